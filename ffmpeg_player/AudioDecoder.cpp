@@ -0,0 +1,182 @@
+#include "AudioDecoder.hpp"
+
+extern "C" {
+#include <libavutil/opt.h>
+#include <libavutil/samplefmt.h>
+#include <libavutil/channel_layout.h>
+}
+
+AudioDecoder::AudioDecoder(AVStream* stream, unsigned outputRate)
+: m_codecCtx(stream->codec)
+, m_sampleRate(outputRate ? outputRate : m_codecCtx->sample_rate)
+, m_inputRate(m_codecCtx->sample_rate)
+, m_dstData(NULL)
+, m_decodeStats("audio decode")
+, m_resampleStats("audio resample")
+{
+    m_audioFrame = av_frame_alloc();
+
+    initResampler();
+}
+
+AudioDecoder::~AudioDecoder()
+{
+    av_frame_free(&m_audioFrame);
+    if(m_dstData)
+        av_freep(&m_dstData[0]);
+    av_freep(&m_dstData);
+    swr_free(&m_swrCtx);
+}
+
+bool AudioDecoder::initResampler()
+{
+    m_dstNbChannels = av_get_channel_layout_nb_channels(AV_CH_LAYOUT_STEREO);
+
+    m_swrCtx = swr_alloc();
+    if(!m_swrCtx)
+    {
+        av_log(NULL, AV_LOG_ERROR, "couldn't allocate the audio resampler\n");
+        return false;
+    }
+
+    if(m_codecCtx->channel_layout == 0)
+    {
+        m_codecCtx->channel_layout = av_get_default_channel_layout(m_codecCtx->channels);
+    }
+
+    /* set options */
+    av_opt_set_int(m_swrCtx, "in_channel_layout",    m_codecCtx->channel_layout, 0);
+    av_opt_set_int(m_swrCtx, "in_sample_rate",       m_inputRate, 0);
+    av_opt_set_sample_fmt(m_swrCtx, "in_sample_fmt", m_codecCtx->sample_fmt, 0);
+    av_opt_set_int(m_swrCtx, "out_channel_layout",    AV_CH_LAYOUT_STEREO, 0);
+    av_opt_set_int(m_swrCtx, "out_sample_rate",       m_sampleRate, 0);
+    av_opt_set_sample_fmt(m_swrCtx, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
+
+    if(swr_init(m_swrCtx) < 0)
+    {
+        // Without a resampler every frame is skipped, the audio stays silent
+        av_log(NULL, AV_LOG_ERROR, "couldn't set up the audio resampler\n");
+        swr_free(&m_swrCtx);
+        return false;
+    }
+
+    // Set up again on a speed change, the output buffer is kept
+    if(m_dstData)
+        return true;
+
+    m_maxDstNbSamples = m_dstNbSamples = 1024;
+
+    if(av_samples_alloc_array_and_samples(&m_dstData, &m_dstLinesize, m_dstNbChannels, m_dstNbSamples, AV_SAMPLE_FMT_S16, 0) < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "couldn't allocate the audio resampling buffer\n");
+        m_dstData = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void AudioDecoder::setSpeed(double speed)
+{
+    const int inputRate = (int)(m_codecCtx->sample_rate * speed + 0.5);
+    if(inputRate == m_inputRate)
+        return;
+
+    m_inputRate = inputRate;
+    swr_free(&m_swrCtx);
+    initResampler();
+}
+
+bool AudioDecoder::decodePacket(AVPacket* packet, AVFrame* outputFrame, bool& gotFrame)
+{
+    bool needsMoreDecoding = false;
+    int igotFrame = 0;
+
+    int decodedLength = avcodec_decode_audio4(m_codecCtx, outputFrame, &igotFrame, packet);
+    gotFrame = (igotFrame != 0);
+
+    if(decodedLength >= 0 && decodedLength < packet->size)
+    {
+        needsMoreDecoding = true;
+        packet->data += decodedLength;
+        packet->size -= decodedLength;
+    }
+
+    return needsMoreDecoding;
+}
+
+bool AudioDecoder::resampleFrame(AVFrame *frame, uint8_t *&outSamples, int &outNbSamples, int &outSamplesLength)
+{
+    if(!m_swrCtx || !m_dstData)
+        return false;
+
+    int src_rate = m_inputRate;
+    int dst_rate = m_sampleRate;
+
+    m_dstNbSamples = av_rescale_rnd(swr_get_delay(m_swrCtx, src_rate) + frame->nb_samples, dst_rate, src_rate, AV_ROUND_UP);
+
+    if(m_dstNbSamples > m_maxDstNbSamples)
+    {
+        av_freep(&m_dstData[0]);
+        m_maxDstNbSamples = 0;
+        if(av_samples_alloc(m_dstData, &m_dstLinesize, m_dstNbChannels, m_dstNbSamples, AV_SAMPLE_FMT_S16, 1) < 0)
+        {
+            av_log(NULL, AV_LOG_ERROR, "couldn't grow the audio resampling buffer to %d samples\n", m_dstNbSamples);
+            return false;
+        }
+        m_maxDstNbSamples = m_dstNbSamples;
+    }
+
+    const int converted = swr_convert(m_swrCtx, m_dstData, m_dstNbSamples, (const uint8_t**)frame->extended_data, frame->nb_samples);
+    if(converted < 0)
+    {
+        av_log(NULL, AV_LOG_WARNING, "audio resampling failed, frame skipped\n");
+        return false;
+    }
+
+    int dst_bufsize = av_samples_get_buffer_size(&m_dstLinesize, m_dstNbChannels, converted, AV_SAMPLE_FMT_S16, 1);
+    if(dst_bufsize < 0)
+        return false;
+
+    outNbSamples = dst_bufsize / av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
+    outSamplesLength = dst_bufsize;
+    outSamples = m_dstData[0];
+    return true;
+}
+
+bool AudioDecoder::decode(AVPacket* packet, const SampleSink& sink)
+{
+    bool needsMoreDecoding = false;
+    bool gotFrame = false;
+
+    do {
+        {
+            StageTimer timer(m_decodeStats);
+            needsMoreDecoding = decodePacket(packet, m_audioFrame, gotFrame);
+        }
+
+        if (gotFrame)
+        {
+            uint8_t* samples = NULL;
+            int nbSamples = 0;
+            int samplesLength = 0;
+
+            bool resampled = false;
+            {
+                StageTimer timer(m_resampleStats);
+                resampled = resampleFrame(m_audioFrame, samples, nbSamples, samplesLength);
+            }
+
+            if(resampled && !sink((const sf::Int16*)samples, nbSamples))
+                return false;
+        }
+
+    }while (needsMoreDecoding);
+
+    return true;
+}
+
+void AudioDecoder::flush()
+{
+    avcodec_flush_buffers(m_codecCtx);
+}
@@ -0,0 +1,85 @@
+#ifndef AUDIO_DECODER_HPP
+#define AUDIO_DECODER_HPP
+
+#include <SFML/Config.hpp>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+}
+
+#include "StageStats.hpp"
+
+#include <functional>
+
+//
+// Decodes audio packets and resamples them to interleaved stereo S16 at the
+// stream's sample rate, or at outputRate when given. Not thread-safe; owned
+// by whichever thread decodes.
+//
+class AudioDecoder
+{
+public:
+    typedef std::function<bool(const sf::Int16* samples, size_t count)> SampleSink;
+
+    explicit AudioDecoder(AVStream* stream, unsigned outputRate = 0);
+    ~AudioDecoder();
+
+    // Hands every decoded block of the packet to sink. Returns false as
+    // soon as sink does.
+    bool decode(AVPacket* packet, const SampleSink& sink);
+
+    void flush();
+
+    // Plays the stream that much faster (and higher) by resampling it from
+    // a correspondingly higher rate
+    void setSpeed(double speed);
+
+    unsigned sampleRate() const
+    {
+        return m_sampleRate;
+    }
+
+    unsigned channelCount() const
+    {
+        return m_dstNbChannels;
+    }
+
+    const StageStats& decodeStats() const
+    {
+        return m_decodeStats;
+    }
+
+    const StageStats& resampleStats() const
+    {
+        return m_resampleStats;
+    }
+
+private:
+    AudioDecoder(const AudioDecoder&);
+    AudioDecoder& operator=(const AudioDecoder&);
+
+    bool decodePacket(AVPacket* packet, AVFrame* outputFrame, bool& gotFrame);
+    // Both log and return false on failure; frames are then skipped
+    bool initResampler();
+    bool resampleFrame(AVFrame* frame, uint8_t*& outSamples, int& outNbSamples, int& outSamplesLength);
+
+    AVCodecContext* m_codecCtx;
+    unsigned m_sampleRate;
+    // The rate the resampler takes the input to be at
+    int m_inputRate;
+    AVFrame* m_audioFrame;
+
+    SwrContext* m_swrCtx;
+    int m_dstNbSamples;
+    int m_maxDstNbSamples;
+    int m_dstNbChannels;
+    int m_dstLinesize;
+    uint8_t** m_dstData;
+
+    StageStats m_decodeStats;
+    StageStats m_resampleStats;
+};
+
+#endif
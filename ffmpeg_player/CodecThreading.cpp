@@ -0,0 +1,107 @@
+#include "CodecThreading.hpp"
+
+#include <thread>
+#include <algorithm>
+
+// Beyond this libavcodec's frame threading stops scaling and only adds delay
+const int MaxAutoThreads = 16;
+
+bool parseThreadType(const std::string& name, CodecThreading::Type& type)
+{
+    if(name == "auto")
+        type = CodecThreading::Auto;
+    else if(name == "none")
+        type = CodecThreading::None;
+    else if(name == "frame")
+        type = CodecThreading::Frame;
+    else if(name == "slice")
+        type = CodecThreading::Slice;
+    else
+        return false;
+
+    return true;
+}
+
+static int autoThreadCount(const AVCodecContext* ctx)
+{
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+
+    // Audio decoders are cheap and mostly single threaded anyway
+    if(ctx->codec_type != AVMEDIA_TYPE_VIDEO)
+        return 1;
+
+    // Small pictures don't have enough work to keep many threads busy
+    const int pixels = ctx->width * ctx->height;
+    int wanted = cores;
+    if(pixels <= 720 * 576)
+        wanted = std::min(cores, 4);
+    else if(pixels <= 1280 * 720)
+        wanted = std::min(cores, 8);
+
+    return std::min(wanted, MaxAutoThreads);
+}
+
+void configureCodecThreading(AVCodecContext* ctx, const AVCodec* codec, const CodecThreading& threading)
+{
+    if(threading.type == CodecThreading::None)
+    {
+        ctx->thread_count = 1;
+        return;
+    }
+
+    ctx->thread_count = threading.threads > 0 ? threading.threads : autoThreadCount(ctx);
+
+    switch (threading.type)
+    {
+        case CodecThreading::Frame:
+            ctx->thread_type = FF_THREAD_FRAME;
+            break;
+        case CodecThreading::Slice:
+            ctx->thread_type = FF_THREAD_SLICE;
+            break;
+        default:
+            // Frame threading scales better when the codec has it; slice
+            // threading is the fallback and adds no delay
+            if(codec && (codec->capabilities & CODEC_CAP_FRAME_THREADS))
+                ctx->thread_type = FF_THREAD_FRAME;
+            else
+                ctx->thread_type = FF_THREAD_SLICE;
+            break;
+    }
+}
+
+int frameThreadingDelayFrames(const AVCodecContext* ctx)
+{
+    if(!(ctx->active_thread_type & FF_THREAD_FRAME))
+        return 0;
+
+    return std::max(0, ctx->thread_count - 1);
+}
+
+double frameThreadingDelayMs(const AVCodecContext* ctx, const AVStream* stream)
+{
+    AVRational rate = stream->avg_frame_rate;
+    if(rate.num <= 0 || rate.den <= 0)
+        rate = stream->r_frame_rate;
+    if(rate.num <= 0 || rate.den <= 0)
+        return 0;
+
+    return frameThreadingDelayFrames(ctx) * 1000.0 / av_q2d(rate);
+}
+
+void printCodecThreading(std::ostream& out, const char* label, const AVCodecContext* ctx, const AVStream* stream)
+{
+    const char* type = "none";
+    if(ctx->active_thread_type & FF_THREAD_FRAME)
+        type = "frame";
+    else if(ctx->active_thread_type & FF_THREAD_SLICE)
+        type = "slice";
+
+    out << label << " decoder: " << ctx->thread_count << " thread(s), " << type << " threading";
+    if(ctx->active_thread_type & FF_THREAD_FRAME)
+    {
+        out << ", adds " << frameThreadingDelayFrames(ctx) << " frame(s) / "
+            << frameThreadingDelayMs(ctx, stream) << " ms of decoder delay";
+    }
+    out << std::endl;
+}
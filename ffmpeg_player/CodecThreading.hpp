@@ -0,0 +1,45 @@
+#ifndef CODEC_THREADING_HPP
+#define CODEC_THREADING_HPP
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <ostream>
+#include <string>
+
+//
+// How libavcodec should spread decoding of one stream over threads.
+//
+struct CodecThreading
+{
+    enum Type
+    {
+        Auto,
+        None,
+        Frame,
+        Slice
+    };
+
+    Type type = Auto;
+
+    // 0 picks a count from the core count and the stream's resolution
+    int threads = 0;
+};
+
+bool parseThreadType(const std::string& name, CodecThreading::Type& type);
+
+// Sets thread_count/thread_type on ctx. Must be called before avcodec_open2.
+void configureCodecThreading(AVCodecContext* ctx, const AVCodec* codec, const CodecThreading& threading);
+
+// Frame threading holds back thread_count - 1 frames inside the decoder.
+// Presentation is driven by PTS so this doesn't skew A/V sync, but it is
+// extra pipeline latency at startup and after every seek. Valid after
+// avcodec_open2.
+int frameThreadingDelayFrames(const AVCodecContext* ctx);
+double frameThreadingDelayMs(const AVCodecContext* ctx, const AVStream* stream);
+
+void printCodecThreading(std::ostream& out, const char* label, const AVCodecContext* ctx, const AVStream* stream);
+
+#endif
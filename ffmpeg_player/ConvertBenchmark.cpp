@@ -0,0 +1,270 @@
+#include "ConvertBenchmark.hpp"
+#include "RgbaConverter.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include <chrono>
+#include <iomanip>
+#include <cstdlib>
+
+namespace
+{
+    struct Resolution
+    {
+        const char* name;
+        int width;
+        int height;
+    };
+
+    const Resolution Resolutions[] = {
+        { "720p",  1280,  720 },
+        { "1080p", 1920, 1080 },
+        { "4K",    3840, 2160 },
+    };
+
+    const int Iterations = 30;
+
+    double elapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Average ms per frame through a kernel, or a negative value if the CPU
+    // doesn't have it
+    double timeKernel(RgbaConverter::Path path, const AVPicture& src, int w, int h, uint8_t* rgba)
+    {
+        if(!RgbaConverter::isSupported(path, PIX_FMT_YUV420P))
+            return -1;
+
+        RgbaConverter converter(w, h, PIX_FMT_YUV420P, path);
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < Iterations; ++n)
+        {
+            converter.convert(src.data, src.linesize, rgba, w * 4);
+        }
+        return elapsedMs(start) / Iterations;
+    }
+
+    void printMs(std::ostream& out, int width, double ms)
+    {
+        if(ms < 0)
+            out << std::setw(width) << "n/a";
+        else
+            out << std::setw(width) << ms;
+    }
+
+    // Gradients with noise on top, so every chroma pair differs and the
+    // values reach both ends of the range
+    void fillPlane(uint8_t* data, int linesize, int w, int h, int bytesPerSample, int maxValue, unsigned& seed)
+    {
+        for (int y = 0; y < h; ++y)
+        {
+            for (int x = 0; x < w; ++x)
+            {
+                seed = seed * 1103515245 + 12345;
+                int value = ((x * 7 + y * 3) + (int)(seed >> 16) % 64) % (maxValue + 1);
+                if(bytesPerSample == 2)
+                    ((uint16_t*)(data + y * linesize))[x] = (uint16_t)value;
+                else
+                    data[y * linesize + x] = (uint8_t)value;
+            }
+        }
+    }
+
+    struct Comparison
+    {
+        int maxDiff;
+        double meanDiff;
+    };
+
+    Comparison compareRgba(const uint8_t* a, const uint8_t* b, int w, int h)
+    {
+        Comparison c = { 0, 0 };
+        double total = 0;
+        const int n = w * h * 4;
+        for (int i = 0; i < n; ++i)
+        {
+            int d = std::abs((int)a[i] - (int)b[i]);
+            if(d > c.maxDiff)
+                c.maxDiff = d;
+            total += d;
+        }
+        c.meanDiff = total / n;
+        return c;
+    }
+}
+
+int runConvertBenchmark(std::ostream& out)
+{
+    out << std::fixed << std::setprecision(2);
+    out << "resolution  two-pass ms  direct ms  sse2 ms  avx2 ms  two-pass MB/frame  direct MB/frame  saved MB/frame\n";
+
+    for (const auto& res : Resolutions)
+    {
+        const int w = res.width;
+        const int h = res.height;
+
+        AVPicture src;
+        avpicture_alloc(&src, PIX_FMT_YUV420P, w, h);
+
+        // Something that isn't flat so swscale can't take shortcuts
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+                src.data[0][y * src.linesize[0] + x] = (uint8_t)(x + y);
+        for (int y = 0; y < h / 2; ++y)
+            for (int x = 0; x < w / 2; ++x)
+            {
+                src.data[1][y * src.linesize[1] + x] = (uint8_t)(x * 2);
+                src.data[2][y * src.linesize[2] + x] = (uint8_t)(y * 2);
+            }
+
+        AVPicture rgb;
+        avpicture_alloc(&rgb, PIX_FMT_RGB24, w, h);
+        uint8_t* rgba = (uint8_t*)av_malloc(w * h * 4);
+        uint8_t* rgbaData[4] = { rgba, NULL, NULL, NULL };
+        int rgbaLinesize[4] = { w * 4, 0, 0, 0 };
+
+        SwsContext* toRGB = sws_getContext(w, h, PIX_FMT_YUV420P, w, h, PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
+        SwsContext* toRGBA = sws_getContext(w, h, PIX_FMT_YUV420P, w, h, PIX_FMT_RGBA, SWS_BILINEAR, NULL, NULL, NULL);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < Iterations; ++n)
+        {
+            sws_scale(toRGB, src.data, src.linesize, 0, h, rgb.data, rgb.linesize);
+
+            const int FrameSize = w * h * 3;
+            for (int i = 0, j = 0; i < FrameSize; i += 3, j += 4)
+            {
+                rgba[j + 0] = rgb.data[0][i + 0];
+                rgba[j + 1] = rgb.data[0][i + 1];
+                rgba[j + 2] = rgb.data[0][i + 2];
+                rgba[j + 3] = 255;
+            }
+        }
+        double twoPassMs = elapsedMs(start) / Iterations;
+
+        start = std::chrono::steady_clock::now();
+        for (int n = 0; n < Iterations; ++n)
+        {
+            sws_scale(toRGBA, src.data, src.linesize, 0, h, rgbaData, rgbaLinesize);
+        }
+        double directMs = elapsedMs(start) / Iterations;
+
+        double sse2Ms = timeKernel(RgbaConverter::Sse2Path, src, w, h, rgba);
+        double avx2Ms = timeKernel(RgbaConverter::Avx2Path, src, w, h, rgba);
+
+        // Bytes touched after the YUV planes have been read, which both paths
+        // share: the two-pass path writes RGB24, reads it back and writes RGBA.
+        const double MB = 1024.0 * 1024.0;
+        double twoPassBytes = (3.0 + 3.0 + 4.0) * w * h;
+        double directBytes = 4.0 * w * h;
+
+        out << std::setw(10) << res.name
+            << std::setw(13) << twoPassMs
+            << std::setw(11) << directMs;
+        printMs(out, 9, sse2Ms);
+        printMs(out, 9, avx2Ms);
+        out << std::setw(19) << twoPassBytes / MB
+            << std::setw(17) << directBytes / MB
+            << std::setw(16) << (twoPassBytes - directBytes) / MB << "\n";
+
+        sws_freeContext(toRGBA);
+        sws_freeContext(toRGB);
+        av_free(rgba);
+        avpicture_free(&rgb);
+        avpicture_free(&src);
+    }
+
+    return 0;
+}
+
+int runConvertCheck(std::ostream& out)
+{
+    // swscale and the kernels round differently; anything past this is a bug.
+    // Noisy chroma on purpose: every sample differs from its neighbours, so
+    // taking it from the wrong place shows.
+    const int MaxAllowedDiff = 4;
+    const double MaxAllowedMean = 1.0;
+
+    const AVPixelFormat Formats[] = { PIX_FMT_YUV420P, PIX_FMT_NV12, PIX_FMT_YUV420P10LE };
+    const char* FormatNames[] = { "yuv420p", "nv12", "yuv420p10" };
+    const RgbaConverter::Path Kernels[] = { RgbaConverter::Sse2Path, RgbaConverter::Avx2Path };
+    // The odd size leaves a scalar tail and a half chroma pair on every row
+    const Resolution Sizes[] = { { "720p", 1280, 720 }, { "odd", 1917, 1081 } };
+
+    int failures = 0;
+    out << std::fixed << std::setprecision(3);
+
+    for (int f = 0; f < 3; ++f)
+    {
+        const AVPixelFormat format = Formats[f];
+        for (const auto& size : Sizes)
+        {
+            const int w = size.width;
+            const int h = size.height;
+
+            AVPicture src;
+            avpicture_alloc(&src, format, w, h);
+
+            unsigned seed = 1;
+            const int chromaW = (w + 1) / 2;
+            const int chromaH = (h + 1) / 2;
+            if(format == PIX_FMT_NV12)
+            {
+                fillPlane(src.data[0], src.linesize[0], w, h, 1, 255, seed);
+                fillPlane(src.data[1], src.linesize[1], chromaW * 2, chromaH, 1, 255, seed);
+            }
+            else
+            {
+                const int bytes = format == PIX_FMT_YUV420P10LE ? 2 : 1;
+                const int maxValue = bytes == 2 ? 1023 : 255;
+                fillPlane(src.data[0], src.linesize[0], w, h, bytes, maxValue, seed);
+                fillPlane(src.data[1], src.linesize[1], chromaW, chromaH, bytes, maxValue, seed);
+                fillPlane(src.data[2], src.linesize[2], chromaW, chromaH, bytes, maxValue, seed);
+            }
+
+            uint8_t* reference = (uint8_t*)av_malloc(w * h * 4);
+            uint8_t* rgba = (uint8_t*)av_malloc(w * h * 4);
+
+            // The kernels take each pixel's chroma from its 2x2 block as is,
+            // so the reference is swscale told to do the same. The player's
+            // own swscale path interpolates chroma and would differ on every
+            // sharp chroma edge.
+            SwsContext* pointCtx = sws_getContext(w, h, format, w, h, PIX_FMT_RGBA, SWS_POINT, NULL, NULL, NULL);
+            uint8_t* referenceData[4] = { reference, NULL, NULL, NULL };
+            int referenceLinesize[4] = { w * 4, 0, 0, 0 };
+            sws_scale(pointCtx, src.data, src.linesize, 0, h, referenceData, referenceLinesize);
+            sws_freeContext(pointCtx);
+
+            for (auto path : Kernels)
+            {
+                RgbaConverter converter(w, h, format, path);
+                if(converter.path() != path)
+                {
+                    out << FormatNames[f] << " " << size.name << " " << (path == RgbaConverter::Avx2Path ? "avx2" : "sse2") << ": not supported by this CPU\n";
+                    continue;
+                }
+
+                converter.convert(src.data, src.linesize, rgba, w * 4);
+                Comparison c = compareRgba(reference, rgba, w, h);
+                bool ok = c.maxDiff <= MaxAllowedDiff && c.meanDiff <= MaxAllowedMean;
+                if(!ok)
+                    ++failures;
+
+                out << FormatNames[f] << " " << size.name << " " << converter.pathName()
+                    << ": max diff " << c.maxDiff << ", mean diff " << c.meanDiff
+                    << (ok ? "  ok" : "  FAILED") << "\n";
+            }
+
+            av_free(rgba);
+            av_free(reference);
+            avpicture_free(&src);
+        }
+    }
+
+    out << (failures ? "conversion check failed" : "conversion check passed") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,17 @@
+#ifndef CONVERT_BENCHMARK_HPP
+#define CONVERT_BENCHMARK_HPP
+
+#include <ostream>
+
+// Times the old two-pass colour conversion (swscale to RGB24, then a scalar
+// RGB24 -> RGBA expansion) against the direct swscale -> RGBA path and the
+// SSE2/AVX2 kernels on synthetic yuv420p frames at 720p, 1080p and 4K, and
+// prints the per-frame memory traffic each path generates.
+int runConvertBenchmark(std::ostream& out);
+
+// Converts synthetic yuv420p, nv12 and yuv420p10 frames with every kernel
+// the CPU supports and compares them against swscale. Returns non-zero if a
+// kernel is off by more than rounding.
+int runConvertCheck(std::ostream& out);
+
+#endif
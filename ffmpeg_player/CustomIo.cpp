@@ -0,0 +1,70 @@
+#include "CustomIo.hpp"
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#include <stdio.h>
+
+// What the AVIOContext asks the source for at a time. Larger than FFmpeg's
+// default so each read() crosses into the source less often.
+const int CustomIoBufferSize = 64 << 10;
+
+CustomIo::CustomIo(std::unique_ptr<InputSource> source)
+: m_source(std::move(source))
+, m_avio(NULL)
+, m_position(0)
+{
+    uint8_t* buffer = (uint8_t*)av_malloc(CustomIoBufferSize);
+    if(buffer)
+        m_avio = avio_alloc_context(buffer, CustomIoBufferSize, 0, this, &CustomIo::readPacket, NULL, &CustomIo::seek);
+    if(!m_avio)
+        av_free(buffer);
+}
+
+CustomIo::~CustomIo()
+{
+    if(m_avio)
+    {
+        // The context may have swapped its buffer for another one by now
+        av_freep(&m_avio->buffer);
+        av_freep(&m_avio);
+    }
+}
+
+int CustomIo::readPacket(void* opaque, uint8_t* buffer, int size)
+{
+    CustomIo* io = (CustomIo*)opaque;
+    int ret = io->m_source->read(buffer, size);
+    if(ret > 0)
+        io->m_position += ret;
+    return ret;
+}
+
+int64_t CustomIo::seek(void* opaque, int64_t offset, int whence)
+{
+    CustomIo* io = (CustomIo*)opaque;
+    InputSource& source = *io->m_source;
+
+    if(whence & AVSEEK_SIZE)
+        return source.size();
+
+    switch (whence & ~AVSEEK_FORCE)
+    {
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += io->m_position;
+            break;
+        case SEEK_END:
+            offset += source.size();
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+
+    int64_t ret = source.seek(offset);
+    if(ret >= 0)
+        io->m_position = ret;
+    return ret;
+}
@@ -0,0 +1,44 @@
+#ifndef CUSTOM_IO_HPP
+#define CUSTOM_IO_HPP
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+#include "InputSource.hpp"
+
+#include <memory>
+
+//
+// An AVIOContext reading from an InputSource, to be set as the format
+// context's pb before avformat_open_input. Must outlive the format context.
+//
+class CustomIo
+{
+public:
+    explicit CustomIo(std::unique_ptr<InputSource> source);
+    ~CustomIo();
+
+    AVIOContext* context() const
+    {
+        return m_avio;
+    }
+
+    const InputSource& source() const
+    {
+        return *m_source;
+    }
+
+private:
+    CustomIo(const CustomIo&);
+    CustomIo& operator=(const CustomIo&);
+
+    static int readPacket(void* opaque, uint8_t* buffer, int size);
+    static int64_t seek(void* opaque, int64_t offset, int whence);
+
+    std::unique_ptr<InputSource> m_source;
+    AVIOContext* m_avio;
+    int64_t m_position;
+};
+
+#endif
@@ -0,0 +1,363 @@
+#include "Demuxer.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+// Arrival times remembered for the latency measurement, a few seconds' worth
+const size_t MaxArrivals = 256;
+
+Demuxer::Demuxer(AVFormatContext* ctx, int videoStream, int audioStream, PacketPool& pool, PacketQueue& videoQueue, PacketQueue& audioQueue)
+: m_formatCtx(ctx)
+, m_videoStreamIndex(videoStream)
+, m_audioStreamIndex(audioStream)
+, m_pool(pool)
+, m_videoQueue(videoQueue)
+, m_audioQueue(audioQueue)
+, m_index(NULL)
+, m_budget(NULL)
+, m_exactSeek(true)
+, m_live(false)
+, m_quit(false)
+, m_seekRequested(false)
+, m_seekTarget(0)
+, m_trickRequested(false)
+, m_trickDirection(0)
+, m_trickStepMs(0)
+, m_lastSeekUsedIndex(false)
+, m_eof(false)
+, m_keyframeDirection(0)
+, m_keyframeStepMs(0)
+, m_lastKeyframeMs(INT64_MIN)
+, m_rewound(false)
+, m_trickHops(0)
+, m_newestVideoMs(INT64_MIN)
+, m_readStats("demux read")
+, m_queueWaits(0)
+, m_budgetWaits(0)
+{
+    if(videoStream >= 0)
+        m_videoQueue.setTimeBase(ctx->streams[videoStream]->time_base);
+    if(audioStream >= 0)
+        m_audioQueue.setTimeBase(ctx->streams[audioStream]->time_base);
+}
+
+Demuxer::~Demuxer()
+{
+    stop();
+}
+
+void Demuxer::start()
+{
+    m_quit = false;
+    m_thread = std::thread(&Demuxer::run, this);
+}
+
+void Demuxer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_quit = true;
+    }
+    m_cond.notify_all();
+
+    if(m_thread.joinable())
+        m_thread.join();
+}
+
+void Demuxer::seek(int64_t targetMs)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_seekRequested = true;
+        m_seekTarget = targetMs;
+        m_seekRequestTime = std::chrono::steady_clock::now();
+    }
+    m_cond.notify_all();
+}
+
+void Demuxer::setTrickPlay(int direction, int64_t stepMs, int64_t fromMs)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_trickRequested = true;
+        m_trickDirection = direction;
+        m_trickStepMs = stepMs;
+        m_seekRequested = true;
+        m_seekTarget = fromMs;
+        m_seekRequestTime = std::chrono::steady_clock::now();
+    }
+    m_cond.notify_all();
+}
+
+std::chrono::steady_clock::time_point Demuxer::lastSeekRequestTime() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    return m_seekRequestTime;
+}
+
+bool Demuxer::queuesFull()
+{
+    if(m_budget && m_budget->isHardExceeded())
+    {
+        ++m_budgetWaits;
+        return true;
+    }
+
+    if(m_videoQueue.isHardFull() || m_audioQueue.isHardFull())
+    {
+        ++m_queueWaits;
+        return true;
+    }
+
+    // Keep reading past the soft limits while a stream is starving,
+    // otherwise a badly interleaved file would stall playback.
+    bool videoStarving = m_videoStreamIndex >= 0 && m_videoQueue.isEmpty();
+    bool audioStarving = m_audioStreamIndex >= 0 && !m_keyframeDirection && m_audioQueue.isEmpty();
+    if(videoStarving || audioStarving)
+        return false;
+
+    if(m_budget && m_budget->isExceeded())
+    {
+        ++m_budgetWaits;
+        return true;
+    }
+
+    if(m_videoQueue.isFull() || m_audioQueue.isFull())
+    {
+        ++m_queueWaits;
+        return true;
+    }
+
+    return false;
+}
+
+void Demuxer::run()
+{
+    traceThreadName("demuxer");
+
+    while (true)
+    {
+        int64_t seekTarget = 0;
+        {
+            std::unique_lock<std::mutex> lk(m_mut);
+            if(m_eof || m_rewound)
+            {
+                m_cond.wait(lk, [this]{ return m_quit || m_seekRequested; });
+            }
+            else if(!m_quit && !m_seekRequested && queuesFull())
+            {
+                // Consumers don't signal us when they pop, poll instead.
+                // seek() and stop() still wake us up immediately.
+                m_cond.wait_for(lk, std::chrono::milliseconds(10));
+                continue;
+            }
+
+            if(m_quit)
+                break;
+
+            if(m_seekRequested)
+            {
+                m_seekRequested = false;
+                seekTarget = m_seekTarget;
+                const bool trickRequested = m_trickRequested;
+                const int direction = m_trickDirection;
+                const int64_t stepMs = m_trickStepMs;
+                m_trickRequested = false;
+                lk.unlock();
+
+                if(trickRequested)
+                    applyTrickPlay(direction, stepMs);
+                doSeek(seekTarget);
+                continue;
+            }
+        }
+
+        PacketHandle packet = m_pool.acquire();
+        if(!packet)
+        {
+            // Out of memory. What the decoders hand back may be enough to
+            // go on with.
+            std::unique_lock<std::mutex> lk(m_mut);
+            m_cond.wait_for(lk, std::chrono::milliseconds(10));
+            continue;
+        }
+
+        int ret = 0;
+        {
+            StageTimer timer(m_readStats);
+            ret = av_read_frame(m_formatCtx, packet.get());
+        }
+
+        if(ret < 0)
+        {
+            m_eof = true;
+            m_videoQueue.setEof();
+            m_audioQueue.setEof();
+            continue;
+        }
+
+        // The packet may point into the demuxer's internal buffer, which is
+        // only valid until the next av_read_frame.
+        if(!m_pool.makeRefcounted(packet.get()))
+            continue;
+
+        if(packet->stream_index == m_videoStreamIndex)
+        {
+            if(m_keyframeDirection && !hopKeyframe(packet.get()))
+                continue;
+
+            if(m_live)
+                recordArrival(packet.get());
+            m_videoQueue.push(std::move(packet));
+        }
+        else if(packet->stream_index == m_audioStreamIndex && !m_keyframeDirection)
+        {
+            m_audioQueue.push(std::move(packet));
+        }
+    }
+}
+
+void Demuxer::doSeek(int64_t targetMs)
+{
+    if(traceEnabled())
+        traceInstant("seek", "targetMs", targetMs);
+
+    int ret = -1;
+    KeyframeIndex::Entry keyframe;
+    if(m_index && m_index->find(targetMs, keyframe))
+    {
+        // Land exactly on the keyframe opening the target's GOP
+        ret = avformat_seek_file(m_formatCtx, m_videoStreamIndex, INT64_MIN, keyframe.timestamp, keyframe.timestamp, 0);
+    }
+    m_lastSeekUsedIndex = ret >= 0;
+
+    if(ret < 0)
+    {
+        const AVRational msTimeBase = {1, 1000};
+        AVStream* stream = m_formatCtx->streams[m_videoStreamIndex];
+        const int64_t startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+        int64_t seekTarget = startTime + av_rescale_q(targetMs, msTimeBase, stream->time_base);
+
+        ret = avformat_seek_file(m_formatCtx, m_videoStreamIndex, 0, seekTarget, seekTarget, AVSEEK_FLAG_BACKWARD);
+    }
+
+    if(ret < 0)
+    {
+        av_log(NULL, AV_LOG_WARNING, "seek to %lld ms failed\n", (long long)targetMs);
+        return;
+    }
+
+    m_eof = false;
+    m_rewound = false;
+    m_lastKeyframeMs = INT64_MIN;
+    m_newestVideoMs = INT64_MIN;
+
+    // Decoding forward to the target would mean decoding what trick play
+    // skips
+    m_videoQueue.flush(m_exactSeek && !m_keyframeDirection ? targetMs : -1);
+    m_audioQueue.flush();
+}
+
+void Demuxer::recordArrival(const AVPacket* packet)
+{
+    const int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if(ts == AV_NOPTS_VALUE)
+        return;
+
+    const AVStream* stream = m_formatCtx->streams[m_videoStreamIndex];
+    const int64_t startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    const int64_t ms = 1000 * (ts - startTime) * av_q2d(stream->time_base);
+
+    // Reordered pictures arrive before ones they are shown after
+    if(ms > m_newestVideoMs)
+        m_newestVideoMs = ms;
+
+    std::lock_guard<std::mutex> lk(m_arrivalMut);
+    m_arrivals.push_back(std::make_pair(ms, std::chrono::steady_clock::now()));
+    if(m_arrivals.size() > MaxArrivals)
+        m_arrivals.pop_front();
+}
+
+bool Demuxer::arrivalTime(int64_t ptsMs, std::chrono::steady_clock::time_point& when) const
+{
+    std::lock_guard<std::mutex> lk(m_arrivalMut);
+
+    // The frame asked about is usually among the oldest remembered
+    for (const auto& arrival : m_arrivals)
+    {
+        if(arrival.first == ptsMs)
+        {
+            when = arrival.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Demuxer::applyTrickPlay(int direction, int64_t stepMs)
+{
+    m_keyframeDirection = direction;
+    m_keyframeStepMs = stepMs;
+
+    // Demuxers that can skip non-key packets and the audio stream without
+    // reading them do; the rest are dropped here
+    if(m_videoStreamIndex >= 0)
+        m_formatCtx->streams[m_videoStreamIndex]->discard = direction ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+    if(m_audioStreamIndex >= 0)
+        m_formatCtx->streams[m_audioStreamIndex]->discard = direction ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+}
+
+bool Demuxer::hopKeyframe(const AVPacket* packet)
+{
+    // Returns whether to queue the packet, and once it is a keyframe seeks
+    // on to the next one a step away
+    if(!(packet->flags & AV_PKT_FLAG_KEY))
+        return false;
+
+    const AVStream* stream = m_formatCtx->streams[m_videoStreamIndex];
+    const int64_t startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    const int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if(ts == AV_NOPTS_VALUE)
+        return false;
+
+    const int64_t ms = 1000 * (ts - startTime) * av_q2d(stream->time_base);
+    if(m_lastKeyframeMs != INT64_MIN)
+    {
+        // A seek can land back on the keyframe just queued. Forwards the
+        // next one is read instead; backwards it means the start was reached.
+        if(m_keyframeDirection > 0 && ms <= m_lastKeyframeMs)
+            return false;
+
+        if(m_keyframeDirection < 0 && ms >= m_lastKeyframeMs)
+        {
+            m_rewound = true;
+            return false;
+        }
+    }
+    m_lastKeyframeMs = ms;
+    ++m_trickHops;
+
+    const AVRational msTimeBase = {1, 1000};
+    const int64_t targetMs = std::max<int64_t>(0, ms + m_keyframeDirection * m_keyframeStepMs);
+    int64_t target = startTime + av_rescale_q(targetMs, msTimeBase, stream->time_base);
+
+    if(m_keyframeDirection > 0)
+    {
+        // First keyframe at or after the target. Should that fail the file
+        // is read on, its non-key packets dropped.
+        avformat_seek_file(m_formatCtx, m_videoStreamIndex, target, target, INT64_MAX, 0);
+    }
+    else
+    {
+        KeyframeIndex::Entry keyframe;
+        if(m_index && m_index->find(targetMs, keyframe))
+            target = keyframe.timestamp;
+
+        if(avformat_seek_file(m_formatCtx, m_videoStreamIndex, INT64_MIN, target, target, 0) < 0)
+            m_rewound = true;
+    }
+
+    if(traceEnabled())
+        traceInstant("keyframe hop", "ptsMs", ms);
+    return true;
+}
@@ -0,0 +1,175 @@
+#ifndef DEMUXER_HPP
+#define DEMUXER_HPP
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "PacketQueue.hpp"
+#include "StageStats.hpp"
+#include "KeyframeIndex.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <utility>
+
+//
+// Reader thread. Once started it owns the AVFormatContext: it calls
+// av_read_frame, routes packets into the video and audio queues and performs
+// seeks requested from other threads.
+//
+class Demuxer
+{
+public:
+    Demuxer(AVFormatContext* ctx, int videoStream, int audioStream, PacketPool& pool, PacketQueue& videoQueue, PacketQueue& audioQueue);
+    ~Demuxer();
+
+    // Seek through the keyframe index once it is ready. Call before start().
+    void setKeyframeIndex(const KeyframeIndex* index)
+    {
+        m_index = index;
+    }
+
+    // Stop reading while the shared packet budget is used up. Call before
+    // start().
+    void setMemoryBudget(const MemoryBudget* budget)
+    {
+        m_budget = budget;
+    }
+
+    // When on (the default) the video decoder is told to decode forward
+    // from the keyframe to the exact target; otherwise playback resumes at
+    // the keyframe. Call before start().
+    void setExactSeek(bool exact)
+    {
+        m_exactSeek = exact;
+    }
+
+    // Live, the arrival time of each video packet is kept for a while, to
+    // measure how long frames take from arrival to the screen. Call before
+    // start().
+    void setLive(bool live)
+    {
+        m_live = live;
+    }
+
+    void start();
+    void stop();
+
+    // Asynchronous; the seek is carried out by the reader thread, which then
+    // flushes both queues. Consumers notice it through the queue serial.
+    void seek(int64_t targetMs);
+
+    // Trick play. With direction 1 or -1 only video keyframes are queued,
+    // hopping at least stepMs of media time from one to the next, forwards
+    // or backwards; audio isn't read. Direction 0 is normal playback. Like
+    // a seek, playback restarts at fromMs.
+    void setTrickPlay(int direction, int64_t stepMs, int64_t fromMs);
+
+    // Rewinding got to the first keyframe
+    bool isRewound() const
+    {
+        return m_rewound;
+    }
+
+    // Keyframes hopped to in trick play
+    sf::Uint64 trickHops() const
+    {
+        return m_trickHops;
+    }
+
+    // When the latest seek was requested, to measure seek latency
+    std::chrono::steady_clock::time_point lastSeekRequestTime() const;
+
+    // Times reading paused because a queue or the memory budget was full
+    sf::Uint64 queueWaits() const
+    {
+        return m_queueWaits;
+    }
+
+    sf::Uint64 budgetWaits() const
+    {
+        return m_budgetWaits;
+    }
+
+    // Whether the latest completed seek went through the keyframe index
+    bool lastSeekUsedIndex() const
+    {
+        return m_lastSeekUsedIndex;
+    }
+
+    bool isEof() const
+    {
+        return m_eof;
+    }
+
+    // Live, the latest presentation time read from the video stream since
+    // the last seek; INT64_MIN before any
+    int64_t newestVideoMs() const
+    {
+        return m_newestVideoMs;
+    }
+
+    // Live, when the video packet presented at ptsMs was read. False once
+    // it is too long ago to be remembered.
+    bool arrivalTime(int64_t ptsMs, std::chrono::steady_clock::time_point& when) const;
+
+    const StageStats& readStats() const
+    {
+        return m_readStats;
+    }
+
+private:
+    void run();
+    void doSeek(int64_t targetMs);
+    void applyTrickPlay(int direction, int64_t stepMs);
+    bool hopKeyframe(const AVPacket* packet);
+    bool queuesFull();
+    void recordArrival(const AVPacket* packet);
+
+    AVFormatContext* m_formatCtx;
+    int m_videoStreamIndex;
+    int m_audioStreamIndex;
+    PacketPool& m_pool;
+    PacketQueue& m_videoQueue;
+    PacketQueue& m_audioQueue;
+    const KeyframeIndex* m_index;
+    const MemoryBudget* m_budget;
+    bool m_exactSeek;
+    bool m_live;
+
+    std::thread m_thread;
+    mutable std::mutex m_mut;
+    std::condition_variable m_cond;
+    bool m_quit;
+    bool m_seekRequested;
+    int64_t m_seekTarget;
+    bool m_trickRequested;
+    int m_trickDirection;
+    int64_t m_trickStepMs;
+    std::chrono::steady_clock::time_point m_seekRequestTime;
+    std::atomic<bool> m_lastSeekUsedIndex;
+    std::atomic<bool> m_eof;
+
+    // Trick play as applied, reader thread only
+    int m_keyframeDirection;
+    int64_t m_keyframeStepMs;
+    int64_t m_lastKeyframeMs;
+    std::atomic<bool> m_rewound;
+    std::atomic<sf::Uint64> m_trickHops;
+
+    // Live arrivals, newest at the back
+    mutable std::mutex m_arrivalMut;
+    std::deque<std::pair<int64_t, std::chrono::steady_clock::time_point> > m_arrivals;
+    std::atomic<int64_t> m_newestVideoMs;
+
+    StageStats m_readStats;
+    std::atomic<sf::Uint64> m_queueWaits;
+    std::atomic<sf::Uint64> m_budgetWaits;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "FrameCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+namespace
+{
+    // Averages each 2x2 block of RGBA pixels
+    void halve(const sf::Uint8* src, int width, int height, sf::Uint8* dst)
+    {
+        const int outWidth = width / 2;
+        const int outHeight = height / 2;
+        const int srcStride = width * 4;
+
+        for (int y = 0; y < outHeight; ++y)
+        {
+            const sf::Uint8* row0 = src + 2 * y * srcStride;
+            const sf::Uint8* row1 = row0 + srcStride;
+            sf::Uint8* out = dst + y * outWidth * 4;
+
+            for (int x = 0; x < outWidth; ++x)
+            {
+                for (int c = 0; c < 4; ++c)
+                    out[c] = (row0[c] + row0[c + 4] + row1[c] + row1[c + 4] + 2) >> 2;
+
+                row0 += 8;
+                row1 += 8;
+                out += 4;
+            }
+        }
+    }
+}
+
+FrameCache::FrameCache(size_t budgetBytes, Storage storage)
+: m_budget(budgetBytes)
+, m_storage(storage)
+, m_bytes(0)
+, m_peakBytes(0)
+, m_hits(0)
+, m_misses(0)
+{
+}
+
+void FrameCache::add(const VideoFrame& frame)
+{
+    if(!m_frames.empty())
+    {
+        const VideoFrame& newest = m_frames.back().frame;
+        if(frame.serial != newest.serial || frame.ptsMs <= newest.ptsMs)
+            clear();
+    }
+
+    const bool halfSize = m_storage == HalfSize && frame.width >= 2 && frame.height >= 2;
+    const int width = halfSize ? frame.width / 2 : frame.width;
+    const int height = halfSize ? frame.height / 2 : frame.height;
+    const size_t bytes = (size_t)width * height * 4;
+    if(bytes > m_budget)
+        return;
+
+    while (!m_frames.empty() && m_bytes + bytes > m_budget)
+    {
+        m_bytes -= m_frames.front().pixels.size();
+        m_spare.swap(m_frames.front().pixels);
+        m_frames.pop_front();
+    }
+
+    Entry entry;
+    entry.pixels.swap(m_spare);
+    entry.pixels.resize(bytes);
+    if(halfSize)
+        halve(frame.pixels, frame.width, frame.height, entry.pixels.data());
+    else
+        std::memcpy(entry.pixels.data(), frame.pixels, bytes);
+
+    entry.frame = frame;
+    entry.frame.width = width;
+    entry.frame.height = height;
+    m_frames.push_back(std::move(entry));
+
+    // Moving the entry in keeps the vector's buffer, so the pointer stays
+    // good from here on
+    m_frames.back().frame.pixels = m_frames.back().pixels.data();
+
+    m_bytes += bytes;
+    m_peakBytes = std::max(m_peakBytes, m_bytes);
+}
+
+void FrameCache::clear()
+{
+    if(!m_frames.empty())
+        m_spare.swap(m_frames.back().pixels);
+
+    m_frames.clear();
+    m_bytes = 0;
+}
+
+const VideoFrame* FrameCache::lookup(const Entry* entry, bool countMiss)
+{
+    if(entry)
+        ++m_hits;
+    else if(countMiss)
+        ++m_misses;
+
+    return entry ? &entry->frame : NULL;
+}
+
+const VideoFrame* FrameCache::find(sf::Int64 ptsMs)
+{
+    if(m_frames.empty() || ptsMs < m_frames.front().frame.ptsMs || ptsMs > m_frames.back().frame.ptsMs)
+        return lookup(NULL, true);
+
+    auto it = std::upper_bound(m_frames.begin(), m_frames.end(), ptsMs,
+                               [](sf::Int64 ms, const Entry& e){ return ms < e.frame.ptsMs; });
+    return lookup(&*(it - 1), true);
+}
+
+const VideoFrame* FrameCache::previous(sf::Int64 ptsMs)
+{
+    auto it = std::lower_bound(m_frames.begin(), m_frames.end(), ptsMs,
+                               [](const Entry& e, sf::Int64 ms){ return e.frame.ptsMs < ms; });
+    return lookup(it != m_frames.begin() ? &*(it - 1) : NULL, true);
+}
+
+const VideoFrame* FrameCache::next(sf::Int64 ptsMs)
+{
+    auto it = std::upper_bound(m_frames.begin(), m_frames.end(), ptsMs,
+                               [](sf::Int64 ms, const Entry& e){ return ms < e.frame.ptsMs; });
+    return lookup(it != m_frames.end() ? &*it : NULL, false);
+}
+
+void FrameCache::printStats(std::ostream& out) const
+{
+    const sf::Uint64 lookups = m_hits + m_misses;
+
+    out << std::fixed << std::setprecision(1)
+        << "frame cache (" << (m_storage == HalfSize ? "half" : "full") << " size): "
+        << m_frames.size() << " frames, " << m_bytes / (1024 * 1024.0) << " MiB of "
+        << m_budget / (1024 * 1024.0) << " MiB, peak " << m_peakBytes / (1024 * 1024.0) << " MiB; "
+        << m_hits << " hits, " << m_misses << " misses ("
+        << (lookups ? 100.0 * m_hits / lookups : 0.0) << "% hit)" << std::endl;
+}
@@ -0,0 +1,99 @@
+#ifndef FRAME_CACHE_HPP
+#define FRAME_CACHE_HPP
+
+#include <SFML/Config.hpp>
+
+#include "FrameQueue.hpp"
+
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//
+// The frames presented most recently, oldest first, so short backward seeks
+// and frame stepping are served without going back through the demuxer and
+// the video decoder.
+//
+// Frames are copied in as they are presented and evicted oldest first once
+// the budget is used up. The cache only ever holds one run of frames: one
+// with another serial, or older than the newest, starts over. Kept at half
+// size (2x2 box filtered) it holds four times as many frames; the texture
+// stretches them back up.
+//
+// Only the render thread uses it.
+//
+class FrameCache
+{
+public:
+    enum Storage
+    {
+        FullSize,
+        HalfSize
+    };
+
+    // A budget of 0 turns the cache off
+    FrameCache(size_t budgetBytes, Storage storage);
+
+    void add(const VideoFrame& frame);
+    void clear();
+
+    // Lookups return NULL on a miss. The frame stays valid until the next
+    // add() or clear().
+
+    // Latest frame at or before ptsMs, if ptsMs lies within the cache
+    const VideoFrame* find(sf::Int64 ptsMs);
+
+    // Latest frame before ptsMs
+    const VideoFrame* previous(sf::Int64 ptsMs);
+
+    // First frame after ptsMs. Past the newest frame stepping continues
+    // from the frame queue, so only hits are counted.
+    const VideoFrame* next(sf::Int64 ptsMs);
+
+    size_t size() const
+    {
+        return m_frames.size();
+    }
+
+    size_t bytes() const
+    {
+        return m_bytes;
+    }
+
+    sf::Uint64 hits() const
+    {
+        return m_hits;
+    }
+
+    sf::Uint64 misses() const
+    {
+        return m_misses;
+    }
+
+    void printStats(std::ostream& out) const;
+
+private:
+    FrameCache(const FrameCache&);
+    FrameCache& operator=(const FrameCache&);
+
+    struct Entry
+    {
+        std::vector<sf::Uint8> pixels;
+        VideoFrame frame;
+    };
+
+    const VideoFrame* lookup(const Entry* entry, bool countMiss);
+
+    const size_t m_budget;
+    const Storage m_storage;
+    std::deque<Entry> m_frames;
+    // Pixels of the last evicted frame, reused for the next one
+    std::vector<sf::Uint8> m_spare;
+    size_t m_bytes;
+    size_t m_peakBytes;
+    sf::Uint64 m_hits;
+    sf::Uint64 m_misses;
+};
+
+#endif
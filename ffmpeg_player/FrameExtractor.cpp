@@ -0,0 +1,471 @@
+#include "FrameExtractor.hpp"
+
+#include "Options.hpp"
+#include "MediaFile.hpp"
+#include "KeyframeIndex.hpp"
+
+#include <SFML/Graphics.hpp>
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#include <sys/stat.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Frames converted or being written at once, per pool thread. Two keep
+// every thread busy while the decoder produces the next frame.
+const size_t InFlightPerThread = 2;
+// A time further than this past the last decoded frame is sought to
+// rather than decoded up to
+const sf::Int64 SeekAheadMs = 5000;
+
+namespace
+{
+    const char* extensionFor(FrameExtractor::Format format)
+    {
+        static const char* extensions[] = { "rgba", "png", "jpg", "bmp" };
+        return extensions[format];
+    }
+
+    bool makeDirectory(const std::string& path)
+    {
+        return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+    }
+
+    // File name without directory or extension
+    std::string baseName(const std::string& path)
+    {
+        const size_t slash = path.find_last_of('/');
+        std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+        const size_t dot = name.find_last_of('.');
+        if(dot != std::string::npos && dot > 0)
+            name.erase(dot);
+        return name;
+    }
+}
+
+bool parseExtractFormat(const std::string& name, FrameExtractor::Format& format)
+{
+    if(name == "raw")
+        format = FrameExtractor::RawFormat;
+    else if(name == "png")
+        format = FrameExtractor::PngFormat;
+    else if(name == "jpg")
+        format = FrameExtractor::JpegFormat;
+    else if(name == "bmp")
+        format = FrameExtractor::BmpFormat;
+    else
+        return false;
+    return true;
+}
+
+FrameExtractor::FrameExtractor(const PlayerOptions& options, WorkPool& pool)
+: m_options(options)
+, m_pool(pool)
+, m_maxInFlight(pool.threadCount() * InFlightPerThread)
+, m_inFlight(0)
+, m_nextToList(0)
+, m_framesWritten(0)
+, m_framesResumed(0)
+, m_bytesWritten(0)
+, m_writeFailures(0)
+, m_decodeWaitUs(0)
+{
+}
+
+FrameExtractor::~FrameExtractor()
+{
+    // Tasks hold this
+    m_pool.waitIdle();
+}
+
+bool FrameExtractor::run(const std::string& path, const std::string& dir)
+{
+    m_dir = dir;
+
+    PlayerOptions options = m_options;
+    options.audio = false;
+
+    MediaFile media;
+    if(!media.open(path, options))
+        return false;
+
+    AVFormatContext* formatCtx = media.formatContext();
+    AVStream* stream = media.videoStream();
+    AVCodecContext* codecCtx = stream->codec;
+    const int videoIndex = media.videoStreamIndex();
+    const int64_t startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    const AVRational msTimeBase = {1, 1000};
+
+    std::vector<sf::Int64> targets = m_options.extractTimesMs;
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+    const bool timesMode = !targets.empty();
+    const int every = std::max(1, m_options.extractEvery);
+
+    // What the directory holds must be of this file, taken the same way
+    std::ostringstream header;
+    sf::Int64 sourceSize = 0;
+    sf::Int64 sourceMtime = 0;
+    fileIdentity(path, sourceSize, sourceMtime);
+    header << "# frames 1 size=" << sourceSize << " mtime=" << sourceMtime << " format=" << extensionFor(m_options.extractFormat);
+    if(timesMode)
+    {
+        header << " at=";
+        for (size_t i = 0; i < targets.size(); ++i)
+            header << (i ? "," : "") << targets[i];
+    }
+    else
+    {
+        header << " every=" << every;
+    }
+
+    bool found = false;
+    sf::Int64 lastFrame = -1;
+    sf::Int64 lastPts = AV_NOPTS_VALUE;
+    size_t done = 0;
+    if(!readIndex(header.str(), found, lastFrame, lastPts, done))
+    {
+        std::cerr << m_dir << " holds frames of another file or taken differently" << std::endl;
+        return false;
+    }
+    m_framesResumed = done;
+
+    const std::string indexPath = m_dir + "/frames.txt";
+    m_index.open(indexPath.c_str(), found ? std::ios::app : std::ios::trunc);
+    if(!m_index)
+    {
+        std::cerr << "can't write " << indexPath << std::endl;
+        return false;
+    }
+    if(!found)
+        m_index << header.str() << "\n" << std::flush;
+
+    // Every-Nth resumes at the frame after the last one listed, seeking to
+    // it when it has a timestamp; frame numbers carry on from there
+    sf::Int64 frameNumber = -1;
+    sf::Int64 skipThroughPts = AV_NOPTS_VALUE;
+    if(!timesMode && lastFrame >= 0 && lastPts != AV_NOPTS_VALUE
+       && avformat_seek_file(formatCtx, videoIndex, INT64_MIN, lastPts, lastPts, 0) >= 0)
+    {
+        frameNumber = lastFrame;
+        skipThroughPts = lastPts;
+    }
+
+    size_t nextTarget = timesMode ? done : 0;
+    sf::Int64 lastDecodedMs = INT64_MIN;
+    sf::Int64 soughtFor = -1;
+    sf::Uint64 sequence = 0;
+
+    // Returns false once nothing more is wanted
+    auto handleFrame = [&](const AVFrame* frame)
+    {
+        const int64_t pts = av_frame_get_best_effort_timestamp(frame);
+        const sf::Int64 ptsMs = pts != AV_NOPTS_VALUE ? 1000 * (pts - startTime) * av_q2d(stream->time_base) : lastDecodedMs;
+        lastDecodedMs = ptsMs;
+
+        if(timesMode)
+        {
+            // Several times may fall on one frame
+            while (nextTarget < targets.size() && ptsMs >= targets[nextTarget])
+            {
+                Job job = { sequence++, -1, pts, ptsMs, targets[nextTarget] };
+                submit(job, frame);
+                ++nextTarget;
+            }
+            return nextTarget < targets.size();
+        }
+
+        if(skipThroughPts != AV_NOPTS_VALUE)
+        {
+            if(pts != AV_NOPTS_VALUE && pts <= skipThroughPts)
+                return true;
+            skipThroughPts = AV_NOPTS_VALUE;
+        }
+
+        ++frameNumber;
+        if(frameNumber > lastFrame && frameNumber % every == 0)
+        {
+            Job job = { sequence++, frameNumber, pts, ptsMs, -1 };
+            submit(job, frame);
+        }
+        return true;
+    };
+
+    AVFrame* frame = av_frame_alloc();
+    AVPacket packet;
+    av_init_packet(&packet);
+    bool wanted = !timesMode || nextTarget < targets.size();
+    while (wanted)
+    {
+        // Far ahead times are sought to, once each
+        if(timesMode && targets[nextTarget] != soughtFor
+           && targets[nextTarget] - std::max<sf::Int64>(lastDecodedMs, 0) > SeekAheadMs)
+        {
+            soughtFor = targets[nextTarget];
+            const int64_t ts = startTime + av_rescale_q(soughtFor, msTimeBase, stream->time_base);
+            if(avformat_seek_file(formatCtx, videoIndex, INT64_MIN, ts, ts, 0) >= 0)
+                avcodec_flush_buffers(codecCtx);
+        }
+
+        if(av_read_frame(formatCtx, &packet) < 0)
+            break;
+
+        if(packet.stream_index == videoIndex)
+        {
+            AVPacket input = packet;
+            while (input.size > 0 && wanted)
+            {
+                int frameFinished = 0;
+                const int len = avcodec_decode_video2(codecCtx, frame, &frameFinished, &input);
+                if(len < 0)
+                    break;
+                if(frameFinished)
+                    wanted = handleFrame(frame);
+                input.data += len;
+                input.size -= len;
+            }
+        }
+        av_free_packet(&packet);
+    }
+
+    // Frames still in the codec
+    AVPacket flushPacket;
+    av_init_packet(&flushPacket);
+    flushPacket.data = NULL;
+    flushPacket.size = 0;
+    int frameFinished = 1;
+    while (wanted && frameFinished)
+    {
+        if(avcodec_decode_video2(codecCtx, frame, &frameFinished, &flushPacket) < 0)
+            break;
+        if(frameFinished)
+            wanted = handleFrame(frame);
+    }
+    av_frame_free(&frame);
+
+    m_pool.waitIdle();
+    m_index.close();
+    return true;
+}
+
+bool FrameExtractor::readIndex(const std::string& header, bool& found, sf::Int64& lastFrame, sf::Int64& lastPts, size_t& lines)
+{
+    found = false;
+    lines = 0;
+
+    std::ifstream in((m_dir + "/frames.txt").c_str());
+    std::string line;
+    if(!in || !std::getline(in, line))
+        return true;
+    if(line != header)
+        return false;
+    found = true;
+
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        sf::Int64 frameNumber = 0;
+        sf::Int64 pts = 0;
+        if(!(fields >> frameNumber >> pts))
+            continue;
+
+        lastFrame = frameNumber;
+        lastPts = pts;
+        ++lines;
+    }
+    return true;
+}
+
+void FrameExtractor::submit(const Job& job, const AVFrame* frame)
+{
+    {
+        std::unique_lock<std::mutex> lk(m_mut);
+        if(m_inFlight >= m_maxInFlight)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            m_slotCond.wait(lk, [this]{ return m_inFlight < m_maxInFlight; });
+            m_decodeWaitUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+        ++m_inFlight;
+    }
+
+    // The decoder reuses its frame; the task gets its own reference, or a
+    // copy when the codec doesn't hand out refcounted frames
+    AVFrame* copy = av_frame_clone(frame);
+    if(!copy)
+    {
+        complete(job, std::string(), false);
+        return;
+    }
+    m_pool.submit([this, job, copy]{ convertAndWrite(job, copy); }, WorkPool::Normal, (unsigned)job.sequence);
+}
+
+void FrameExtractor::convertAndWrite(const Job& job, AVFrame* frame)
+{
+    const int width = frame->width;
+    const int height = frame->height;
+    const size_t bytes = (size_t)width * height * 4;
+
+    // av_malloc keeps the rows aligned for the SIMD kernels
+    sf::Uint8* rgba = (sf::Uint8*)av_malloc(bytes);
+    {
+        std::unique_ptr<RgbaConverter> converter = takeConverter(frame);
+        converter->convert(frame, rgba, width * 4);
+        returnConverter(std::move(converter));
+    }
+    av_frame_free(&frame);
+
+    char name[64];
+    if(job.targetMs >= 0)
+        std::snprintf(name, sizeof(name), "t%010lld.%s", (long long)job.targetMs, extensionFor(m_options.extractFormat));
+    else
+        std::snprintf(name, sizeof(name), "frame%08lld.%s", (long long)job.frameNumber, extensionFor(m_options.extractFormat));
+
+    // Written under a hidden name with the same extension, which picks the
+    // image format, and renamed once complete
+    const std::string tmpPath = m_dir + "/." + name;
+    bool ok = false;
+    if(m_options.extractFormat == RawFormat)
+    {
+        std::ofstream out(tmpPath.c_str(), std::ios::binary);
+        ok = out.write((const char*)rgba, bytes) && out.flush();
+    }
+    else
+    {
+        sf::Image image;
+        image.create(width, height, rgba);
+        ok = image.saveToFile(tmpPath);
+    }
+    av_free(rgba);
+
+    struct stat st;
+    if(ok && stat(tmpPath.c_str(), &st) == 0)
+        m_bytesWritten += st.st_size;
+    ok = ok && std::rename(tmpPath.c_str(), (m_dir + "/" + name).c_str()) == 0;
+
+    std::ostringstream line;
+    line << job.frameNumber << " " << job.pts << " " << job.ptsMs << " " << job.targetMs << " " << width << "x" << height << " " << name;
+    complete(job, line.str(), ok);
+}
+
+void FrameExtractor::complete(const Job& job, const std::string& line, bool ok)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        --m_inFlight;
+
+        // A frame that failed is never listed, nor anything after it, so a
+        // second run starts over from there
+        if(ok)
+        {
+            ++m_framesWritten;
+            m_written[job.sequence] = line;
+        }
+        else
+        {
+            ++m_writeFailures;
+        }
+
+        while (!m_written.empty() && m_written.begin()->first == m_nextToList)
+        {
+            m_index << m_written.begin()->second << "\n";
+            m_written.erase(m_written.begin());
+            ++m_nextToList;
+        }
+        m_index.flush();
+    }
+    m_slotCond.notify_one();
+}
+
+std::unique_ptr<RgbaConverter> FrameExtractor::takeConverter(const AVFrame* frame)
+{
+    std::unique_ptr<RgbaConverter> converter;
+    {
+        std::lock_guard<std::mutex> lk(m_converterMut);
+        if(!m_converters.empty())
+        {
+            converter = std::move(m_converters.back());
+            m_converters.pop_back();
+        }
+    }
+
+    if(!converter || converter->outputWidth() != frame->width || converter->outputHeight() != frame->height)
+    {
+        converter.reset(new RgbaConverter(frame->width, frame->height, (AVPixelFormat)frame->format, m_options.convertPath));
+        converter->setOutput(frame->width, frame->height, RgbaConverter::BilinearFilter);
+    }
+    return converter;
+}
+
+void FrameExtractor::returnConverter(std::unique_ptr<RgbaConverter> converter)
+{
+    std::lock_guard<std::mutex> lk(m_converterMut);
+    m_converters.push_back(std::move(converter));
+}
+
+int runFrameExtraction(const PlayerOptions& options, std::ostream& out)
+{
+    if(options.inputs.empty())
+    {
+        out << "--extract needs at least one input file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(!makeDirectory(options.extractDir))
+    {
+        out << "can't create " << options.extractDir << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    WorkPool pool(options.poolThreads);
+
+    int failures = 0;
+    for (const auto& path : options.inputs)
+    {
+        std::string dir = options.extractDir;
+        if(options.inputs.size() > 1)
+        {
+            dir += "/" + baseName(path);
+            if(!makeDirectory(dir))
+            {
+                out << "can't create " << dir << std::endl;
+                ++failures;
+                continue;
+            }
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        FrameExtractor extractor(options, pool);
+        if(!extractor.run(path, dir))
+        {
+            out << path << ": nothing extracted" << std::endl;
+            ++failures;
+            continue;
+        }
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Decoding waiting most of the time means more writer threads
+        // would help; not at all, that decoding is the limit
+        out << std::fixed << std::setprecision(2)
+            << path << ": " << extractor.framesWritten() << " frames to " << dir << " in " << sec << " s, "
+            << extractor.framesWritten() / sec << " fps, "
+            << extractor.bytesWritten() / sec / (1 << 20) << " MiB/s; "
+            << extractor.framesResumed() << " done before, " << extractor.writeFailures() << " failed; decoder waited "
+            << extractor.decodeWaitUs() / 1000.0 << " ms for " << pool.threadCount() << " writer threads" << std::endl;
+        if(extractor.writeFailures())
+            ++failures;
+    }
+
+    pool.printStats(out);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
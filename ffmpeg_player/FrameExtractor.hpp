@@ -0,0 +1,139 @@
+#ifndef FRAME_EXTRACTOR_HPP
+#define FRAME_EXTRACTOR_HPP
+
+#include <SFML/Config.hpp>
+
+#include "WorkPool.hpp"
+#include "RgbaConverter.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct PlayerOptions;
+
+//
+// Offline frame dump: every Nth frame, or the first frame at or after each
+// of a list of times, written to a directory as fast as the machine allows.
+//
+// The calling thread demuxes and decodes, with the codec's own threads, and
+// hands each selected frame to a WorkPool task that converts it to RGBA and
+// writes it out, raw or as an image. A bounded number of frames is in
+// flight, so decoding, conversion and writing overlap without unbounded
+// memory.
+//
+// Files are named by frame number, and frames.txt lists them in order,
+// appended as soon as every earlier frame is on disk. An interrupted run
+// resumes after the last frame listed: every-Nth runs seek back to it, and
+// time lists skip the times done.
+//
+class FrameExtractor
+{
+public:
+    enum Format
+    {
+        RawFormat,
+        PngFormat,
+        JpegFormat,
+        BmpFormat
+    };
+
+    FrameExtractor(const PlayerOptions& options, WorkPool& pool);
+    ~FrameExtractor();
+
+    // Extracts from path into dir, which must exist. Blocks until every
+    // frame is written. Returns false if the file can't be opened or dir
+    // holds an extraction of something else.
+    bool run(const std::string& path, const std::string& dir);
+
+    sf::Uint64 framesWritten() const
+    {
+        return m_framesWritten;
+    }
+
+    // Listed by an earlier run and not extracted again
+    sf::Uint64 framesResumed() const
+    {
+        return m_framesResumed;
+    }
+
+    sf::Uint64 bytesWritten() const
+    {
+        return m_bytesWritten;
+    }
+
+    sf::Uint64 writeFailures() const
+    {
+        return m_writeFailures;
+    }
+
+    // Time the decoder waited for a free slot, i.e. for the writers
+    sf::Uint64 decodeWaitUs() const
+    {
+        return m_decodeWaitUs;
+    }
+
+private:
+    FrameExtractor(const FrameExtractor&);
+    FrameExtractor& operator=(const FrameExtractor&);
+
+    // A frame selected, in output order
+    struct Job
+    {
+        sf::Uint64 sequence;
+        sf::Int64 frameNumber;
+        sf::Int64 pts;
+        sf::Int64 ptsMs;
+        // Negative in every-Nth mode
+        sf::Int64 targetMs;
+    };
+
+    bool readIndex(const std::string& header, bool& found, sf::Int64& lastFrame, sf::Int64& lastPts, size_t& lines);
+    void submit(const Job& job, const AVFrame* frame);
+    void convertAndWrite(const Job& job, AVFrame* frame);
+    void complete(const Job& job, const std::string& file, bool ok);
+    std::unique_ptr<RgbaConverter> takeConverter(const AVFrame* frame);
+    void returnConverter(std::unique_ptr<RgbaConverter> converter);
+
+    const PlayerOptions& m_options;
+    WorkPool& m_pool;
+    std::string m_dir;
+    size_t m_maxInFlight;
+
+    // Frames submitted and not yet written; the decoder waits on
+    // m_slotCond for it to drop below m_maxInFlight
+    std::mutex m_mut;
+    std::condition_variable m_slotCond;
+    size_t m_inFlight;
+
+    // Reorder buffer: frames written out of order wait here until all
+    // earlier ones are listed in the index. Guarded by m_mut.
+    std::ofstream m_index;
+    sf::Uint64 m_nextToList;
+    std::map<sf::Uint64, std::string> m_written;
+
+    // Converters are built for one source format; reused across tasks
+    std::mutex m_converterMut;
+    std::vector<std::unique_ptr<RgbaConverter> > m_converters;
+
+    std::atomic<sf::Uint64> m_framesWritten;
+    std::atomic<sf::Uint64> m_framesResumed;
+    std::atomic<sf::Uint64> m_bytesWritten;
+    std::atomic<sf::Uint64> m_writeFailures;
+    sf::Uint64 m_decodeWaitUs;
+};
+
+// Parses "raw", "png", "jpg" or "bmp"
+bool parseExtractFormat(const std::string& name, FrameExtractor::Format& format);
+
+// Extracts from every input, into a subdirectory per input when there are
+// several, and prints frames per second extracted
+int runFrameExtraction(const PlayerOptions& options, std::ostream& out);
+
+#endif
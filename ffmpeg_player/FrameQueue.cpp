@@ -0,0 +1,108 @@
+#include "FrameQueue.hpp"
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#include <algorithm>
+#include <chrono>
+
+FrameQueue::FrameQueue(size_t depth, int width, int height)
+: m_frames(std::max<size_t>(depth, 2))
+, m_readIndex(0)
+, m_writeIndex(0)
+, m_size(0)
+, m_aborted(false)
+, m_pixelCapacity((size_t)width * height)
+{
+    for (auto& f : m_frames)
+    {
+        // av_malloc keeps the rows aligned for swscale's SIMD writers
+        f.pixels = (sf::Uint8*)av_malloc(width * height * 4);
+        f.width = width;
+        f.height = height;
+        f.ptsMs = 0;
+        f.serial = 0;
+    }
+}
+
+FrameQueue::~FrameQueue()
+{
+    for (auto& f : m_frames)
+    {
+        av_free(f.pixels);
+    }
+}
+
+VideoFrame* FrameQueue::peekWritable()
+{
+    std::unique_lock<std::mutex> lk(m_mut);
+    m_cond.wait(lk, [this]{ return m_size < m_frames.size() || m_aborted; });
+
+    if(m_aborted)
+        return NULL;
+
+    return &m_frames[m_writeIndex];
+}
+
+void FrameQueue::push()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_writeIndex = (m_writeIndex + 1) % m_frames.size();
+        ++m_size;
+    }
+    m_cond.notify_all();
+}
+
+bool FrameQueue::waitReadable(int timeoutMs)
+{
+    std::unique_lock<std::mutex> lk(m_mut);
+    return m_cond.wait_for(lk, std::chrono::milliseconds(timeoutMs), [this]{ return m_size > 0 || m_aborted; }) && m_size > 0;
+}
+
+VideoFrame* FrameQueue::peek()
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    if(m_size < 1)
+        return NULL;
+
+    return &m_frames[m_readIndex];
+}
+
+VideoFrame* FrameQueue::peekNext()
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    if(m_size < 2)
+        return NULL;
+
+    return &m_frames[(m_readIndex + 1) % m_frames.size()];
+}
+
+void FrameQueue::next()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        if(m_size < 1)
+            return;
+
+        m_readIndex = (m_readIndex + 1) % m_frames.size();
+        --m_size;
+    }
+    m_cond.notify_all();
+}
+
+void FrameQueue::abort()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_aborted = true;
+    }
+    m_cond.notify_all();
+}
+
+size_t FrameQueue::size() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    return m_size;
+}
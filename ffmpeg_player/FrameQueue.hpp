@@ -0,0 +1,76 @@
+#ifndef FRAME_QUEUE_HPP
+#define FRAME_QUEUE_HPP
+
+#include <SFML/Config.hpp>
+
+#include <stdint.h>
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+//
+// A decoded picture converted to tightly packed RGBA, ready to be uploaded
+// to a texture. It may be smaller than the buffer, which fits the source
+// size, when the output is scaled down to the window.
+//
+struct VideoFrame
+{
+    sf::Uint8* pixels;
+    int width;
+    int height;
+    int64_t ptsMs;
+    int serial;
+};
+
+//
+// Fixed-depth ring of VideoFrames between the VideoDecoder thread and the
+// render loop. The pixel buffers are allocated once up front and reused for
+// the whole session; the producer converts straight into the slot returned
+// by peekWritable() and publishes it with push(), the consumer reads peek()
+// and hands the slot back with next().
+//
+class FrameQueue
+{
+public:
+    FrameQueue(size_t depth, int width, int height);
+    ~FrameQueue();
+
+    // Blocks until a slot is free. Returns NULL once aborted.
+    VideoFrame* peekWritable();
+    void push();
+
+    // Oldest ready frame and the one after it, or NULL. Never block.
+    VideoFrame* peek();
+    VideoFrame* peekNext();
+    void next();
+
+    // Waits up to timeoutMs for a frame to become readable
+    bool waitReadable(int timeoutMs);
+
+    void abort();
+
+    size_t size() const;
+    size_t depth() const
+    {
+        return m_frames.size();
+    }
+
+    // Pixels each slot's buffer holds, fixed at construction
+    size_t pixelCapacity() const
+    {
+        return m_pixelCapacity;
+    }
+
+private:
+    mutable std::mutex m_mut;
+    std::condition_variable m_cond;
+    std::vector<VideoFrame> m_frames;
+    size_t m_readIndex;
+    size_t m_writeIndex;
+    size_t m_size;
+    bool m_aborted;
+    const size_t m_pixelCapacity;
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include "HeadlessBenchmark.hpp"
+
+#include "MediaFile.hpp"
+#include "PacketPool.hpp"
+#include "PacketQueue.hpp"
+#include "Demuxer.hpp"
+#include "FrameQueue.hpp"
+#include "VideoDecoder.hpp"
+#include "AudioDecoder.hpp"
+#include "StartupTimer.hpp"
+
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <iomanip>
+#include <cstdlib>
+
+namespace
+{
+    bool benchmarkFile(const std::string& path, const PlayerOptions& options, std::ostream& out)
+    {
+        StartupTimer startup;
+        MediaFile media;
+        if(!media.open(path, options))
+            return false;
+        startup.mark(StartupTimer::MediaOpened);
+
+        AVStream* videoStream = media.videoStream();
+        AVStream* audioStream = media.audioStream();
+        if(!videoStream)
+        {
+            out << path << ": no video stream, nothing to benchmark" << std::endl;
+            return false;
+        }
+
+        PacketPool packetPool;
+        MemoryBudget packetBudget(options.memoryBudget);
+        PacketQueue videoPkts(options.videoQueue, &packetBudget);
+        PacketQueue audioPkts(options.audioQueue, &packetBudget);
+        FrameQueue videoFrames(options.decodeAhead, videoStream->codec->width, videoStream->codec->height);
+
+        Demuxer demuxer(media.formatContext(), media.videoStreamIndex(), media.audioStreamIndex(), packetPool, videoPkts, audioPkts);
+        demuxer.setMemoryBudget(&packetBudget);
+        VideoDecoder videoDecoder(videoStream, videoPkts, videoFrames, !options.skipScale, NULL, options.convertPath);
+
+        std::unique_ptr<AudioDecoder> audioDecoder;
+        if(audioStream)
+            audioDecoder.reset(new AudioDecoder(audioStream));
+
+        std::atomic<sf::Uint64> audioSamples(0);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        demuxer.start();
+        videoDecoder.start();
+
+        std::thread audioThread;
+        if(audioDecoder)
+        {
+            audioThread = std::thread([&]
+            {
+                traceThreadName("audio decoder");
+
+                PacketHandle packet;
+                int serial = 0;
+                while (audioPkts.pop(packet, serial))
+                {
+                    audioDecoder->decode(packet.get(), [&](const sf::Int16*, size_t count)
+                    {
+                        startup.mark(StartupTimer::FirstAudio);
+                        audioSamples += count;
+                        return true;
+                    });
+                }
+            });
+        }
+
+        // Null video sink
+        sf::Uint64 frames = 0;
+        int64_t firstPtsMs = 0;
+        int64_t lastPtsMs = 0;
+        auto consume = [&](const VideoFrame* frame)
+        {
+            if(frames == 0)
+            {
+                startup.mark(StartupTimer::FirstVideoFrame);
+                firstPtsMs = frame->ptsMs;
+            }
+            lastPtsMs = frame->ptsMs;
+            ++frames;
+            videoFrames.next();
+        };
+
+        while (true)
+        {
+            if(videoFrames.waitReadable(10))
+            {
+                consume(videoFrames.peek());
+            }
+            else if(videoDecoder.isFinished() && videoPkts.isFinished())
+            {
+                // The last flushed frames may have been queued between the
+                // timeout and the check; the decoder queues them before it
+                // says it is finished
+                while (const VideoFrame* frame = videoFrames.peek())
+                    consume(frame);
+                break;
+            }
+        }
+
+        if(audioThread.joinable())
+            audioThread.join();
+
+        const double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        videoDecoder.stop();
+        demuxer.stop();
+
+        double videoSec = (lastPtsMs - firstPtsMs) / 1000.0;
+        double audioSec = 0;
+        if(audioDecoder)
+            audioSec = audioSamples / (double)(audioDecoder->channelCount() * audioDecoder->sampleRate());
+
+        const double mediaSec = std::max(videoSec, audioSec);
+
+        out << std::fixed << std::setprecision(2)
+            << path << (options.skipScale ? " (no scale)" : "") << ", conversion " << videoDecoder.converter().pathName() << "\n"
+            << "  " << frames << " video frames in " << wallSec << " s: "
+            << frames / wallSec << " fps, "
+            << mediaSec / wallSec << "x realtime over " << mediaSec << " s of media\n";
+
+        startup.print(out);
+        demuxer.readStats().print(out);
+        videoDecoder.decodeStats().print(out);
+        if(!options.skipScale)
+            videoDecoder.scaleStats().print(out);
+        if(audioDecoder)
+        {
+            audioDecoder->decodeStats().print(out);
+            audioDecoder->resampleStats().print(out);
+        }
+
+        printQueueStats(out, "video", videoPkts.stats());
+        printQueueStats(out, "audio", audioPkts.stats());
+        packetPool.printStats(out);
+        if(media.inputSource())
+            media.inputSource()->stats().print(out, media.inputSource()->name());
+        return true;
+    }
+}
+
+int runHeadlessBenchmark(const PlayerOptions& options, std::ostream& out)
+{
+    if(options.inputs.empty())
+    {
+        out << "--headless needs at least one input file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int failures = 0;
+    for (const auto& path : options.inputs)
+    {
+        if(!benchmarkFile(path, options, out))
+            ++failures;
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
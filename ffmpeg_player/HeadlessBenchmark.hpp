@@ -0,0 +1,13 @@
+#ifndef HEADLESS_BENCHMARK_HPP
+#define HEADLESS_BENCHMARK_HPP
+
+#include "Options.hpp"
+
+#include <ostream>
+
+// Runs every input through demux -> decode -> scale as fast as possible
+// into a null sink, without opening a window or an audio device, and prints
+// throughput and the CPU time spent in each stage.
+int runHeadlessBenchmark(const PlayerOptions& options, std::ostream& out);
+
+#endif
@@ -0,0 +1,287 @@
+#include "InputSource.hpp"
+#include "ReadAheadSource.hpp"
+
+extern "C" {
+#include <libavutil/error.h>
+}
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+namespace
+{
+    sf::Uint64 elapsedUs(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    //
+    // Plain read() on the calling thread. Each read is a syscall and counts
+    // as a stall, since it blocks until the storage answers.
+    //
+    class FileSource : public InputSource
+    {
+    public:
+        FileSource()
+        : m_fd(-1)
+        , m_size(0)
+        {
+        }
+
+        virtual ~FileSource()
+        {
+            if(m_fd >= 0)
+                ::close(m_fd);
+        }
+
+        bool open(const std::string& path)
+        {
+            m_fd = ::open(path.c_str(), O_RDONLY);
+            if(m_fd < 0)
+                return false;
+
+            struct stat st;
+            if(fstat(m_fd, &st) != 0)
+                return false;
+
+            m_size = st.st_size;
+            return true;
+        }
+
+        virtual int read(uint8_t* buffer, int size)
+        {
+            auto start = std::chrono::steady_clock::now();
+            ssize_t n = 0;
+            do {
+                n = ::read(m_fd, buffer, size);
+            }while (n < 0 && errno == EINTR);
+
+            ++m_stats.reads;
+            ++m_stats.syscalls;
+            ++m_stats.stalls;
+            m_stats.stallUs += elapsedUs(start);
+
+            if(n < 0)
+                return AVERROR(errno);
+            if(n == 0)
+                return AVERROR_EOF;
+
+            m_stats.bytesRead += n;
+            return (int)n;
+        }
+
+        virtual int64_t seek(int64_t offset)
+        {
+            ++m_stats.syscalls;
+            off_t pos = lseek(m_fd, offset, SEEK_SET);
+            return pos < 0 ? AVERROR(errno) : pos;
+        }
+
+        virtual int64_t size() const
+        {
+            return m_size;
+        }
+
+        virtual const char* name() const
+        {
+            return "file";
+        }
+
+    private:
+        int m_fd;
+        int64_t m_size;
+    };
+
+    //
+    // The whole file mapped read-only; reads are a memcpy. A copy that
+    // touches pages not yet in memory faults them in, which is the only
+    // blocking left, so copies are timed as stalls.
+    //
+    class MmapSource : public InputSource
+    {
+    public:
+        MmapSource()
+        : m_data(NULL)
+        , m_size(0)
+        , m_pos(0)
+        {
+        }
+
+        virtual ~MmapSource()
+        {
+            if(m_data)
+                munmap(m_data, m_size);
+        }
+
+        bool open(const std::string& path)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if(fd < 0)
+                return false;
+
+            struct stat st;
+            if(fstat(fd, &st) != 0 || st.st_size == 0)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            m_size = st.st_size;
+            void* data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            m_stats.syscalls += 3;
+
+            if(data == MAP_FAILED)
+                return false;
+
+            m_data = (uint8_t*)data;
+            // Makes the kernel read ahead aggressively and drop pages behind
+            madvise(m_data, m_size, MADV_SEQUENTIAL);
+            return true;
+        }
+
+        virtual int read(uint8_t* buffer, int size)
+        {
+            if(m_pos >= m_size)
+                return AVERROR_EOF;
+
+            const int n = (int)std::min<int64_t>(size, m_size - m_pos);
+
+            auto start = std::chrono::steady_clock::now();
+            memcpy(buffer, m_data + m_pos, n);
+            const sf::Uint64 us = elapsedUs(start);
+
+            // A copy from resident pages takes a few microseconds
+            if(us > 100)
+            {
+                ++m_stats.stalls;
+                m_stats.stallUs += us;
+            }
+
+            ++m_stats.reads;
+            m_stats.bytesRead += n;
+            m_pos += n;
+            return n;
+        }
+
+        virtual int64_t seek(int64_t offset)
+        {
+            if(offset < 0 || offset > m_size)
+                return AVERROR(EINVAL);
+
+            m_pos = offset;
+            return m_pos;
+        }
+
+        virtual int64_t size() const
+        {
+            return m_size;
+        }
+
+        virtual const char* name() const
+        {
+            return "mmap";
+        }
+
+    private:
+        uint8_t* m_data;
+        int64_t m_size;
+        int64_t m_pos;
+    };
+}
+
+void IoStats::print(std::ostream& out, const char* name) const
+{
+    const sf::Uint64 n = reads;
+    out << std::fixed << std::setprecision(2)
+        << "input (" << name << "): " << reads << " reads, "
+        << bytesRead / (1024.0 * 1024.0) << " MiB, "
+        << syscalls << " syscalls, "
+        << stalls << " stalls, "
+        << stallUs / 1000.0 << " ms stalled ("
+        << (n ? stallUs / (double)n : 0.0) << " us/read)" << std::endl;
+}
+
+std::unique_ptr<InputSource> InputSource::open(const std::string& path, Backend backend, size_t readAheadBytes)
+{
+    switch (backend)
+    {
+        case FileBackend:
+        {
+            std::unique_ptr<FileSource> source(new FileSource);
+            if(source->open(path))
+                return std::unique_ptr<InputSource>(std::move(source));
+            break;
+        }
+        case MmapBackend:
+        {
+            std::unique_ptr<MmapSource> source(new MmapSource);
+            if(source->open(path))
+                return std::unique_ptr<InputSource>(std::move(source));
+            break;
+        }
+        case ReadAheadBackend:
+        {
+            std::unique_ptr<ReadAheadSource> source(new ReadAheadSource);
+            if(source->open(path, readAheadBytes))
+                return std::unique_ptr<InputSource>(std::move(source));
+            break;
+        }
+        case FFmpegBackend:
+            break;
+    }
+
+    return std::unique_ptr<InputSource>();
+}
+
+bool parseIoBackend(const std::string& name, InputSource::Backend& backend)
+{
+    if(name == "ffmpeg")
+        backend = InputSource::FFmpegBackend;
+    else if(name == "file")
+        backend = InputSource::FileBackend;
+    else if(name == "mmap")
+        backend = InputSource::MmapBackend;
+    else if(name == "readahead")
+        backend = InputSource::ReadAheadBackend;
+    else
+        return false;
+
+    return true;
+}
+
+bool isLiveInput(const std::string& path)
+{
+    if(path == "-" || path.compare(0, 5, "pipe:") == 0)
+        return true;
+
+    const char* const schemes[] = { "tcp://", "udp://", "rtp://" };
+    for (const char* scheme : schemes)
+    {
+        if(path.compare(0, strlen(scheme), scheme) == 0)
+            return true;
+    }
+
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode));
+}
+
+std::string inputUrl(const std::string& path)
+{
+    if(path == "-")
+        return "pipe:";
+
+    struct stat st;
+    if(::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        return "unix:" + path;
+
+    return path;
+}
@@ -0,0 +1,87 @@
+#ifndef INPUT_SOURCE_HPP
+#define INPUT_SOURCE_HPP
+
+#include <SFML/Config.hpp>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <string>
+
+//
+// What the demuxer's reads cost. A stall is a read() that had to wait for
+// the storage: a blocking syscall, a page fault on a mapping, or an empty
+// read-ahead window.
+//
+struct IoStats
+{
+    std::atomic<sf::Uint64> reads{0};
+    std::atomic<sf::Uint64> bytesRead{0};
+    std::atomic<sf::Uint64> syscalls{0};
+    std::atomic<sf::Uint64> stalls{0};
+    std::atomic<sf::Uint64> stallUs{0};
+
+    void print(std::ostream& out, const char* name) const;
+};
+
+//
+// Byte source behind the custom AVIOContext. Only ever used from the thread
+// that owns the AVFormatContext, but an implementation may run its own
+// threads.
+//
+class InputSource
+{
+public:
+    enum Backend
+    {
+        // FFmpeg's own file protocol, no custom AVIOContext
+        FFmpegBackend,
+        // read() on the demux thread
+        FileBackend,
+        // The whole file mapped into memory
+        MmapBackend,
+        // A background thread keeps a window ahead of the read position
+        ReadAheadBackend
+    };
+
+    virtual ~InputSource() {}
+
+    // Same contract as AVIOContext's read_packet: bytes copied, or
+    // AVERROR_EOF / a negative AVERROR code
+    virtual int read(uint8_t* buffer, int size) = 0;
+
+    // Absolute position, returns it or a negative AVERROR code
+    virtual int64_t seek(int64_t offset) = 0;
+
+    virtual int64_t size() const = 0;
+
+    virtual const char* name() const = 0;
+
+    const IoStats& stats() const
+    {
+        return m_stats;
+    }
+
+    // NULL if the file can't be opened with that backend. FFmpegBackend
+    // always gives NULL.
+    static std::unique_ptr<InputSource> open(const std::string& path, Backend backend, size_t readAheadBytes);
+
+protected:
+    IoStats m_stats;
+};
+
+// Parses "ffmpeg", "file", "mmap" or "readahead"
+bool parseIoBackend(const std::string& name, InputSource::Backend& backend);
+
+// Inputs that can only be read front to back as they arrive: "-" and
+// "pipe:" (stdin), named pipes, local sockets, and tcp://, udp:// and
+// rtp:// URLs
+bool isLiveInput(const std::string& path);
+
+// What to hand FFmpeg for a path: "-" becomes "pipe:" as on FFmpeg's
+// command line and a local socket "unix:" plus its path; the rest as is
+std::string inputUrl(const std::string& path);
+
+#endif
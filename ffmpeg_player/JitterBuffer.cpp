@@ -0,0 +1,145 @@
+#include "JitterBuffer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+
+// The level is judged by its lowest point over two halves of this
+const sf::Int64 WindowMs = 1000;
+// Rates while the level is off target by more than RateBandMs, until it is
+// back on it. 5% is most of a semitone on the sound, and makes up 50 ms
+// a second.
+const double CatchUpRate = 1.05;
+const double SlowDownRate = 0.95;
+const sf::Int64 RateBandMs = 20;
+// Beyond this (or the target, if larger) over the target the excess is
+// dropped at once
+const sf::Int64 DropAboveMs = 200;
+// Each underrun raises the target this much, up to this far above the
+// configured latency; each StableMs without one lowers it again. Underruns
+// closer together than SameUnderrunMs are one.
+const sf::Int64 TargetStepMs = 20;
+const sf::Int64 MaxTargetRaiseMs = 400;
+const sf::Int64 StableMs = 10000;
+const sf::Int64 SameUnderrunMs = 250;
+
+namespace
+{
+    sf::Int64 elapsedMs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count();
+    }
+}
+
+JitterBuffer::JitterBuffer(sf::Int64 targetMs)
+: m_baseTargetMs(targetMs)
+, m_targetMs(targetMs)
+, m_levelMs(0)
+, m_rate(1)
+, m_currentMin(INT64_MAX)
+, m_previousMin(INT64_MAX)
+, m_halfStart(Clock::now())
+, m_lastUnderrun(Clock::now())
+, m_lastTargetChange(Clock::now())
+, m_lastUpdate(Clock::now())
+, m_underruns(0)
+, m_drops(0)
+, m_droppedMs(0)
+, m_maxTargetMs(targetMs)
+, m_fastUs(0)
+, m_slowUs(0)
+, m_latencyStats("live latency (arrival to display)")
+{
+}
+
+void JitterBuffer::restart()
+{
+    m_rate = 1;
+    m_currentMin = INT64_MAX;
+    m_previousMin = INT64_MAX;
+    m_halfStart = Clock::now();
+    m_lastUpdate = m_halfStart;
+}
+
+double JitterBuffer::update(sf::Int64 bufferedMs, bool underrun, sf::Int64& dropMs)
+{
+    dropMs = 0;
+
+    const Clock::time_point now = Clock::now();
+    const sf::Uint64 sinceUpdateUs = std::chrono::duration_cast<std::chrono::microseconds>(now - m_lastUpdate).count();
+    if(m_rate > 1)
+        m_fastUs += sinceUpdateUs;
+    else if(m_rate < 1)
+        m_slowUs += sinceUpdateUs;
+    m_lastUpdate = now;
+
+    m_levelMs = bufferedMs;
+    adaptTarget(underrun, now);
+
+    m_currentMin = std::min(m_currentMin, bufferedMs);
+    if(elapsedMs(m_halfStart, now) < WindowMs / 2)
+    {
+        // Until a whole half window is measured there is nothing to go by
+        if(m_previousMin == INT64_MAX)
+            return m_rate;
+    }
+    else
+    {
+        m_previousMin = m_currentMin;
+        m_currentMin = bufferedMs;
+        m_halfStart = now;
+    }
+
+    const sf::Int64 excess = std::min(m_currentMin, m_previousMin) - m_targetMs;
+    if(excess > std::max(DropAboveMs, m_targetMs))
+    {
+        dropMs = excess;
+        ++m_drops;
+        m_droppedMs += excess;
+
+        // What was measured no longer applies
+        restart();
+        return m_rate;
+    }
+
+    if(excess > RateBandMs)
+        m_rate = CatchUpRate;
+    else if(excess < -RateBandMs)
+        m_rate = SlowDownRate;
+    else if((m_rate > 1 && excess <= 0) || (m_rate < 1 && excess >= 0))
+        m_rate = 1;
+
+    return m_rate;
+}
+
+void JitterBuffer::adaptTarget(bool underrun, Clock::time_point now)
+{
+    if(underrun)
+    {
+        // A dry spell is reported by every call while it lasts, and the
+        // sound reports one per block of silence
+        if(m_underruns == 0 || elapsedMs(m_lastUnderrun, now) > SameUnderrunMs)
+        {
+            ++m_underruns;
+            m_targetMs = std::min(m_targetMs + TargetStepMs, m_baseTargetMs + MaxTargetRaiseMs);
+            m_maxTargetMs = std::max(m_maxTargetMs, m_targetMs);
+            m_lastTargetChange = now;
+        }
+        m_lastUnderrun = now;
+    }
+    else if(m_targetMs > m_baseTargetMs && elapsedMs(std::max(m_lastUnderrun, m_lastTargetChange), now) >= StableMs)
+    {
+        m_targetMs = std::max(m_targetMs - TargetStepMs, m_baseTargetMs);
+        m_lastTargetChange = now;
+    }
+}
+
+void JitterBuffer::printStats(std::ostream& out) const
+{
+    out << std::fixed << std::setprecision(1)
+        << "live: target " << m_baseTargetMs << " ms, " << m_targetMs << " ms at exit, "
+        << m_maxTargetMs << " ms at most; " << m_underruns << " underruns, "
+        << m_drops << " drops (" << m_droppedMs << " ms); "
+        << m_fastUs / 1e6 << " s sped up, " << m_slowUs / 1e6 << " s slowed down" << std::endl;
+    m_latencyStats.print(out);
+}
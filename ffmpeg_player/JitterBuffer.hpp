@@ -0,0 +1,106 @@
+#ifndef JITTER_BUFFER_HPP
+#define JITTER_BUFFER_HPP
+
+#include <SFML/Config.hpp>
+
+#include "StageStats.hpp"
+
+#include <chrono>
+#include <ostream>
+
+//
+// Holds a live stream's playback a target latency behind what has arrived.
+//
+// The render loop reports every iteration how much received media is not
+// presented yet. Packets come in bursts, so what counts is the lowest level
+// over the last second or so: that much could go without the picture
+// running dry. While it sits above the target playback runs slightly fast,
+// below it slightly slow. Far above, after a pause or a stall upstream, the
+// excess is dropped at once.
+//
+// The target adapts to the input. Each underrun raises it a step; each
+// stretch without one lowers it a step, back to the configured latency.
+//
+// Render thread only.
+//
+class JitterBuffer
+{
+public:
+    explicit JitterBuffer(sf::Int64 targetMs);
+
+    // bufferedMs is the received media not presented yet, underrun whether
+    // the picture or the sound ran dry since the last call. Returns the rate
+    // to play at, and in dropMs how much to throw away now, usually 0.
+    double update(sf::Int64 bufferedMs, bool underrun, sf::Int64& dropMs);
+
+    // While paused or seeking the level means nothing. The next update()
+    // starts measuring afresh.
+    void restart();
+
+    // From arrival to the screen, per presented frame
+    void recordLatency(sf::Uint64 us)
+    {
+        m_latencyStats.record(0, us);
+    }
+
+    sf::Int64 targetMs() const
+    {
+        return m_targetMs;
+    }
+
+    // As last reported
+    sf::Int64 levelMs() const
+    {
+        return m_levelMs;
+    }
+
+    double rate() const
+    {
+        return m_rate;
+    }
+
+    sf::Uint64 underruns() const
+    {
+        return m_underruns;
+    }
+
+    const StageStats& latencyStats() const
+    {
+        return m_latencyStats;
+    }
+
+    void printStats(std::ostream& out) const;
+
+private:
+    JitterBuffer(const JitterBuffer&);
+    JitterBuffer& operator=(const JitterBuffer&);
+
+    typedef std::chrono::steady_clock Clock;
+
+    void adaptTarget(bool underrun, Clock::time_point now);
+
+    const sf::Int64 m_baseTargetMs;
+    sf::Int64 m_targetMs;
+    sf::Int64 m_levelMs;
+    double m_rate;
+
+    // Lowest level of the current half window and of the one before;
+    // INT64_MAX while not measured
+    sf::Int64 m_currentMin;
+    sf::Int64 m_previousMin;
+    Clock::time_point m_halfStart;
+
+    Clock::time_point m_lastUnderrun;
+    Clock::time_point m_lastTargetChange;
+    Clock::time_point m_lastUpdate;
+
+    sf::Uint64 m_underruns;
+    sf::Uint64 m_drops;
+    sf::Int64 m_droppedMs;
+    sf::Int64 m_maxTargetMs;
+    sf::Uint64 m_fastUs;
+    sf::Uint64 m_slowUs;
+    StageStats m_latencyStats;
+};
+
+#endif
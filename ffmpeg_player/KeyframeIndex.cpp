@@ -0,0 +1,230 @@
+#include "KeyframeIndex.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    const char SidecarMagic[4] = { 'K', 'F', 'I', '1' };
+
+    struct SidecarHeader
+    {
+        char magic[4];
+        sf::Int32 videoStream;
+        sf::Int64 sourceSize;
+        sf::Int64 sourceMtime;
+        sf::Uint64 count;
+    };
+
+    bool entryBefore(const KeyframeIndex::Entry& a, const KeyframeIndex::Entry& b)
+    {
+        return a.ptsMs < b.ptsMs;
+    }
+}
+
+KeyframeIndex::KeyframeIndex(const std::string& path, int videoStream)
+: m_path(path)
+, m_sidecarPath(path + ".kfindex")
+, m_videoStream(videoStream)
+, m_quit(false)
+, m_ready(false)
+{
+}
+
+KeyframeIndex::~KeyframeIndex()
+{
+    stop();
+}
+
+void KeyframeIndex::start()
+{
+    m_quit = false;
+    m_thread = std::thread(&KeyframeIndex::run, this);
+}
+
+void KeyframeIndex::stop()
+{
+    m_quit = true;
+    if(m_thread.joinable())
+        m_thread.join();
+}
+
+bool KeyframeIndex::find(sf::Int64 targetMs, Entry& entry) const
+{
+    if(!isReady())
+        return false;
+
+    Entry key = { 0, targetMs };
+    auto it = std::upper_bound(m_entries.begin(), m_entries.end(), key, entryBefore);
+    if(it == m_entries.begin())
+        return false;
+
+    entry = *(it - 1);
+    return true;
+}
+
+void KeyframeIndex::run()
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    const char* source = "cache";
+    if(!loadSidecar())
+    {
+        if(!build())
+            return;
+
+        source = "scan";
+        saveSidecar();
+    }
+
+    std::sort(m_entries.begin(), m_entries.end(), entryBefore);
+    m_ready.store(true, std::memory_order_release);
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    av_log(NULL, AV_LOG_INFO, "keyframe index: %u keyframes from %s in %lld ms\n", (unsigned)m_entries.size(), source, (long long)ms);
+}
+
+bool KeyframeIndex::build()
+{
+    AVFormatContext* ctx = NULL;
+    if(avformat_open_input(&ctx, m_path.c_str(), NULL, NULL) != 0)
+        return false;
+
+    if(avformat_find_stream_info(ctx, NULL) < 0 || m_videoStream >= (int)ctx->nb_streams)
+    {
+        avformat_close_input(&ctx);
+        return false;
+    }
+
+    AVStream* stream = ctx->streams[m_videoStream];
+    const sf::Int64 startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    const double msPerTick = 1000 * av_q2d(stream->time_base);
+
+    // mov reads its complete sample table up front, no need to scan
+    if(std::strstr(ctx->iformat->name, "mov") && stream->nb_index_entries > 0)
+    {
+        for (int i = 0; i < stream->nb_index_entries; ++i)
+        {
+            const AVIndexEntry& ie = stream->index_entries[i];
+            if(ie.flags & AVINDEX_KEYFRAME)
+            {
+                Entry e = { ie.timestamp, (sf::Int64)((ie.timestamp - startTime) * msPerTick) };
+                m_entries.push_back(e);
+            }
+        }
+
+        avformat_close_input(&ctx);
+        return !m_entries.empty();
+    }
+
+    // Only the packet headers are needed, drop everything else early
+    for (unsigned i = 0; i < ctx->nb_streams; ++i)
+    {
+        if((int)i != m_videoStream)
+            ctx->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    AVPacket packet;
+    av_init_packet(&packet);
+    while (!m_quit && av_read_frame(ctx, &packet) >= 0)
+    {
+        if(packet.stream_index == m_videoStream && (packet.flags & AV_PKT_FLAG_KEY))
+        {
+            // Demuxers seek on dts; pts tells where the picture belongs
+            sf::Int64 ts = packet.dts != AV_NOPTS_VALUE ? packet.dts : packet.pts;
+            sf::Int64 pts = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+            if(ts != AV_NOPTS_VALUE)
+            {
+                Entry e = { ts, (sf::Int64)((pts - startTime) * msPerTick) };
+                m_entries.push_back(e);
+            }
+        }
+        av_free_packet(&packet);
+    }
+
+    avformat_close_input(&ctx);
+    return !m_quit && !m_entries.empty();
+}
+
+bool fileIdentity(const std::string& path, sf::Int64& size, sf::Int64& mtime)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+        return false;
+
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+bool KeyframeIndex::loadSidecar()
+{
+    SidecarHeader header;
+    std::ifstream in(m_sidecarPath.c_str(), std::ios::binary);
+    if(!in.read((char*)&header, sizeof(header)))
+        return false;
+
+    sf::Int64 size = 0;
+    sf::Int64 mtime = 0;
+    if(std::memcmp(header.magic, SidecarMagic, sizeof(SidecarMagic)) != 0
+       || header.videoStream != m_videoStream
+       || !fileIdentity(m_path, size, mtime)
+       || header.sourceSize != size
+       || header.sourceMtime != mtime)
+    {
+        return false;
+    }
+
+    // The count is only trusted if the entries it announces are all there,
+    // so a damaged or foreign file can't ask for any amount of memory
+    const std::streamoff entriesStart = in.tellg();
+    in.seekg(0, std::ios::end);
+    const std::streamoff remaining = in.tellg() - entriesStart;
+    in.seekg(entriesStart);
+    if(!in || remaining < 0 || remaining % sizeof(Entry) != 0 || header.count != (sf::Uint64)remaining / sizeof(Entry))
+        return false;
+
+    m_entries.resize(header.count);
+    if(!in.read((char*)m_entries.data(), header.count * sizeof(Entry)))
+    {
+        m_entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void KeyframeIndex::saveSidecar() const
+{
+    SidecarHeader header;
+    std::memcpy(header.magic, SidecarMagic, sizeof(SidecarMagic));
+    header.videoStream = m_videoStream;
+    header.count = m_entries.size();
+    if(!fileIdentity(m_path, header.sourceSize, header.sourceMtime))
+        return;
+
+    // Write to a temporary so a reader never sees half a file. Failing is
+    // fine, e.g. next to a file on read-only media; we just rescan next time.
+    const std::string tmpPath = m_sidecarPath + ".tmp";
+    {
+        std::ofstream out(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)m_entries.data(), m_entries.size() * sizeof(Entry));
+        if(!out)
+        {
+            out.close();
+            std::remove(tmpPath.c_str());
+            return;
+        }
+    }
+    std::rename(tmpPath.c_str(), m_sidecarPath.c_str());
+}
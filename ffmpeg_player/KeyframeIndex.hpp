@@ -0,0 +1,77 @@
+#ifndef KEYFRAME_INDEX_HPP
+#define KEYFRAME_INDEX_HPP
+
+#include <SFML/Config.hpp>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+//
+// Timestamps of every keyframe of the video stream, so a seek can go
+// straight to the GOP holding the target instead of relying on whatever
+// index the container has.
+//
+// The index is built on a background thread with a separate
+// AVFormatContext, so playback starts right away. When the container already
+// carries a complete index (mp4/mov) that is copied, otherwise the file is
+// scanned packet by packet without decoding. The result is cached in a
+// sidecar file next to the input, keyed on its size and modification time.
+//
+class KeyframeIndex
+{
+public:
+    struct Entry
+    {
+        // Timestamp to seek to, in the stream time base
+        sf::Int64 timestamp;
+        // Presentation time of the keyframe
+        sf::Int64 ptsMs;
+    };
+
+    KeyframeIndex(const std::string& path, int videoStream);
+    ~KeyframeIndex();
+
+    void start();
+    void stop();
+
+    bool isReady() const
+    {
+        return m_ready.load(std::memory_order_acquire);
+    }
+
+    // Last keyframe at or before targetMs. False until the index is ready,
+    // or if the target lies before the first keyframe.
+    bool find(sf::Int64 targetMs, Entry& entry) const;
+
+    size_t size() const
+    {
+        return isReady() ? m_entries.size() : 0;
+    }
+
+private:
+    KeyframeIndex(const KeyframeIndex&);
+    KeyframeIndex& operator=(const KeyframeIndex&);
+
+    void run();
+    bool build();
+    bool loadSidecar();
+    void saveSidecar() const;
+
+    std::string m_path;
+    std::string m_sidecarPath;
+    int m_videoStream;
+
+    // Written by the build thread only, read once m_ready is set
+    std::vector<Entry> m_entries;
+
+    std::thread m_thread;
+    std::atomic<bool> m_quit;
+    std::atomic<bool> m_ready;
+};
+
+// Size and modification time, which sidecar caches are keyed on
+bool fileIdentity(const std::string& path, sf::Int64& size, sf::Int64& mtime);
+
+#endif
@@ -0,0 +1,226 @@
+#include "MediaFile.hpp"
+#include "InputSource.hpp"
+
+#include <iostream>
+
+// Probing limits with --fast-start. FFmpeg's defaults are 5 MB and 5 s,
+// which on a slow source alone take seconds.
+const unsigned FastStartProbeBytes = 256 << 10;
+const int64_t FastStartAnalyzeUs = AV_TIME_BASE / 2;
+// Live, everything read while probing is thrown away: it is latency
+const unsigned LiveProbeBytes = 32 << 10;
+const int64_t LiveAnalyzeUs = AV_TIME_BASE / 5;
+
+namespace
+{
+    // What decoding and our converters need before the first packet,
+    // roughly FFmpeg's own has_codec_parameters
+    bool hasCodecParameters(const AVCodecContext* codecCtx)
+    {
+        if(codecCtx->codec_id == AV_CODEC_ID_NONE)
+            return false;
+
+        switch (codecCtx->codec_type)
+        {
+            case AVMEDIA_TYPE_VIDEO:
+                return codecCtx->width > 0 && codecCtx->height > 0 && codecCtx->pix_fmt != PIX_FMT_NONE;
+            case AVMEDIA_TYPE_AUDIO:
+                return codecCtx->sample_rate > 0 && codecCtx->channels > 0 && codecCtx->sample_fmt != AV_SAMPLE_FMT_NONE;
+            default:
+                return true;
+        }
+    }
+}
+
+MediaFile::MediaFile()
+: m_formatCtx(NULL)
+, m_videoStream(-1)
+, m_audioStream(-1)
+{
+}
+
+MediaFile::~MediaFile()
+{
+    close();
+}
+
+bool MediaFile::open(const std::string& path, const PlayerOptions& options)
+{
+    close();
+    m_path = path;
+
+    // Our backends need a regular file; pipes and sockets are FFmpeg's
+    if(options.io != InputSource::FFmpegBackend && !options.live)
+    {
+        std::unique_ptr<InputSource> source = InputSource::open(path, options.io, options.readAheadBytes);
+        if(source)
+            m_io.reset(new CustomIo(std::move(source)));
+
+        if(!m_io || !m_io->context())
+        {
+            av_log(NULL, AV_LOG_WARNING, "custom input unavailable for %s, letting FFmpeg read it\n", path.c_str());
+            m_io.reset();
+        }
+    }
+
+    m_formatCtx = avformat_alloc_context();
+    if(m_io)
+        m_formatCtx->pb = m_io->context();
+
+    if(options.live)
+    {
+        m_formatCtx->probesize = LiveProbeBytes;
+        m_formatCtx->max_analyze_duration = LiveAnalyzeUs;
+        m_formatCtx->flags |= AVFMT_FLAG_NOBUFFER;
+    }
+    else if(options.fastStart)
+    {
+        m_formatCtx->probesize = FastStartProbeBytes;
+        m_formatCtx->max_analyze_duration = FastStartAnalyzeUs;
+    }
+
+    // Open video file. On failure the context is freed, but not our pb.
+    const std::string url = inputUrl(path);
+    if(avformat_open_input(&m_formatCtx, url.c_str(), NULL, NULL) != 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "couldn't open %s\n", path.c_str());
+        m_io.reset();
+        return false;
+    }
+
+    // Containers like MP4 and MKV usually describe their streams in the
+    // header. With --fast-start, if that is enough for the streams we play,
+    // nothing is probed; start times then come from the headers alone.
+    selectStreams(options.audio);
+    bool needProbe = !options.fastStart || m_videoStream < 0
+        || !hasCodecParameters(videoStream()->codec)
+        || (m_audioStream >= 0 && !hasCodecParameters(audioStream()->codec));
+
+    if(needProbe)
+    {
+        // Retrieve stream information
+        if(avformat_find_stream_info(m_formatCtx, NULL) < 0)
+        {
+            av_log(NULL, AV_LOG_ERROR, "couldn't find stream information in %s\n", path.c_str());
+            close();
+            return false;
+        }
+        selectStreams(options.audio);
+    }
+    else
+    {
+        av_log(NULL, AV_LOG_VERBOSE, "stream parameters taken from the headers of %s\n", path.c_str());
+    }
+
+    // Dump information about file onto standard error
+    av_dump_format(m_formatCtx, 0, path.c_str(), 0);
+
+    if(options.fastStart || options.live || !options.audio)
+    {
+        // Nor read streams we won't play
+        for (unsigned i = 0; i < m_formatCtx->nb_streams; ++i)
+        {
+            if((int)i != m_videoStream && (int)i != m_audioStream)
+                m_formatCtx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    // Output frames as soon as they are decoded, without reordering delay
+    if(options.live && m_videoStream >= 0)
+        videoStream()->codec->flags |= CODEC_FLAG_LOW_DELAY;
+
+    if(m_videoStream < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "no video stream in %s\n", path.c_str());
+        close();
+        return false;
+    }
+
+    if(!openCodec(videoStream(), options.videoThreading, "video"))
+    {
+        close();
+        return false;
+    }
+
+    if(m_audioStream >= 0 && !openCodec(audioStream(), options.audioThreading, "audio"))
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void MediaFile::selectStreams(bool withAudio)
+{
+    m_videoStream = -1;
+    m_audioStream = -1;
+
+    for(unsigned i = 0; i < m_formatCtx->nb_streams; ++i)
+    {
+        if(m_formatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            m_videoStream = i;
+        }
+        else if(withAudio && m_formatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_AUDIO)
+        {
+            m_audioStream = i;
+        }
+    }
+}
+
+bool MediaFile::openCodec(AVStream* stream, const CodecThreading& threading, const char* label)
+{
+    AVCodecContext* codecCtx = stream->codec;
+    AVCodec* codec = avcodec_find_decoder(codecCtx->codec_id);
+    if(!codec)
+    {
+        av_log(NULL, AV_LOG_ERROR, "no %s decoder for %s\n", label, m_path.c_str());
+        return false;
+    }
+
+    configureCodecThreading(codecCtx, codec, threading);
+
+    AVDictionary* optionsDict = NULL;
+    int ret = avcodec_open2(codecCtx, codec, &optionsDict);
+    av_dict_free(&optionsDict);
+
+    if(ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "couldn't open the %s decoder for %s\n", label, m_path.c_str());
+        return false;
+    }
+
+    printCodecThreading(std::cout, label, codecCtx, stream);
+    return true;
+}
+
+void MediaFile::close()
+{
+    if(m_formatCtx)
+    {
+        // avcodec_close is harmless on decoders that were never opened
+        if(m_videoStream >= 0)
+            avcodec_close(videoStream()->codec);
+        if(m_audioStream >= 0)
+            avcodec_close(audioStream()->codec);
+
+        avformat_close_input(&m_formatCtx);
+    }
+
+    // Custom IO is left to the caller by avformat_close_input
+    m_io.reset();
+
+    m_videoStream = -1;
+    m_audioStream = -1;
+}
+
+AVStream* MediaFile::videoStream() const
+{
+    return m_videoStream >= 0 ? m_formatCtx->streams[m_videoStream] : NULL;
+}
+
+AVStream* MediaFile::audioStream() const
+{
+    return m_audioStream >= 0 ? m_formatCtx->streams[m_audioStream] : NULL;
+}
@@ -0,0 +1,72 @@
+#ifndef MEDIA_FILE_HPP
+#define MEDIA_FILE_HPP
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "Options.hpp"
+#include "CustomIo.hpp"
+
+#include <string>
+#include <memory>
+
+//
+// An opened input: format context, the selected video and audio streams
+// and their opened decoders. Closes everything on destruction.
+//
+class MediaFile
+{
+public:
+    MediaFile();
+    ~MediaFile();
+
+    // Fails if the file can't be opened or has no decodable video stream.
+    bool open(const std::string& path, const PlayerOptions& options);
+    void close();
+
+    AVFormatContext* formatContext() const
+    {
+        return m_formatCtx;
+    }
+
+    int videoStreamIndex() const
+    {
+        return m_videoStream;
+    }
+
+    int audioStreamIndex() const
+    {
+        return m_audioStream;
+    }
+
+    // NULL when the file has no such stream
+    AVStream* videoStream() const;
+    AVStream* audioStream() const;
+
+    // NULL when FFmpeg reads the file itself
+    const InputSource* inputSource() const
+    {
+        return m_io ? &m_io->source() : NULL;
+    }
+
+    const std::string& path() const
+    {
+        return m_path;
+    }
+
+private:
+    MediaFile(const MediaFile&);
+    MediaFile& operator=(const MediaFile&);
+
+    void selectStreams(bool withAudio);
+    bool openCodec(AVStream* stream, const CodecThreading& threading, const char* label);
+
+    AVFormatContext* m_formatCtx;
+    int m_videoStream;
+    int m_audioStream;
+    std::string m_path;
+    std::unique_ptr<CustomIo> m_io;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#include "MemoryBudget.hpp"
+
+MemoryBudget::MemoryBudget(size_t limitBytes)
+: m_limit(limitBytes)
+, m_used(0)
+, m_peak(0)
+{
+}
+
+void MemoryBudget::add(size_t bytes)
+{
+    size_t used = m_used.fetch_add(bytes) + bytes;
+
+    size_t peak = m_peak;
+    while (used > peak && !m_peak.compare_exchange_weak(peak, used)) {}
+}
+
+void MemoryBudget::release(size_t bytes)
+{
+    m_used.fetch_sub(bytes);
+}
+
+bool MemoryBudget::isExceeded() const
+{
+    return m_limit > 0 && m_used >= m_limit;
+}
+
+bool MemoryBudget::isHardExceeded() const
+{
+    return m_limit > 0 && m_used >= m_limit + m_limit / 4;
+}
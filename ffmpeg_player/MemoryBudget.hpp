@@ -0,0 +1,51 @@
+#ifndef MEMORY_BUDGET_HPP
+#define MEMORY_BUDGET_HPP
+
+#include <atomic>
+#include <cstddef>
+
+//
+// Bytes of packet data queued across every PacketQueue that shares it. The
+// Demuxer stops reading once the budget is used up, so the memory a player
+// holds in compressed packets stays bounded whatever the bitrate.
+//
+// Like the per-queue limits it is soft: the demuxer may run past it to feed
+// a starving stream, but never past the hard limit a quarter above it.
+//
+class MemoryBudget
+{
+public:
+    // 0 means unlimited
+    explicit MemoryBudget(size_t limitBytes);
+
+    void add(size_t bytes);
+    void release(size_t bytes);
+
+    bool isExceeded() const;
+    bool isHardExceeded() const;
+
+    size_t limit() const
+    {
+        return m_limit;
+    }
+
+    size_t used() const
+    {
+        return m_used;
+    }
+
+    size_t peak() const
+    {
+        return m_peak;
+    }
+
+private:
+    MemoryBudget(const MemoryBudget&);
+    MemoryBudget& operator=(const MemoryBudget&);
+
+    const size_t m_limit;
+    std::atomic<size_t> m_used;
+    std::atomic<size_t> m_peak;
+};
+
+#endif
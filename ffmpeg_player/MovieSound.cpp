@@ -0,0 +1,403 @@
+#include "MovieSound.hpp"
+
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+// How far the decode worker may run ahead of the sound card
+const int MaxBufferedMs = 500;
+// Size of the blocks handed to SFML. SFML keeps three queued.
+const int ChunkMs = 50;
+const int LowLatencyChunkMs = 20;
+// How long onGetData waits for the worker before reporting an underrun
+const int UnderrunWaitMs = 20;
+
+MovieSound::MovieSound(AVStream* stream, PacketQueue& packets, bool lowLatency)
+: m_stream(stream)
+, m_packets(&packets)
+, m_startTime(stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0)
+, m_serial(packets.serial())
+, m_decoder(new AudioDecoder(stream))
+, m_sampleRate(m_decoder->sampleRate())
+, m_channelCount(m_decoder->channelCount())
+, m_chunkSamples(m_channelCount * m_sampleRate * (lowLatency ? LowLatencyChunkMs : ChunkMs) / 1000)
+, m_ring(m_channelCount * m_sampleRate * MaxBufferedMs / 1000)
+, m_quit(false)
+, m_flushRequested(false)
+, m_finished(false)
+, m_flushTargetMs(0)
+, m_discardBeforeMs(0)
+, m_nextStream(NULL)
+, m_nextPackets(NULL)
+, m_sourceCount(1)
+, m_decodingSource(0)
+, m_speed(1)
+, m_speedChanged(false)
+, m_playingSpeed(1)
+, m_samplesWritten(0)
+, m_samplesOut(0)
+, m_adjustedSamples(0)
+, m_skipRequestMs(0)
+, m_underruns(0)
+, m_startup(NULL)
+, m_getDataStats("audio output")
+{
+    m_samplesBuffer = new sf::Int16[m_chunkSamples];
+
+    SourceStart first = { 0, 0, 0, 1 };
+    m_sourceStarts.push_back(first);
+
+    initialize(m_channelCount, m_sampleRate);
+
+    initialTime = sf::SoundStream::getPlayingOffset();
+
+    m_decodeThread = std::thread(&MovieSound::decodeLoop, this);
+}
+
+MovieSound::~MovieSound()
+{
+    shutdown();
+
+    delete [] m_samplesBuffer;
+}
+
+int MovieSound::queueNext(AVStream* stream, PacketQueue& packets)
+{
+    std::lock_guard<std::mutex> lk(m_flushMut);
+    m_nextStream = stream;
+    m_nextPackets = &packets;
+    return m_sourceCount++;
+}
+
+MovieSound::SourceStart MovieSound::playingStart() const
+{
+    const sf::Int64 position = sf::SoundStream::getPlayingOffset().asMilliseconds();
+
+    std::lock_guard<std::mutex> lk(m_timelineMut);
+    SourceStart start = m_sourceStarts.front();
+    for (const SourceStart& s : m_sourceStarts)
+    {
+        if(s.ms <= position)
+            start = s;
+    }
+    return start;
+}
+
+int MovieSound::playingSource() const
+{
+    return playingStart().source;
+}
+
+sf::Int32 MovieSound::timeElapsed() const
+{
+    const SourceStart start = playingStart();
+    const sf::Int64 played = sf::SoundStream::getPlayingOffset().asMilliseconds() - start.ms;
+    return start.mediaMs + (sf::Int32)(played * start.speed);
+}
+
+sf::Int64 MovieSound::samplesToMs(sf::Int64 samples) const
+{
+    return samples * 1000 / (sf::Int64)(m_channelCount * m_sampleRate);
+}
+
+sf::Int64 MovieSound::writeHeadMs(sf::Int64 flushTargetMs) const
+{
+    // Playing offset at which what the worker wrote so far ends
+    return flushTargetMs + samplesToMs((sf::Int64)m_samplesWritten + m_adjustedSamples);
+}
+
+void MovieSound::shutdown()
+{
+    // The streaming thread calls back into us, stop it while we are whole
+    stop();
+
+    m_quit = true;
+    m_flushCond.notify_all();
+    if(m_decodeThread.joinable())
+        m_decodeThread.join();
+}
+
+bool MovieSound::writeSamples(const sf::Int16* samples, size_t count)
+{
+    // Block until everything fits, unless a flush or shutdown makes the
+    // samples worthless
+    while (count > 0)
+    {
+        if(m_quit || m_flushRequested)
+            return false;
+
+        size_t written = m_ring.write(samples, count);
+        m_samplesWritten += written;
+        samples += written;
+        count -= written;
+
+        if(count > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    return true;
+}
+
+void MovieSound::handleFlush()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_flushMut);
+        m_decoder->flush();
+        m_decoder->setSpeed(m_speed);
+        m_ring.reset();
+        m_discardBeforeMs = m_flushTargetMs;
+        m_samplesWritten = 0;
+        m_samplesOut = 0;
+        m_adjustedSamples = 0;
+        m_skipRequestMs = 0;
+        {
+            // SFML restarts the playing offset at the target
+            std::lock_guard<std::mutex> timelineLock(m_timelineMut);
+            SourceStart start = { m_flushTargetMs, m_flushTargetMs, m_decodingSource, m_speed };
+            m_sourceStarts.assign(1, start);
+            m_playingSpeed = m_speed;
+        }
+        m_flushRequested = false;
+    }
+    m_flushCond.notify_all();
+}
+
+bool MovieSound::switchSource()
+{
+    sf::Int64 flushTargetMs = 0;
+    {
+        std::lock_guard<std::mutex> lk(m_flushMut);
+        if(!m_nextStream)
+            return false;
+
+        m_stream = m_nextStream;
+        m_packets = m_nextPackets;
+        m_nextStream = NULL;
+        m_nextPackets = NULL;
+        flushTargetMs = m_flushTargetMs;
+    }
+
+    m_decoder.reset(new AudioDecoder(m_stream, m_sampleRate));
+    m_decoder->setSpeed(m_playingSpeed);
+    m_startTime = m_stream->start_time != AV_NOPTS_VALUE ? m_stream->start_time : 0;
+    m_serial = m_packets->serial();
+    m_discardBeforeMs = 0;
+
+    // The new source is heard once everything written so far has played
+    SourceStart start = { writeHeadMs(flushTargetMs), 0, m_decodingSource + 1, m_playingSpeed };
+    const sf::Int64 position = sf::SoundStream::getPlayingOffset().asMilliseconds();
+    {
+        std::lock_guard<std::mutex> lk(m_timelineMut);
+        // Forget sources that are over
+        while (m_sourceStarts.size() > 1 && m_sourceStarts[1].ms <= position)
+            m_sourceStarts.erase(m_sourceStarts.begin());
+        m_sourceStarts.push_back(start);
+    }
+    ++m_decodingSource;
+
+    if(traceEnabled())
+        traceInstant("audio source", "startMs", start.ms);
+    return true;
+}
+
+void MovieSound::applySpeed()
+{
+    const double speed = m_speed;
+    if(speed == m_playingSpeed)
+        return;
+
+    sf::Int64 flushTargetMs = 0;
+    {
+        std::lock_guard<std::mutex> lk(m_flushMut);
+        flushTargetMs = m_flushTargetMs;
+    }
+
+    // Samples written from here on play at the new speed
+    {
+        std::lock_guard<std::mutex> lk(m_timelineMut);
+        const SourceStart& last = m_sourceStarts.back();
+        const sf::Int64 ms = writeHeadMs(flushTargetMs);
+        SourceStart start = { ms, last.mediaMs + (sf::Int64)((ms - last.ms) * last.speed), last.source, speed };
+        m_sourceStarts.push_back(start);
+    }
+    m_playingSpeed = speed;
+    m_decoder->setSpeed(speed);
+}
+
+void MovieSound::spliceTimeline(sf::Int64 atMs, sf::Int64 lengthMs, bool silence)
+{
+    // Streaming thread only. Silence lengthMs long was handed out at atMs,
+    // or that much audio thrown away there: the media time at every later
+    // offset moves by it.
+    const sf::Int64 position = sf::SoundStream::getPlayingOffset().asMilliseconds();
+
+    std::lock_guard<std::mutex> lk(m_timelineMut);
+    size_t active = 0;
+    for (size_t i = 0; i < m_sourceStarts.size(); ++i)
+    {
+        if(m_sourceStarts[i].ms <= atMs)
+            active = i;
+    }
+    const SourceStart current = m_sourceStarts[active];
+    const sf::Int64 mediaMs = current.mediaMs + (sf::Int64)((atMs - current.ms) * current.speed);
+
+    for (size_t i = active + 1; i < m_sourceStarts.size(); ++i)
+    {
+        sf::Int64& ms = m_sourceStarts[i].ms;
+        ms = silence ? ms + lengthMs : std::max(atMs, ms - lengthMs);
+    }
+
+    std::vector<SourceStart> splice;
+    if(silence)
+    {
+        SourceStart hold = { atMs, mediaMs, current.source, 0 };
+        SourceStart resume = { atMs + lengthMs, mediaMs, current.source, current.speed };
+        splice.push_back(hold);
+        splice.push_back(resume);
+    }
+    else
+    {
+        SourceStart skip = { atMs, mediaMs + (sf::Int64)(lengthMs * current.speed), current.source, current.speed };
+        splice.push_back(skip);
+    }
+    m_sourceStarts.insert(m_sourceStarts.begin() + active + 1, splice.begin(), splice.end());
+
+    // Forget what has played
+    while (m_sourceStarts.size() > 1 && m_sourceStarts[1].ms <= position)
+        m_sourceStarts.erase(m_sourceStarts.begin());
+}
+
+void MovieSound::skipSamples()
+{
+    const sf::Int64 ms = m_skipRequestMs.exchange(0);
+    if(ms <= 0)
+        return;
+
+    // Whole sample frames of what the ring holds
+    size_t left = std::min<size_t>(m_ring.size(), (size_t)(ms * m_sampleRate / 1000) * m_channelCount);
+    left -= left % m_channelCount;
+
+    sf::Int64 skipped = 0;
+    while (left > 0)
+    {
+        const size_t read = m_ring.read(m_samplesBuffer, std::min(left, m_chunkSamples));
+        if(read == 0)
+            break;
+        left -= read;
+        skipped += read;
+    }
+
+    if(skipped > 0)
+    {
+        spliceTimeline(m_flushTargetMs + samplesToMs(m_samplesOut), samplesToMs(skipped), false);
+        m_adjustedSamples -= skipped;
+    }
+}
+
+void MovieSound::decodeLoop()
+{
+    traceThreadName("audio decoder");
+
+    while (!m_quit)
+    {
+        if(m_flushRequested)
+        {
+            handleFlush();
+        }
+
+        if(m_speedChanged.exchange(false))
+        {
+            applySpeed();
+        }
+
+        PacketHandle packet;
+        int serial = 0;
+        if(!m_packets->tryPop(packet, serial))
+        {
+            if(m_packets->isFinished() && switchSource())
+                continue;
+
+            m_finished = m_packets->isFinished();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        m_finished = false;
+
+        if(serial != m_serial)
+        {
+            m_decoder->flush();
+            m_serial = serial;
+        }
+
+        if(packet->pts != AV_NOPTS_VALUE)
+        {
+            int64_t ms = 1000 * (packet->pts - m_startTime) * av_q2d(m_stream->time_base);
+            if(ms < m_discardBeforeMs)
+                continue;
+        }
+
+        m_decoder->decode(packet.get(), [this](const sf::Int16* samples, size_t count)
+        {
+            return writeSamples(samples, count);
+        });
+    }
+}
+
+bool MovieSound::onGetData(sf::SoundStream::Chunk &data)
+{
+    // SFML starts a new streaming thread after every seek
+    if(traceEnabled())
+        traceThreadName("audio output");
+
+    StageTimer timer(m_getDataStats);
+
+    skipSamples();
+
+    data.samples = m_samplesBuffer;
+    data.sampleCount = m_ring.read(m_samplesBuffer, m_chunkSamples);
+
+    // Give the worker a moment to catch up before calling it an underrun
+    for (int waited = 0; data.sampleCount == 0 && waited < UnderrunWaitMs; ++waited)
+    {
+        if(m_finished)
+        {
+            // End of file and nothing left to play
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        data.sampleCount = m_ring.read(m_samplesBuffer, m_chunkSamples);
+    }
+
+    if(data.sampleCount == 0)
+    {
+        // Hand out a short block of silence so the stream keeps its buffers
+        // queued instead of stopping
+        ++m_underruns;
+        data.sampleCount = m_channelCount * m_sampleRate / 100;
+        std::memset(m_samplesBuffer, 0, data.sampleCount * sizeof(sf::Int16));
+
+        // The media stands still while it plays
+        spliceTimeline(m_flushTargetMs + samplesToMs(m_samplesOut), samplesToMs(data.sampleCount), true);
+        m_adjustedSamples += data.sampleCount;
+    }
+    else if(m_startup)
+    {
+        m_startup->mark(StartupTimer::FirstAudio);
+    }
+    m_samplesOut += data.sampleCount;
+
+    return true;
+}
+
+void MovieSound::onSeek(sf::Time timeOffset)
+{
+    // The demuxer already flushed the packet queue when it seeked, what is
+    // queued now belongs to the new position. The worker drops what comes
+    // before the offset and empties the ring. SFML's streaming thread is
+    // stopped while this runs, so resetting the ring is safe.
+    std::unique_lock<std::mutex> lk(m_flushMut);
+    m_flushTargetMs = timeOffset.asMilliseconds();
+    m_flushRequested = true;
+    m_flushCond.wait(lk, [this]{ return !m_flushRequested || m_quit; });
+}
@@ -0,0 +1,215 @@
+#ifndef MOVIE_SOUND_HPP
+#define MOVIE_SOUND_HPP
+
+#include <SFML/Audio.hpp>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "PacketQueue.hpp"
+#include "PcmRingBuffer.hpp"
+#include "AudioDecoder.hpp"
+#include "StartupTimer.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//
+// Plays the audio stream and provides the master clock.
+//
+// Decoding and resampling (AudioDecoder) run on a worker thread that keeps a
+// PcmRingBuffer topped up; onGetData, called from SFML's streaming thread, only copies out
+// of the ring.
+//
+// A playlist queues the next file's audio while the current one plays. The
+// worker moves on to it as soon as the current source runs out, resampled
+// to the same rate, so the output never stops between files. Sources are
+// numbered from 0 in the order they were given.
+//
+// In trick play the audio is resampled to play faster. The playing offset
+// then runs slower than the media, timeElapsed() scales it back.
+//
+// The timeline from playing offset to media time also accounts for the
+// silence handed out on underruns, which doesn't move the media on, and
+// for audio a live stream throws away to catch up, which does.
+//
+class MovieSound : public sf::SoundStream
+{
+public:
+    // Low latency hands SFML smaller blocks, so less sits queued in the
+    // sound card
+    MovieSound(AVStream* stream, PacketQueue& packets, bool lowLatency);
+    virtual ~MovieSound();
+
+    // Marks FirstAudio once the first decoded samples go out. Call before
+    // play().
+    void setStartupTimer(StartupTimer* startup)
+    {
+        m_startup = startup;
+    }
+
+    // Plays stream right after the current source, returns its number. The
+    // stream and queue must stay alive until decodingSource() passes it.
+    int queueNext(AVStream* stream, PacketQueue& packets);
+
+    // Source the worker reads from
+    int decodingSource() const
+    {
+        return m_decodingSource;
+    }
+
+    // Source the sound card is playing
+    int playingSource() const;
+
+    // Stops playback and the decode worker. Must be called before the codec
+    // is closed.
+    void shutdown();
+
+    bool isAudioReady() const
+    {
+        return sf::SoundStream::getPlayingOffset() != initialTime;
+    }
+
+    // Position in the playing source
+    sf::Int32 timeElapsed() const;
+
+    // Takes effect at the next setPlayingOffset(), and for the sources
+    // switched to after that
+    void setSpeed(double speed)
+    {
+        m_speed = speed;
+    }
+
+    // Takes effect without a setPlayingOffset(): what is already decoded
+    // plays out at the old speed, what follows at the new one. For the
+    // slight speed changes a live stream catches up with.
+    void changeSpeed(double speed)
+    {
+        m_speed = speed;
+        m_speedChanged = true;
+    }
+
+    // Throws away up to ms of the audio decoded ahead of the sound card,
+    // the next time SFML asks for samples, moving the position on by as
+    // much
+    void skipBuffered(sf::Int64 ms)
+    {
+        m_skipRequestMs = ms;
+    }
+
+    // Number of times onGetData found the ring empty
+    sf::Uint64 underruns() const
+    {
+        return m_underruns;
+    }
+
+    size_t bufferedSamples() const
+    {
+        return m_ring.size();
+    }
+
+    size_t bufferCapacity() const
+    {
+        return m_ring.capacity();
+    }
+
+    // The current source's decoder; replaced when the worker moves on
+    const AudioDecoder& decoder() const
+    {
+        return *m_decoder;
+    }
+
+    // Time spent in onGetData, including waits for the worker
+    const StageStats& getDataStats() const
+    {
+        return m_getDataStats;
+    }
+
+private:
+    // Where a source starts on the playing offset's timeline, and the
+    // position in the source there
+    struct SourceStart
+    {
+        sf::Int64 ms;
+        sf::Int64 mediaMs;
+        int source;
+        // Media time per playing offset time from here; 0 in silence
+        double speed;
+    };
+
+    virtual bool onGetData(Chunk& data);
+    virtual void onSeek(sf::Time timeOffset);
+
+    void decodeLoop();
+    void handleFlush();
+    bool switchSource();
+    void applySpeed();
+    SourceStart playingStart() const;
+    sf::Int64 samplesToMs(sf::Int64 samples) const;
+    sf::Int64 writeHeadMs(sf::Int64 flushTargetMs) const;
+    void spliceTimeline(sf::Int64 atMs, sf::Int64 lengthMs, bool silence);
+    void skipSamples();
+    bool writeSamples(const sf::Int16* samples, size_t count);
+
+    AVStream* m_stream;
+    PacketQueue* m_packets;
+    int64_t m_startTime;
+    int m_serial;
+
+    std::unique_ptr<AudioDecoder> m_decoder;
+    unsigned m_sampleRate;
+    unsigned m_channelCount;
+    size_t m_chunkSamples;
+    sf::Int16* m_samplesBuffer;
+    PcmRingBuffer m_ring;
+
+    // Decode worker state. onSeek hands a flush request to the worker and
+    // waits until it has reset the ring, so no stale samples are played.
+    std::thread m_decodeThread;
+    std::mutex m_flushMut;
+    std::condition_variable m_flushCond;
+    std::atomic<bool> m_quit;
+    std::atomic<bool> m_flushRequested;
+    std::atomic<bool> m_finished;
+    sf::Int64 m_flushTargetMs;
+
+    // Packets presented before this time are dropped, set on flush
+    sf::Int64 m_discardBeforeMs;
+
+    // Queued by queueNext, taken by the worker; guarded by m_flushMut
+    AVStream* m_nextStream;
+    PacketQueue* m_nextPackets;
+    int m_sourceCount;
+    std::atomic<int> m_decodingSource;
+    std::atomic<double> m_speed;
+    std::atomic<bool> m_speedChanged;
+
+    // A flush restarts the timeline with the decoding source at the seek
+    // target; a switch adds the point the samples written so far end at
+    std::vector<SourceStart> m_sourceStarts;
+    // Speed of the samples being written, worker only
+    double m_playingSpeed;
+    mutable std::mutex m_timelineMut;
+    // Written to the ring since the last flush, worker only
+    sf::Uint64 m_samplesWritten;
+    // Handed to SFML since the last flush, silence included; streaming
+    // thread only
+    sf::Uint64 m_samplesOut;
+    // Silence handed out less samples thrown away since the last flush. The
+    // worker adds it to what it wrote to find where that ends.
+    std::atomic<sf::Int64> m_adjustedSamples;
+    std::atomic<sf::Int64> m_skipRequestMs;
+
+    std::atomic<sf::Uint64> m_underruns;
+    StartupTimer* m_startup;
+    StageStats m_getDataStats;
+
+    sf::Time initialTime;
+};
+
+#endif
@@ -0,0 +1,350 @@
+#include "Options.hpp"
+#include "Playlist.hpp"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+
+static void printUsage(const char* program)
+{
+    std::cerr << "usage: " << program << " [options] [file...]\n"
+              << "  several files play back to back, each opened while the previous one plays\n"
+              << "  - reads stdin; pipes, local sockets and tcp://, udp:// or rtp:// URLs play live,\n"
+              << "  and can't share a playlist with files\n"
+              << "  --decode-ahead N     frames decoded ahead of presentation (default 4)\n"
+              << "  --video-queue-mb N   compressed video queued ahead (default 24)\n"
+              << "  --audio-queue-mb N   compressed audio queued ahead (default 4)\n"
+              << "  --queue-seconds N    media time queued ahead per stream (default 10)\n"
+              << "  --memory-budget-mb N all queued packets together, 0 = unlimited (default 32)\n"
+              << "  --io B               input reads: ffmpeg, file, mmap or readahead (default readahead)\n"
+              << "  --readahead-mb N     window kept buffered by --io readahead (default 8)\n"
+              << "  --no-audio           play the video only\n"
+              << "  --fast-start         bounded probing, skipped when the headers suffice\n"
+              << "  --live               play the input as a live stream, even from a file\n"
+              << "  --live-latency MS    live, how far playback stays behind the input (default 100)\n"
+              << "  --video-threads N    video decoder threads, 0 = auto (default)\n"
+              << "  --video-thread-type T  auto, frame, slice or none (default auto)\n"
+              << "  --audio-threads N    audio decoder threads, 0 = auto (default)\n"
+              << "  --audio-thread-type T  auto, frame, slice or none (default auto)\n"
+              << "  --sync M             master clock: audio, video or external (default audio)\n"
+              << "  --no-drop            never drop late frames in the decoder\n"
+              << "  --no-seek-index      seek with the container's index only\n"
+              << "  --keyframe-seek      resume at the keyframe instead of the exact seek target\n"
+              << "  --frame-cache-mb N   presented frames kept for stepping and seeking back (default 128)\n"
+              << "  --frame-cache-half   keep cached frames at half size\n"
+              << "  --size WxH           initial window size (default: source size)\n"
+              << "  --convert K          RGBA conversion: auto, swscale, sse2 or avx2 (default auto)\n"
+              << "  --bench-convert      benchmark RGBA conversion at 720p/1080p/4K and exit\n"
+              << "  --check-convert      compare the conversion kernels against swscale and exit\n"
+              << "  --make-test-media DIR  write synthetic benchmark clips and DIR/clips.txt and exit\n"
+              << "  --bench-stages       time demux, decode, conversion, audio and seeking per file and exit\n"
+              << "  --bench-out FILE     write the --bench-stages JSON lines to FILE\n"
+              << "  --headless           decode the files without presenting them and print throughput\n"
+              << "  --no-scale           with --headless, skip the RGBA conversion\n"
+              << "  --thumbnails SECS    build a thumbnail every SECS seconds of each file and exit\n"
+              << "  --thumb-size WxH     thumbnails fit inside this (default 160x90)\n"
+              << "  --thumb-workers N    thumbnail worker threads, 0 = one per core (default)\n"
+              << "  --wall               play the files side by side in a grid\n"
+              << "  --wall-streams N     repeat the files to N tiles\n"
+              << "  --wall-page N        tiles on screen at a time, PageUp/PageDown to flip (default 16)\n"
+              << "  --wall-bench         find how many streams the wall plays on time per core and exit\n"
+              << "  --extract DIR        write frames of the files to DIR as fast as possible and exit\n"
+              << "  --extract-every N    with --extract, every Nth frame (default 1)\n"
+              << "  --extract-at LIST    with --extract, the frames at these comma-separated seconds instead\n"
+              << "  --extract-format F   raw (RGBA), png, jpg or bmp (default png)\n"
+              << "  --pool-threads N     wall decode and extraction threads, 0 = one per core (default)\n"
+              << "  --playlist FILE      play the files listed in FILE, one per line\n"
+              << "  --trace FILE         write a Chrome trace-event JSON of the session\n";
+}
+
+bool parseOptions(int argc, char const** argv, PlayerOptions& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        
+        if(arg.compare(0, 5, "-psn_") == 0)
+        {
+            // Process serial number added by the Finder on OS X
+            continue;
+        }
+        else if(arg == "--decode-ahead" && hasValue)
+        {
+            options.decodeAhead = std::atoi(argv[++i]);
+            if(options.decodeAhead < 2)
+            {
+                std::cerr << "--decode-ahead must be at least 2\n";
+                return false;
+            }
+        }
+        else if(arg == "--video-queue-mb" && hasValue)
+        {
+            options.videoQueue.maxBytes = (size_t)std::max(1, std::atoi(argv[++i])) << 20;
+        }
+        else if(arg == "--audio-queue-mb" && hasValue)
+        {
+            options.audioQueue.maxBytes = (size_t)std::max(1, std::atoi(argv[++i])) << 20;
+        }
+        else if(arg == "--queue-seconds" && hasValue)
+        {
+            int64_t ms = (int64_t)std::max(1, std::atoi(argv[++i])) * 1000;
+            options.videoQueue.maxDurationMs = ms;
+            options.audioQueue.maxDurationMs = ms;
+        }
+        else if(arg == "--memory-budget-mb" && hasValue)
+        {
+            options.memoryBudget = (size_t)std::max(0, std::atoi(argv[++i])) << 20;
+        }
+        else if(arg == "--io" && hasValue)
+        {
+            if(!parseIoBackend(argv[++i], options.io))
+            {
+                std::cerr << "--io must be one of ffmpeg, file, mmap or readahead\n";
+                return false;
+            }
+        }
+        else if(arg == "--readahead-mb" && hasValue)
+        {
+            options.readAheadBytes = (size_t)std::max(1, std::atoi(argv[++i])) << 20;
+        }
+        else if(arg == "--no-audio")
+        {
+            options.audio = false;
+        }
+        else if(arg == "--fast-start")
+        {
+            options.fastStart = true;
+        }
+        else if(arg == "--video-threads" && hasValue)
+        {
+            options.videoThreading.threads = std::max(0, std::atoi(argv[++i]));
+        }
+        else if(arg == "--audio-threads" && hasValue)
+        {
+            options.audioThreading.threads = std::max(0, std::atoi(argv[++i]));
+        }
+        else if((arg == "--video-thread-type" || arg == "--audio-thread-type") && hasValue)
+        {
+            CodecThreading& threading = arg == "--video-thread-type" ? options.videoThreading : options.audioThreading;
+            if(!parseThreadType(argv[++i], threading.type))
+            {
+                std::cerr << arg << " must be one of auto, frame, slice or none\n";
+                return false;
+            }
+        }
+        else if(arg == "--sync" && hasValue)
+        {
+            if(!parseSyncMaster(argv[++i], options.syncMaster))
+            {
+                std::cerr << "--sync must be one of audio, video or external\n";
+                return false;
+            }
+        }
+        else if(arg == "--no-drop")
+        {
+            options.dropLate = false;
+        }
+        else if(arg == "--no-seek-index")
+        {
+            options.seekIndex = false;
+        }
+        else if(arg == "--keyframe-seek")
+        {
+            options.exactSeek = false;
+        }
+        else if(arg == "--frame-cache-mb" && hasValue)
+        {
+            options.frameCacheBytes = (size_t)std::max(0, std::atoi(argv[++i])) << 20;
+        }
+        else if(arg == "--frame-cache-half")
+        {
+            options.frameCacheHalfSize = true;
+        }
+        else if(arg == "--size" && hasValue)
+        {
+            if(std::sscanf(argv[++i], "%dx%d", &options.windowWidth, &options.windowHeight) != 2
+               || options.windowWidth < 1 || options.windowHeight < 1)
+            {
+                std::cerr << "--size must look like 640x360\n";
+                return false;
+            }
+        }
+        else if(arg == "--convert" && hasValue)
+        {
+            if(!parseConvertPath(argv[++i], options.convertPath))
+            {
+                std::cerr << "--convert must be one of auto, swscale, sse2 or avx2\n";
+                return false;
+            }
+        }
+        else if(arg == "--bench-convert")
+        {
+            options.benchConvert = true;
+        }
+        else if(arg == "--check-convert")
+        {
+            options.checkConvert = true;
+        }
+        else if(arg == "--make-test-media" && hasValue)
+        {
+            options.testMediaDir = argv[++i];
+        }
+        else if(arg == "--bench-stages")
+        {
+            options.benchStages = true;
+        }
+        else if(arg == "--bench-out" && hasValue)
+        {
+            options.benchOutPath = argv[++i];
+        }
+        else if(arg == "--headless")
+        {
+            options.headless = true;
+        }
+        else if(arg == "--no-scale")
+        {
+            options.skipScale = true;
+        }
+        else if(arg == "--thumbnails" && hasValue)
+        {
+            options.thumbnailIntervalMs = (sf::Int64)(std::atof(argv[++i]) * 1000);
+            if(options.thumbnailIntervalMs < 1)
+            {
+                std::cerr << "--thumbnails needs an interval in seconds\n";
+                return false;
+            }
+        }
+        else if(arg == "--thumb-size" && hasValue)
+        {
+            if(std::sscanf(argv[++i], "%dx%d", &options.thumbnailWidth, &options.thumbnailHeight) != 2
+               || options.thumbnailWidth < 2 || options.thumbnailHeight < 2)
+            {
+                std::cerr << "--thumb-size must look like 160x90\n";
+                return false;
+            }
+        }
+        else if(arg == "--thumb-workers" && hasValue)
+        {
+            options.thumbnailWorkers = std::max(0, std::atoi(argv[++i]));
+        }
+        else if(arg == "--wall")
+        {
+            options.wall = true;
+        }
+        else if(arg == "--wall-streams" && hasValue)
+        {
+            options.wallStreams = std::max(0, std::atoi(argv[++i]));
+        }
+        else if(arg == "--wall-page" && hasValue)
+        {
+            options.wallPageSize = std::max(1, std::atoi(argv[++i]));
+        }
+        else if(arg == "--wall-bench")
+        {
+            options.wallBench = true;
+        }
+        else if(arg == "--extract" && hasValue)
+        {
+            options.extractDir = argv[++i];
+        }
+        else if(arg == "--extract-every" && hasValue)
+        {
+            options.extractEvery = std::max(1, std::atoi(argv[++i]));
+        }
+        else if(arg == "--extract-at" && hasValue)
+        {
+            const char* list = argv[++i];
+            while (*list)
+            {
+                char* end = NULL;
+                const double sec = std::strtod(list, &end);
+                if(end == list || sec < 0)
+                {
+                    std::cerr << "--extract-at must be seconds separated by commas, like 1.5,10,60\n";
+                    return false;
+                }
+                options.extractTimesMs.push_back((sf::Int64)(sec * 1000));
+                list = *end == ',' ? end + 1 : end;
+            }
+        }
+        else if(arg == "--extract-format" && hasValue)
+        {
+            if(!parseExtractFormat(argv[++i], options.extractFormat))
+            {
+                std::cerr << "--extract-format must be one of raw, png, jpg or bmp\n";
+                return false;
+            }
+        }
+        else if(arg == "--pool-threads" && hasValue)
+        {
+            options.poolThreads = std::max(0, std::atoi(argv[++i]));
+        }
+        else if(arg == "--playlist" && hasValue)
+        {
+            if(!readPlaylistFile(argv[++i], options.inputs))
+            {
+                std::cerr << "couldn't read playlist " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--trace" && hasValue)
+        {
+            options.tracePath = argv[++i];
+        }
+        else if(arg == "--live")
+        {
+            options.live = true;
+        }
+        else if(arg == "--live-latency" && hasValue)
+        {
+            options.liveLatencyMs = std::atoi(argv[++i]);
+            if(options.liveLatencyMs < 1)
+            {
+                std::cerr << "--live-latency must be at least 1 ms\n";
+                return false;
+            }
+        }
+        else if(arg.compare(0, 1, "-") != 0 || arg == "-")
+        {
+            options.inputs.push_back(arg);
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    
+    // Live mode is for the whole run: it gives up seeking and indexing and
+    // shortens probing for every input, which a file shouldn't pay for
+    size_t liveInputs = 0;
+    for (const std::string& input : options.inputs)
+    {
+        if(isLiveInput(input))
+            ++liveInputs;
+    }
+    if(liveInputs > 0 && liveInputs < options.inputs.size())
+    {
+        std::cerr << "can't mix live inputs (stdin, pipes, sockets, network streams) with files in one playlist\n";
+        return false;
+    }
+    if(liveInputs > 0)
+        options.live = true;
+    
+    if(options.live)
+    {
+        // Nothing to index or seek in, and reading the input a second time
+        // for the index would steal from the stream
+        options.seekIndex = false;
+        
+        // Frame threading holds frames back in the decoder, a frame time
+        // of latency per thread
+        if(options.videoThreading.type == CodecThreading::Auto)
+            options.videoThreading.type = CodecThreading::Slice;
+    }
+    
+    return true;
+}
@@ -0,0 +1,137 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include "CodecThreading.hpp"
+#include "SyncClock.hpp"
+#include "RgbaConverter.hpp"
+#include "PacketQueue.hpp"
+#include "InputSource.hpp"
+#include "FrameExtractor.hpp"
+
+#include <string>
+#include <vector>
+
+//
+// Settings that can be changed from the command line.
+//
+struct PlayerOptions
+{
+    // Number of converted frames the video decoder may run ahead of
+    // presentation
+    int decodeAhead = 4;
+
+    // How much compressed data the demuxer may queue ahead, per stream and
+    // in total. A memoryBudget of 0 is unlimited.
+    QueueLimits videoQueue = DefaultVideoQueueLimits;
+    QueueLimits audioQueue = DefaultAudioQueueLimits;
+    size_t memoryBudget = 32 << 20;
+
+    // How the file is read. readAheadBytes is the window the read-ahead
+    // backend keeps buffered.
+    InputSource::Backend io = InputSource::ReadAheadBackend;
+    size_t readAheadBytes = 8 << 20;
+
+    // Play the audio stream, if there is one
+    bool audio = true;
+
+    // Probe only a little of the file, and not at all when the container
+    // headers already describe the streams
+    bool fastStart = false;
+
+    CodecThreading videoThreading;
+    CodecThreading audioThreading;
+
+    // Play the input as a live stream: no seeking, minimal probing, and a
+    // jitter buffer holding playback liveLatencyMs behind what has arrived.
+    // On by itself for stdin, pipes and network URLs.
+    bool live = false;
+    sf::Int64 liveLatencyMs = 100;
+
+    // Clock video is presented against. Files without audio fall back to
+    // the external clock.
+    SyncClock::Master syncMaster = SyncClock::AudioMaster;
+
+    // Let the video decoder drop late frames and skip non-reference frames
+    bool dropLate = true;
+
+    // Build (or load) a keyframe index and seek through it
+    bool seekIndex = true;
+
+    // Decode forward from the keyframe to the exact seek target
+    bool exactSeek = true;
+
+    // Memory for presented frames kept for stepping and short backward
+    // seeks, 0 for none. Kept at half size the same memory holds four
+    // times as many.
+    size_t frameCacheBytes = 128 << 20;
+    bool frameCacheHalfSize = false;
+
+    // Initial window size, 0 for the source size. Either way the window
+    // starts no larger than the desktop.
+    int windowWidth = 0;
+    int windowHeight = 0;
+
+    // Colour conversion kernel; auto picks the fastest the CPU supports
+    RgbaConverter::Path convertPath = RgbaConverter::AutoPath;
+
+    // Run the colour conversion benchmark and exit
+    bool benchConvert = false;
+
+    // Compare the conversion kernels against swscale and exit
+    bool checkConvert = false;
+
+    // Write the synthetic benchmark clips into this directory and exit
+    std::string testMediaDir;
+
+    // Time each pipeline stage of the inputs on its own and exit, printing
+    // JSON lines to benchOutPath, or to stdout when it is empty
+    bool benchStages = false;
+    std::string benchOutPath;
+
+    // Decode the inputs as fast as possible without a window or audio
+    // device and print throughput
+    bool headless = false;
+
+    // With --headless, leave out the RGBA conversion
+    bool skipScale = false;
+
+    // Build the thumbnail strip of every input, one picture every this
+    // many ms, and exit. 0 is off.
+    sf::Int64 thumbnailIntervalMs = 0;
+    int thumbnailWidth = 160;
+    int thumbnailHeight = 90;
+    // Thumbnail workers, 0 for one per core
+    unsigned thumbnailWorkers = 0;
+
+    // Play the inputs tiled in one window, repeated to wallStreams tiles
+    // when that is more, wallPageSize of them on screen at a time
+    bool wall = false;
+    size_t wallStreams = 0;
+    size_t wallPageSize = 16;
+
+    // Find how many streams the wall plays on time and exit
+    bool wallBench = false;
+
+    // Write every extractEvery-th frame of each input into extractDir, or
+    // the frames at extractTimesMs when given, and exit. Off when empty.
+    std::string extractDir;
+    int extractEvery = 1;
+    std::vector<sf::Int64> extractTimesMs;
+    FrameExtractor::Format extractFormat = FrameExtractor::PngFormat;
+
+    // Threads of the wall's decode pool and the extraction writers, 0 for
+    // one per core
+    unsigned poolThreads = 0;
+
+    // Write a Chrome trace of the session here when not empty
+    std::string tracePath;
+
+    // Files given on the command line and in --playlist files, played in
+    // order
+    std::vector<std::string> inputs;
+};
+
+// Returns false and prints usage if the command line can't be parsed.
+bool parseOptions(int argc, char const** argv, PlayerOptions& options);
+
+#endif
@@ -0,0 +1,182 @@
+#include "PacketPool.hpp"
+
+#include <atomic>
+#include <cstring>
+
+// AVBufferPool's allocator takes no opaque pointer, so the count of fresh
+// payload allocations is process wide.
+static std::atomic<sf::Uint64> s_payloadAllocations(0);
+
+static AVBufferRef* allocPayload(int size)
+{
+    ++s_payloadAllocations;
+    return av_buffer_alloc(size);
+}
+
+PacketHandle::PacketHandle()
+: m_pool(NULL)
+, m_packet(NULL)
+{
+}
+
+PacketHandle::PacketHandle(PacketPool* pool, AVPacket* packet)
+: m_pool(pool)
+, m_packet(packet)
+{
+}
+
+PacketHandle::PacketHandle(PacketHandle&& other)
+: m_pool(other.m_pool)
+, m_packet(other.m_packet)
+{
+    other.m_packet = NULL;
+}
+
+PacketHandle& PacketHandle::operator=(PacketHandle&& other)
+{
+    if(this != &other)
+    {
+        reset();
+        m_pool = other.m_pool;
+        m_packet = other.m_packet;
+        other.m_packet = NULL;
+    }
+    return *this;
+}
+
+PacketHandle::~PacketHandle()
+{
+    reset();
+}
+
+void PacketHandle::reset()
+{
+    if(m_packet)
+    {
+        m_pool->release(m_packet);
+        m_packet = NULL;
+    }
+}
+
+PacketPool::PacketPool()
+{
+    std::memset(&m_stats, 0, sizeof(m_stats));
+
+    for (int i = 0; i < NumPayloadBuckets; ++i)
+    {
+        m_payloadPools[i] = av_buffer_pool_init(1024 << i, allocPayload);
+    }
+}
+
+PacketPool::~PacketPool()
+{
+    for (auto p : m_free)
+    {
+        av_free(p);
+    }
+
+    // Buffers still referenced keep their pool alive until they are released
+    for (int i = 0; i < NumPayloadBuckets; ++i)
+    {
+        av_buffer_pool_uninit(&m_payloadPools[i]);
+    }
+}
+
+PacketHandle PacketPool::acquire()
+{
+    AVPacket* packet = NULL;
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        if(!m_free.empty())
+        {
+            packet = m_free.back();
+            m_free.pop_back();
+            ++m_stats.packetReuses;
+            countInUse();
+        }
+    }
+
+    if(!packet)
+    {
+        // Counted only once there is something to count
+        packet = (AVPacket*)av_malloc(sizeof(AVPacket));
+        if(!packet)
+            return PacketHandle();
+
+        std::lock_guard<std::mutex> lk(m_mut);
+        ++m_stats.packetAllocations;
+        countInUse();
+    }
+
+    av_init_packet(packet);
+    packet->data = NULL;
+    packet->size = 0;
+
+    return PacketHandle(this, packet);
+}
+
+void PacketPool::countInUse()
+{
+    ++m_stats.inUse;
+    if(m_stats.inUse > m_stats.highWater)
+        m_stats.highWater = m_stats.inUse;
+}
+
+void PacketPool::release(AVPacket* packet)
+{
+    // Drops our reference on the payload; pooled payloads go back to their bucket
+    av_free_packet(packet);
+
+    std::lock_guard<std::mutex> lk(m_mut);
+    m_free.push_back(packet);
+    --m_stats.inUse;
+}
+
+bool PacketPool::makeRefcounted(AVPacket* packet)
+{
+    if(packet->buf || !packet->data)
+        return true;
+
+    // Side data has to be duplicated too, leave that case to lavc
+    if(packet->side_data_elems > 0)
+        return av_dup_packet(packet) >= 0;
+
+    const int size = packet->size + FF_INPUT_BUFFER_PADDING_SIZE;
+
+    int bucket = 0;
+    while (bucket < NumPayloadBuckets && (1024 << bucket) < size)
+        ++bucket;
+
+    AVBufferRef* buf = bucket < NumPayloadBuckets ? av_buffer_pool_get(m_payloadPools[bucket]) : allocPayload(size);
+    if(!buf)
+        return false;
+
+    std::memcpy(buf->data, packet->data, packet->size);
+    std::memset(buf->data + packet->size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+
+    // The old data still belongs to the demuxer
+    packet->buf = buf;
+    packet->data = buf->data;
+
+    std::lock_guard<std::mutex> lk(m_mut);
+    ++m_stats.payloadCopies;
+    return true;
+}
+
+PacketPoolStats PacketPool::stats() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    PacketPoolStats stats = m_stats;
+    stats.payloadAllocations = s_payloadAllocations;
+    return stats;
+}
+
+void PacketPool::printStats(std::ostream& out) const
+{
+    PacketPoolStats s = stats();
+    out << "packet pool: " << s.packetAllocations << " packets allocated, "
+        << s.packetReuses << " reused, high-water " << s.highWater << ", "
+        << s.inUse << " in use; "
+        << s.payloadCopies << " payload copies, "
+        << s.payloadAllocations << " payload buffers allocated" << std::endl;
+}
@@ -0,0 +1,106 @@
+#ifndef PACKET_POOL_HPP
+#define PACKET_POOL_HPP
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+#include <SFML/Config.hpp>
+
+#include <mutex>
+#include <vector>
+#include <ostream>
+
+class PacketPool;
+
+//
+// Owning handle to a pooled AVPacket. Move-only; when it goes away the
+// payload is unreferenced and the packet struct goes back to its pool.
+//
+class PacketHandle
+{
+public:
+    PacketHandle();
+    PacketHandle(PacketPool* pool, AVPacket* packet);
+    PacketHandle(PacketHandle&& other);
+    PacketHandle& operator=(PacketHandle&& other);
+    ~PacketHandle();
+
+    void reset();
+
+    AVPacket* get() const
+    {
+        return m_packet;
+    }
+
+    AVPacket* operator->() const
+    {
+        return m_packet;
+    }
+
+    explicit operator bool() const
+    {
+        return m_packet != NULL;
+    }
+
+private:
+    PacketHandle(const PacketHandle&);
+    PacketHandle& operator=(const PacketHandle&);
+
+    PacketPool* m_pool;
+    AVPacket* m_packet;
+};
+
+struct PacketPoolStats
+{
+    sf::Uint64 packetAllocations;
+    sf::Uint64 packetReuses;
+    sf::Uint64 payloadCopies;
+    sf::Uint64 payloadAllocations;
+    size_t inUse;
+    size_t highWater;
+};
+
+//
+// Recycles AVPacket structs, and the payload buffers of packets we have to
+// copy ourselves, so steady-state demuxing does no av_malloc/av_free for
+// them. Thread-safe: the demuxer acquires, the decoders release.
+//
+// The pool must outlive every handle it gave out.
+//
+class PacketPool
+{
+public:
+    PacketPool();
+    ~PacketPool();
+
+    // An empty handle if there is no memory left for one
+    PacketHandle acquire();
+
+    // Makes the payload survive the next av_read_frame. Refcounted packets
+    // are left alone, anything else is copied into a recycled buffer.
+    bool makeRefcounted(AVPacket* packet);
+
+    PacketPoolStats stats() const;
+    void printStats(std::ostream& out) const;
+
+private:
+    friend class PacketHandle;
+    void release(AVPacket* packet);
+    // With m_mut held
+    void countInUse();
+
+    PacketPool(const PacketPool&);
+    PacketPool& operator=(const PacketPool&);
+
+    // Payloads are served from power-of-two buckets starting at 1 KiB
+    static const int NumPayloadBuckets = 14;
+
+    mutable std::mutex m_mut;
+    std::vector<AVPacket*> m_free;
+    AVBufferPool* m_payloadPools[NumPayloadBuckets];
+    PacketPoolStats m_stats;
+};
+
+#endif
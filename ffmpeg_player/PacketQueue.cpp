@@ -0,0 +1,210 @@
+#include "PacketQueue.hpp"
+
+#include <atomic>
+
+static std::atomic<int> s_nextSerial(0);
+
+PacketQueue::PacketQueue(const QueueLimits& limits, MemoryBudget* budget)
+: m_limits(limits)
+, m_budget(budget)
+, m_bytes(0)
+, m_peakBytes(0)
+, m_serial(s_nextSerial++)
+, m_seekTargetMs(-1)
+, m_eof(false)
+, m_aborted(false)
+{
+    m_timeBase.num = 0;
+    m_timeBase.den = 1;
+}
+
+PacketQueue::~PacketQueue()
+{
+    clear();
+}
+
+void PacketQueue::setTimeBase(AVRational timeBase)
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    m_timeBase = timeBase;
+}
+
+void PacketQueue::push(PacketHandle packet)
+{
+    // Pooled payloads sit in power-of-two buffers, count those
+    size_t bytes = sizeof(AVPacket) + (packet->buf ? packet->buf->size : packet->size);
+
+    int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        int64_t timeMs = INT64_MIN;
+        if(ts != AV_NOPTS_VALUE && m_timeBase.num)
+            timeMs = 1000 * ts * av_q2d(m_timeBase);
+
+        // Charged before the entry is visible, so a pop can't release it
+        // first
+        if(m_budget)
+            m_budget->add(bytes);
+
+        Entry e = { std::move(packet), m_serial, bytes, timeMs };
+        m_packets.push_back(std::move(e));
+
+        m_bytes += bytes;
+        if(m_bytes > m_peakBytes)
+            m_peakBytes = m_bytes;
+    }
+    m_cond.notify_one();
+}
+
+bool PacketQueue::pop(PacketHandle& packet, int& serial)
+{
+    std::unique_lock<std::mutex> lk(m_mut);
+    m_cond.wait(lk, [this]{ return !m_packets.empty() || m_eof || m_aborted; });
+
+    if(m_aborted || m_packets.empty())
+        return false;
+
+    packet = std::move(m_packets.front().packet);
+    serial = m_packets.front().serial;
+    const size_t bytes = m_packets.front().bytes;
+    m_packets.pop_front();
+
+    m_bytes -= bytes;
+    if(m_budget)
+        m_budget->release(bytes);
+    return true;
+}
+
+bool PacketQueue::tryPop(PacketHandle& packet, int& serial)
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    if(m_aborted || m_packets.empty())
+        return false;
+
+    packet = std::move(m_packets.front().packet);
+    serial = m_packets.front().serial;
+    const size_t bytes = m_packets.front().bytes;
+    m_packets.pop_front();
+
+    m_bytes -= bytes;
+    if(m_budget)
+        m_budget->release(bytes);
+    return true;
+}
+
+void PacketQueue::flush(int64_t targetMs)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        clear();
+        m_serial = s_nextSerial++;
+        m_seekTargetMs = targetMs;
+        m_eof = false;
+    }
+    m_cond.notify_all();
+}
+
+void PacketQueue::setEof()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_eof = true;
+    }
+    m_cond.notify_all();
+}
+
+void PacketQueue::abort()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_aborted = true;
+    }
+    m_cond.notify_all();
+}
+
+size_t PacketQueue::size() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    return m_packets.size();
+}
+
+bool PacketQueue::isEmpty() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    return m_packets.empty();
+}
+
+bool PacketQueue::isFull() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    return (m_limits.maxPackets && m_packets.size() >= m_limits.maxPackets)
+        || (m_limits.maxBytes && m_bytes >= m_limits.maxBytes)
+        || (m_limits.maxDurationMs && durationMs() >= m_limits.maxDurationMs);
+}
+
+bool PacketQueue::isHardFull() const
+{
+    // A queue may run past its limits while the other stream starves, but
+    // never by more than this, so memory stays bounded on badly interleaved
+    // files. Duration doesn't count here, bytes are what costs memory.
+    std::lock_guard<std::mutex> lk(m_mut);
+    return (m_limits.maxPackets && m_packets.size() >= m_limits.maxPackets * 4)
+        || (m_limits.maxBytes && m_bytes >= m_limits.maxBytes * 2);
+}
+
+bool PacketQueue::isFinished() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    return m_eof && m_packets.empty();
+}
+
+int64_t PacketQueue::seekTargetMs(int serial) const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    return serial == m_serial ? m_seekTargetMs : -1;
+}
+
+int PacketQueue::serial() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    return m_serial;
+}
+
+PacketQueueStats PacketQueue::stats() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    PacketQueueStats s = { m_packets.size(), m_bytes, durationMs(), m_peakBytes };
+    return s;
+}
+
+int64_t PacketQueue::durationMs() const
+{
+    // Called with m_mut held
+    if(m_packets.size() < 2)
+        return 0;
+
+    const int64_t first = m_packets.front().timeMs;
+    const int64_t last = m_packets.back().timeMs;
+    if(first == INT64_MIN || last == INT64_MIN || last < first)
+        return 0;
+
+    return last - first;
+}
+
+void PacketQueue::clear()
+{
+    // Called with m_mut held, or from the destructor
+    if(m_budget)
+        m_budget->release(m_bytes);
+
+    m_packets.clear();
+    m_bytes = 0;
+}
+
+void printQueueStats(std::ostream& out, const char* name, const PacketQueueStats& stats)
+{
+    out << name << " packet queue: " << stats.packets << " packets, "
+        << stats.bytes / 1024 << " KiB, " << stats.durationMs << " ms queued; peak "
+        << stats.peakBytes / 1024 << " KiB" << std::endl;
+}
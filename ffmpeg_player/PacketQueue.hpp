@@ -0,0 +1,116 @@
+#ifndef PACKET_QUEUE_HPP
+#define PACKET_QUEUE_HPP
+
+#include "PacketPool.hpp"
+#include "MemoryBudget.hpp"
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <ostream>
+
+//
+// Soft limits the demuxer keeps a queue under; it counts as full as soon
+// as any of them is reached. 0 disables a limit.
+//
+struct QueueLimits
+{
+    size_t maxPackets;
+    size_t maxBytes;
+    int64_t maxDurationMs;
+};
+
+const QueueLimits DefaultVideoQueueLimits = { 150, 24 << 20, 10000 };
+const QueueLimits DefaultAudioQueueLimits = { 300, 4 << 20, 10000 };
+
+struct PacketQueueStats
+{
+    size_t packets;
+    size_t bytes;
+    int64_t durationMs;
+    size_t peakBytes;
+};
+
+void printQueueStats(std::ostream& out, const char* name, const PacketQueueStats& stats);
+
+//
+// FIFO of demuxed packets for one stream, filled by the Demuxer thread and
+// drained by a single decoder.
+//
+// Every packet carries the queue serial it was pushed under. flush() bumps
+// the serial, so a consumer that sees a new serial knows a seek happened and
+// must flush its codec before decoding the packet. Serials are unique
+// across all queues, so one file's serial is never mistaken for another's
+// in a playlist.
+//
+// Bytes are counted as the size of the buffers the packets hold, which is
+// what they cost in memory, and are also charged to the shared budget if
+// there is one. Duration is the span of timestamps from the oldest to the
+// newest packet.
+//
+class PacketQueue
+{
+public:
+    explicit PacketQueue(const QueueLimits& limits, MemoryBudget* budget = NULL);
+    ~PacketQueue();
+
+    // Never blocks; the Demuxer uses isFull() to decide when to stop reading.
+    void push(PacketHandle packet);
+
+    // Blocks until a packet is available. Returns false once the queue has
+    // been drained after EOF, or when it has been aborted.
+    bool pop(PacketHandle& packet, int& serial);
+
+    // Non-blocking variant of pop(). Returns false if nothing is queued.
+    bool tryPop(PacketHandle& packet, int& serial);
+
+    // Drops every queued packet, clears EOF and starts a new serial.
+    // targetMs is the exact position the seek asked for, or -1 when the
+    // consumer should start with whatever comes first.
+    void flush(int64_t targetMs = -1);
+
+    // Time base of the packets' timestamps, for the duration limit
+    void setTimeBase(AVRational timeBase);
+
+    // Seek target of the given serial, -1 if none or if it is stale
+    int64_t seekTargetMs(int serial) const;
+
+    void setEof();
+    void abort();
+
+    size_t size() const;
+    bool isEmpty() const;
+    bool isFull() const;
+    bool isHardFull() const;
+    bool isFinished() const;
+    int serial() const;
+
+    PacketQueueStats stats() const;
+
+private:
+    struct Entry
+    {
+        PacketHandle packet;
+        int serial;
+        size_t bytes;
+        int64_t timeMs;
+    };
+
+    int64_t durationMs() const;
+    void clear();
+
+    mutable std::mutex m_mut;
+    std::condition_variable m_cond;
+    std::deque<Entry> m_packets;
+    QueueLimits m_limits;
+    MemoryBudget* m_budget;
+    AVRational m_timeBase;
+    size_t m_bytes;
+    size_t m_peakBytes;
+    int m_serial;
+    int64_t m_seekTargetMs;
+    bool m_eof;
+    bool m_aborted;
+};
+
+#endif
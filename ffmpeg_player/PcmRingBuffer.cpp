@@ -0,0 +1,62 @@
+#include "PcmRingBuffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+PcmRingBuffer::PcmRingBuffer(size_t capacity)
+: m_buffer(new sf::Int16[capacity])
+, m_capacity(capacity)
+, m_readPos(0)
+, m_writePos(0)
+{
+}
+
+PcmRingBuffer::~PcmRingBuffer()
+{
+    delete [] m_buffer;
+}
+
+size_t PcmRingBuffer::write(const sf::Int16* samples, size_t count)
+{
+    const size_t w = m_writePos.load(std::memory_order_relaxed);
+    const size_t r = m_readPos.load(std::memory_order_acquire);
+
+    const size_t n = std::min(count, m_capacity - (w - r));
+    const size_t offset = w % m_capacity;
+    const size_t first = std::min(n, m_capacity - offset);
+
+    std::memcpy(m_buffer + offset, samples, first * sizeof(sf::Int16));
+    std::memcpy(m_buffer, samples + first, (n - first) * sizeof(sf::Int16));
+
+    m_writePos.store(w + n, std::memory_order_release);
+    return n;
+}
+
+size_t PcmRingBuffer::read(sf::Int16* samples, size_t count)
+{
+    const size_t r = m_readPos.load(std::memory_order_relaxed);
+    const size_t w = m_writePos.load(std::memory_order_acquire);
+
+    const size_t n = std::min(count, w - r);
+    const size_t offset = r % m_capacity;
+    const size_t first = std::min(n, m_capacity - offset);
+
+    std::memcpy(samples, m_buffer + offset, first * sizeof(sf::Int16));
+    std::memcpy(samples + first, m_buffer, (n - first) * sizeof(sf::Int16));
+
+    m_readPos.store(r + n, std::memory_order_release);
+    return n;
+}
+
+void PcmRingBuffer::reset()
+{
+    m_readPos = 0;
+    m_writePos = 0;
+}
+
+size_t PcmRingBuffer::size() const
+{
+    // Read position first: it never overtakes the write position
+    const size_t r = m_readPos.load(std::memory_order_acquire);
+    return m_writePos.load(std::memory_order_acquire) - r;
+}
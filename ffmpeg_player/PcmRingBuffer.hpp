@@ -0,0 +1,47 @@
+#ifndef PCM_RING_BUFFER_HPP
+#define PCM_RING_BUFFER_HPP
+
+#include <SFML/Config.hpp>
+
+#include <atomic>
+#include <cstddef>
+
+//
+// Lock-free single-producer/single-consumer ring of interleaved 16 bit
+// samples. The audio decode thread writes, SFML's streaming thread reads.
+//
+// Positions only ever increase; their difference is the fill level, so no
+// slot is wasted to tell full from empty.
+//
+class PcmRingBuffer
+{
+public:
+    explicit PcmRingBuffer(size_t capacity);
+    ~PcmRingBuffer();
+
+    // Producer side. Writes as much as fits and returns the sample count.
+    size_t write(const sf::Int16* samples, size_t count);
+
+    // Consumer side. Reads up to count samples and returns how many it got.
+    size_t read(sf::Int16* samples, size_t count);
+
+    // Only safe while neither side is running.
+    void reset();
+
+    size_t size() const;
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    PcmRingBuffer(const PcmRingBuffer&);
+    PcmRingBuffer& operator=(const PcmRingBuffer&);
+
+    sf::Int16* m_buffer;
+    size_t m_capacity;
+    std::atomic<size_t> m_readPos;
+    std::atomic<size_t> m_writePos;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include "PlaybackItem.hpp"
+
+#include <algorithm>
+
+sf::Vector2u fitInside(int srcWidth, int srcHeight, unsigned boxWidth, unsigned boxHeight)
+{
+    double scale = std::min(boxWidth / (double)srcWidth, boxHeight / (double)srcHeight);
+    unsigned w = std::max(1u, (unsigned)(srcWidth * scale + 0.5));
+    unsigned h = std::max(1u, (unsigned)(srcHeight * scale + 0.5));
+    return sf::Vector2u(std::min(w, boxWidth), std::min(h, boxHeight));
+}
+
+PlaybackItem::PlaybackItem(const PlayerOptions& options)
+: m_options(options)
+, m_durationMs(0)
+, m_maxOutputSize(0, 0)
+, m_pooledDecoding(false)
+, m_packetBudget(options.memoryBudget)
+, m_videoPkts(options.videoQueue, &m_packetBudget)
+, m_audioPkts(options.audioQueue, &m_packetBudget)
+{
+}
+
+PlaybackItem::~PlaybackItem()
+{
+    stop();
+}
+
+bool PlaybackItem::open(const std::string& path, const SyncClock* clock)
+{
+    if(!m_media.open(path, m_options))
+        return false;
+
+    const int64_t duration = m_media.formatContext()->duration;
+    if(duration != AV_NOPTS_VALUE && duration > 0)
+        m_durationMs = duration / (AV_TIME_BASE / 1000);
+
+    AVStream* videoStream = m_media.videoStream();
+    sf::Vector2u frameSize(videoStream->codec->width, videoStream->codec->height);
+    if(m_maxOutputSize.x > 0 && m_maxOutputSize.y > 0)
+        frameSize = fitInside(frameSize.x, frameSize.y, std::min(frameSize.x, m_maxOutputSize.x), std::min(frameSize.y, m_maxOutputSize.y));
+    m_videoFrames.reset(new FrameQueue(m_options.decodeAhead, frameSize.x, frameSize.y));
+    m_keyframes.reset(new KeyframeIndex(m_media.path(), m_media.videoStreamIndex()));
+
+    // From here on the format context belongs to the demuxer thread
+    m_demuxer.reset(new Demuxer(m_media.formatContext(), m_media.videoStreamIndex(), m_media.audioStreamIndex(), m_packetPool, m_videoPkts, m_audioPkts));
+    m_demuxer->setKeyframeIndex(m_keyframes.get());
+    m_demuxer->setExactSeek(m_options.exactSeek);
+    m_demuxer->setMemoryBudget(&m_packetBudget);
+    m_demuxer->setLive(m_options.live);
+
+    m_videoDecoder.reset(new VideoDecoder(videoStream, m_videoPkts, *m_videoFrames, true, m_options.dropLate ? clock : NULL, m_options.convertPath));
+
+    // The decoder starts out at the source size, which may not fit
+    if(m_maxOutputSize.x > 0 && m_maxOutputSize.y > 0)
+        setWindowSize(m_maxOutputSize);
+    return true;
+}
+
+void PlaybackItem::start()
+{
+    m_demuxer->start();
+    if(!m_pooledDecoding)
+        m_videoDecoder->start();
+
+    // With --fast-start the player builds the index once the first frame
+    // is up, so it doesn't compete with startup for the disk
+    if(m_options.seekIndex && !m_options.fastStart)
+        m_keyframes->start();
+}
+
+void PlaybackItem::stop()
+{
+    if(m_videoDecoder)
+        m_videoDecoder->stop();
+    if(m_demuxer)
+        m_demuxer->stop();
+    if(m_keyframes)
+        m_keyframes->stop();
+}
+
+void PlaybackItem::setWindowSize(const sf::Vector2u& size)
+{
+    const AVCodecContext* codecCtx = m_media.videoStream()->codec;
+    unsigned boxWidth = std::min<unsigned>(size.x, codecCtx->width);
+    unsigned boxHeight = std::min<unsigned>(size.y, codecCtx->height);
+    if(m_maxOutputSize.x > 0 && m_maxOutputSize.y > 0)
+    {
+        boxWidth = std::min(boxWidth, m_maxOutputSize.x);
+        boxHeight = std::min(boxHeight, m_maxOutputSize.y);
+    }
+    sf::Vector2u output = fitInside(codecCtx->width, codecCtx->height, boxWidth, boxHeight);
+    m_videoDecoder->setOutputSize(output.x, output.y);
+}
+
+bool PlaybackItem::isFinished() const
+{
+    return m_videoDecoder->isFinished() && m_videoPkts.isFinished() && m_videoFrames->size() == 0;
+}
+
+sf::Int64 PlaybackItem::frameIntervalMs() const
+{
+    const AVRational rate = m_media.videoStream()->avg_frame_rate;
+    if(rate.num <= 0 || rate.den <= 0)
+        return 40;
+
+    return std::max<sf::Int64>(1, 1000 * rate.den / rate.num);
+}
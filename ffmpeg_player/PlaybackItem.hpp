@@ -0,0 +1,149 @@
+#ifndef PLAYBACK_ITEM_HPP
+#define PLAYBACK_ITEM_HPP
+
+#include <SFML/System.hpp>
+
+#include "MediaFile.hpp"
+#include "PacketPool.hpp"
+#include "PacketQueue.hpp"
+#include "MemoryBudget.hpp"
+#include "FrameQueue.hpp"
+#include "KeyframeIndex.hpp"
+#include "Demuxer.hpp"
+#include "VideoDecoder.hpp"
+
+#include <memory>
+#include <string>
+
+// Largest size with the source's aspect ratio that fits in the box
+sf::Vector2u fitInside(int srcWidth, int srcHeight, unsigned boxWidth, unsigned boxHeight);
+
+//
+// One file's video pipeline: the opened media, its packet and frame queues,
+// the demuxer and the video decoder. Its audio queue is drained by
+// MovieSound, which outlives items so the output keeps running from one
+// file of a playlist to the next.
+//
+class PlaybackItem
+{
+public:
+    explicit PlaybackItem(const PlayerOptions& options);
+    ~PlaybackItem();
+
+    // Frames are converted to no more than this, and the frame queue's
+    // buffers sized for it. Call before open().
+    void setMaxOutputSize(const sf::Vector2u& size)
+    {
+        m_maxOutputSize = size;
+    }
+
+    // Leaves video decoding to the caller, through
+    // videoDecoder().decodeStep(), instead of a thread of its own. Call
+    // before start().
+    void setPooledDecoding(bool pooled)
+    {
+        m_pooledDecoding = pooled;
+    }
+
+    // Opens the file and builds the pipeline without starting it. May run
+    // on any thread.
+    bool open(const std::string& path, const SyncClock* clock);
+
+    // Reads and decodes ahead until the queues are full, whether or not
+    // the item is presented yet
+    void start();
+
+    // Stops reading and video decoding. The audio queue is left as it is
+    // for MovieSound to play out.
+    void stop();
+
+    // Frames are converted at the size they are shown, but never above the
+    // source size; the GPU stretches them beyond that
+    void setWindowSize(const sf::Vector2u& size);
+
+    // Every frame decoded and taken off the frame queue
+    bool isFinished() const;
+
+    // From the container, 0 when unknown
+    sf::Int64 durationMs() const
+    {
+        return m_durationMs;
+    }
+
+    // Nominal frame duration, 40 ms when the stream doesn't say
+    sf::Int64 frameIntervalMs() const;
+
+    const MediaFile& media() const
+    {
+        return m_media;
+    }
+
+    bool hasAudio() const
+    {
+        return m_media.audioStreamIndex() >= 0;
+    }
+
+    Demuxer& demuxer()
+    {
+        return *m_demuxer;
+    }
+
+    VideoDecoder& videoDecoder()
+    {
+        return *m_videoDecoder;
+    }
+
+    PacketQueue& videoPackets()
+    {
+        return m_videoPkts;
+    }
+
+    PacketQueue& audioPackets()
+    {
+        return m_audioPkts;
+    }
+
+    FrameQueue& videoFrames()
+    {
+        return *m_videoFrames;
+    }
+
+    KeyframeIndex& keyframes()
+    {
+        return *m_keyframes;
+    }
+
+    const MemoryBudget& packetBudget() const
+    {
+        return m_packetBudget;
+    }
+
+    const PacketPool& packetPool() const
+    {
+        return m_packetPool;
+    }
+
+private:
+    PlaybackItem(const PlaybackItem&);
+    PlaybackItem& operator=(const PlaybackItem&);
+
+    const PlayerOptions& m_options;
+    sf::Int64 m_durationMs;
+    sf::Vector2u m_maxOutputSize;
+    bool m_pooledDecoding;
+
+    // Declared first so it is closed last, after every thread using it
+    MediaFile m_media;
+
+    // Must outlive the queues and everyone holding a packet
+    PacketPool m_packetPool;
+    MemoryBudget m_packetBudget;
+    PacketQueue m_videoPkts;
+    PacketQueue m_audioPkts;
+    std::unique_ptr<FrameQueue> m_videoFrames;
+    std::unique_ptr<KeyframeIndex> m_keyframes;
+    std::unique_ptr<Demuxer> m_demuxer;
+    std::unique_ptr<VideoDecoder> m_videoDecoder;
+};
+
+#endif
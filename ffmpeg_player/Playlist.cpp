@@ -0,0 +1,116 @@
+#include "Playlist.hpp"
+#include "Trace.hpp"
+
+#include <fstream>
+
+Playlist::Playlist(const std::vector<std::string>& paths, const PlayerOptions& options, const SyncClock* clock)
+: m_paths(paths)
+, m_options(options)
+, m_clock(clock)
+, m_startup(NULL)
+, m_nextIndex(0)
+, m_loadedPosition(0)
+, m_position(0)
+, m_ready(false)
+, m_openStats("item open")
+{
+}
+
+Playlist::~Playlist()
+{
+    if(m_thread.joinable())
+        m_thread.join();
+}
+
+void Playlist::preload(const sf::Vector2u& windowSize)
+{
+    if(m_thread.joinable() || !hasNext())
+        return;
+
+    m_ready = false;
+    m_thread = std::thread(&Playlist::load, this, windowSize);
+}
+
+std::unique_ptr<PlaybackItem> Playlist::takeNext(const sf::Vector2u& windowSize)
+{
+    preload(windowSize);
+    if(m_thread.joinable())
+        m_thread.join();
+
+    m_ready = false;
+    m_position = m_loadedPosition;
+    return std::move(m_loaded);
+}
+
+void Playlist::stop()
+{
+    if(m_thread.joinable())
+        m_thread.join();
+
+    m_loaded.reset();
+    m_ready = false;
+}
+
+void Playlist::load(sf::Vector2u windowSize)
+{
+    traceThreadName("playlist preload");
+
+    while (m_nextIndex < m_paths.size())
+    {
+        const size_t index = m_nextIndex++;
+        const std::string& path = m_paths[index];
+
+        std::unique_ptr<PlaybackItem> item(new PlaybackItem(m_options));
+        bool opened = false;
+        {
+            StageTimer timer(m_openStats);
+            opened = item->open(path, m_clock);
+            if(opened)
+            {
+                item->setWindowSize(windowSize);
+                item->start();
+            }
+        }
+
+        if(opened)
+        {
+            if(m_startup)
+                m_startup->mark(StartupTimer::MediaOpened);
+
+            m_loaded = std::move(item);
+            m_loadedPosition = index + 1;
+            break;
+        }
+
+        av_log(NULL, AV_LOG_WARNING, "skipping %s\n", path.c_str());
+    }
+
+    m_ready = true;
+}
+
+bool readPlaylistFile(const std::string& path, std::vector<std::string>& paths)
+{
+    std::ifstream in(path.c_str());
+    if(!in)
+        return false;
+
+    std::string dir;
+    const size_t slash = path.find_last_of('/');
+    if(slash != std::string::npos)
+        dir = path.substr(0, slash + 1);
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        // Tolerate files written on Windows
+        if(!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        paths.push_back(line[0] == '/' || line.find("://") != std::string::npos ? line : dir + line);
+    }
+
+    return true;
+}
@@ -0,0 +1,105 @@
+#ifndef PLAYLIST_HPP
+#define PLAYLIST_HPP
+
+#include "PlaybackItem.hpp"
+#include "StageStats.hpp"
+#include "StartupTimer.hpp"
+
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+//
+// The files to play, in order. preload() opens, probes and starts the next
+// one on a background thread, so by the time the current one ends the next
+// has its first frames decoded and its audio queued. Files that fail to
+// open are skipped.
+//
+class Playlist
+{
+public:
+    Playlist(const std::vector<std::string>& paths, const PlayerOptions& options, const SyncClock* clock);
+    ~Playlist();
+
+    // Marks MediaOpened when the first item is open. Call before preload().
+    void setStartupTimer(StartupTimer* startup)
+    {
+        m_startup = startup;
+    }
+
+    // Starts opening the next file unless that is already under way or the
+    // list is done. Frames are converted for a window of that size.
+    void preload(const sf::Vector2u& windowSize);
+
+    // A preload was started and its item not taken yet
+    bool isPreloading() const
+    {
+        return m_thread.joinable();
+    }
+
+    // The preload has finished and takeNext() won't block
+    bool isReady() const
+    {
+        return m_ready;
+    }
+
+    // Files not yet handed out by takeNext()
+    bool hasNext() const
+    {
+        return m_nextIndex < m_paths.size();
+    }
+
+    // Waits for the preload (starting one if needed) and returns the item,
+    // or NULL when no file is left that opens
+    std::unique_ptr<PlaybackItem> takeNext(const sf::Vector2u& windowSize);
+
+    // Waits for a preload under way and drops its item
+    void stop();
+
+    // Position of the item last handed out, from 1
+    size_t position() const
+    {
+        return m_position;
+    }
+
+    size_t size() const
+    {
+        return m_paths.size();
+    }
+
+    // How long opening and starting each item took
+    const StageStats& openStats() const
+    {
+        return m_openStats;
+    }
+
+private:
+    Playlist(const Playlist&);
+    Playlist& operator=(const Playlist&);
+
+    void load(sf::Vector2u windowSize);
+
+    std::vector<std::string> m_paths;
+    const PlayerOptions& m_options;
+    const SyncClock* m_clock;
+    StartupTimer* m_startup;
+
+    // Owned by the preload thread while it runs
+    size_t m_nextIndex;
+    size_t m_loadedPosition;
+    std::unique_ptr<PlaybackItem> m_loaded;
+
+    size_t m_position;
+    std::thread m_thread;
+    std::atomic<bool> m_ready;
+    StageStats m_openStats;
+};
+
+// Reads a playlist file: one path per line, blank lines and lines starting
+// with # ignored (so .m3u files work). Relative paths are taken relative to
+// the playlist.
+bool readPlaylistFile(const std::string& path, std::vector<std::string>& paths);
+
+#endif
@@ -0,0 +1,199 @@
+#include "ReadAheadSource.hpp"
+#include "Trace.hpp"
+
+extern "C" {
+#include <libavutil/error.h>
+}
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+// Size of each pread issued by the prefetch thread
+const int64_t ReadAheadChunk = 512 << 10;
+const size_t MinReadAheadWindow = 2 << 20;
+
+ReadAheadSource::ReadAheadSource()
+: m_fd(-1)
+, m_size(0)
+, m_start(0)
+, m_end(0)
+, m_readPos(0)
+, m_generation(0)
+, m_error(0)
+, m_quit(false)
+{
+}
+
+ReadAheadSource::~ReadAheadSource()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_quit = true;
+    }
+    m_spaceCond.notify_all();
+    m_dataCond.notify_all();
+
+    if(m_thread.joinable())
+        m_thread.join();
+
+    if(m_fd >= 0)
+        ::close(m_fd);
+}
+
+bool ReadAheadSource::open(const std::string& path, size_t windowBytes)
+{
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if(m_fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(m_fd, &st) != 0)
+        return false;
+
+    m_size = st.st_size;
+    m_ring.resize(std::max(windowBytes, MinReadAheadWindow));
+    m_stats.syscalls += 2;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    // We do our own read-ahead, but a larger kernel one doesn't hurt
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    m_thread = std::thread(&ReadAheadSource::run, this);
+    return true;
+}
+
+int ReadAheadSource::read(uint8_t* buffer, int size)
+{
+    std::unique_lock<std::mutex> lk(m_mut);
+
+    if(m_readPos >= m_size)
+        return AVERROR_EOF;
+
+    if(m_readPos >= m_end && !m_error)
+    {
+        auto start = std::chrono::steady_clock::now();
+        m_dataCond.wait(lk, [this]{ return m_readPos < m_end || m_error || m_quit; });
+
+        ++m_stats.stalls;
+        m_stats.stallUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    if(m_readPos >= m_end)
+        return m_error ? m_error : AVERROR_EOF;
+
+    const int n = (int)std::min<int64_t>(size, m_end - m_readPos);
+    const size_t ringSize = m_ring.size();
+    const size_t offset = m_readPos % ringSize;
+    const size_t first = std::min<size_t>(n, ringSize - offset);
+
+    memcpy(buffer, &m_ring[offset], first);
+    memcpy(buffer + first, &m_ring[0], n - first);
+
+    m_readPos += n;
+    lk.unlock();
+    m_spaceCond.notify_one();
+
+    ++m_stats.reads;
+    m_stats.bytesRead += n;
+    return n;
+}
+
+int64_t ReadAheadSource::seek(int64_t offset)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        if(offset < 0 || offset > m_size)
+            return AVERROR(EINVAL);
+
+        m_readPos = offset;
+        if(offset >= m_start && offset <= m_end)
+            return offset;
+
+        // Outside the buffer: drop it and prefetch from the new position
+        ++m_generation;
+        m_start = offset;
+        m_end = offset;
+        m_error = 0;
+    }
+    m_spaceCond.notify_one();
+
+    return offset;
+}
+
+void ReadAheadSource::run()
+{
+    traceThreadName("read-ahead");
+
+    const size_t ringSize = m_ring.size();
+    // The rest of the ring keeps bytes behind the read position
+    const int64_t ahead = ringSize - ringSize / 4;
+
+    while (true)
+    {
+        int64_t pos = 0;
+        int64_t n = 0;
+        int generation = 0;
+        {
+            std::unique_lock<std::mutex> lk(m_mut);
+            m_spaceCond.wait(lk, [this, ahead]{
+                return m_quit || (!m_error && m_end < m_size
+                    && m_end + std::min(ReadAheadChunk, m_size - m_end) <= m_readPos + ahead);
+            });
+
+            if(m_quit)
+                break;
+
+            pos = m_end;
+            n = std::min(ReadAheadChunk, m_size - m_end);
+            generation = m_generation;
+
+            // The chunk overwrites the oldest bytes of the ring, stop
+            // serving them first. They are well behind the read position.
+            m_start = std::max(m_start, pos + n - (int64_t)ringSize);
+        }
+
+        // Only this thread writes the ring, and never inside
+        // [m_start, m_end), so the copy needs no lock
+        const size_t offset = pos % ringSize;
+        const size_t first = std::min<size_t>(n, ringSize - offset);
+
+        ssize_t got = 0;
+        int error = 0;
+        while (got < n)
+        {
+            uint8_t* dst = got < (ssize_t)first ? &m_ring[offset + got] : &m_ring[got - first];
+            const size_t want = got < (ssize_t)first ? first - got : n - got;
+
+            ssize_t ret = pread(m_fd, dst, want, pos + got);
+            ++m_stats.syscalls;
+
+            if(ret < 0 && errno == EINTR)
+                continue;
+            if(ret <= 0)
+            {
+                // A file shorter than it was at open ends here
+                error = ret < 0 ? AVERROR(errno) : AVERROR_EOF;
+                break;
+            }
+            got += ret;
+        }
+
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            // A seek reset the buffer while we were reading
+            if(generation != m_generation)
+                continue;
+
+            m_end += got;
+            m_error = error;
+        }
+        m_dataCond.notify_all();
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef READ_AHEAD_SOURCE_HPP
+#define READ_AHEAD_SOURCE_HPP
+
+#include "InputSource.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+//
+// Reads a file on a background thread into a ring that stays up to a window
+// ahead of the demuxer, in large chunks, so slow or high-latency storage
+// (network mounts) rarely blocks the demux thread.
+//
+// A quarter of the window is kept behind the read position, which covers
+// the short backward seeks demuxers make while parsing. A seek outside the
+// buffered range drops the buffer and restarts prefetching there.
+//
+class ReadAheadSource : public InputSource
+{
+public:
+    ReadAheadSource();
+    virtual ~ReadAheadSource();
+
+    bool open(const std::string& path, size_t windowBytes);
+
+    virtual int read(uint8_t* buffer, int size);
+    virtual int64_t seek(int64_t offset);
+
+    virtual int64_t size() const
+    {
+        return m_size;
+    }
+
+    virtual const char* name() const
+    {
+        return "readahead";
+    }
+
+private:
+    void run();
+
+    int m_fd;
+    int64_t m_size;
+    std::vector<uint8_t> m_ring;
+
+    // File offsets of the buffered bytes [m_start, m_end) and the position
+    // the demuxer reads from next. The bytes of offset p live at
+    // m_ring[p % m_ring.size()].
+    int64_t m_start;
+    int64_t m_end;
+    int64_t m_readPos;
+    // Bumped by every reset, so a prefetch that raced with one is dropped
+    int m_generation;
+    int m_error;
+
+    std::thread m_thread;
+    std::mutex m_mut;
+    std::condition_variable m_dataCond;
+    std::condition_variable m_spaceCond;
+    bool m_quit;
+};
+
+#endif
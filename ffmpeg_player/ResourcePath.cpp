@@ -0,0 +1,13 @@
+#include "ResourcePath.hpp"
+
+// Builds without an application bundle (the CMake build on Linux) find the
+// icon and font in the directory compiled in, or else the working directory.
+// ResourcePath.mm takes them from the bundle on OS X.
+std::string resourcePath(void)
+{
+#ifdef FFMPEG_PLAYER_RESOURCE_DIR
+    return FFMPEG_PLAYER_RESOURCE_DIR "/";
+#else
+    return "";
+#endif
+}
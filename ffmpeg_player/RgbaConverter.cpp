@@ -0,0 +1,254 @@
+#include "RgbaConverter.hpp"
+#include "RgbaKernels.hpp"
+
+extern "C" {
+#include <libavutil/cpu.h>
+}
+
+void yuv420pRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int x, int width)
+{
+    for (; x < width; ++x)
+        yuvToRgbaPixel(y[x], u[x / 2], v[x / 2], dst + x * 4);
+}
+
+void nv12RowScalar(const uint8_t* y, const uint8_t* uv, uint8_t* dst, int x, int width)
+{
+    for (; x < width; ++x)
+        yuvToRgbaPixel(y[x], uv[x / 2 * 2], uv[x / 2 * 2 + 1], dst + x * 4);
+}
+
+void yuv420p10RowScalar(const uint16_t* y, const uint16_t* u, const uint16_t* v, uint8_t* dst, int x, int width)
+{
+    for (; x < width; ++x)
+        yuvToRgbaPixel((y[x] + 2) >> 2, (u[x / 2] + 2) >> 2, (v[x / 2] + 2) >> 2, dst + x * 4);
+}
+
+namespace
+{
+    // Indexed by RgbaConverter::Filter
+    const int SwsFlags[] = { SWS_BILINEAR, SWS_FAST_BILINEAR, SWS_POINT };
+
+    bool isKernelFormat(AVPixelFormat format)
+    {
+        return format == PIX_FMT_YUV420P || format == PIX_FMT_NV12 || format == PIX_FMT_YUV420P10LE;
+    }
+
+    bool cpuHas(RgbaConverter::Path path)
+    {
+#ifdef RGBA_KERNELS_X86
+        const int flags = av_get_cpu_flags();
+        if(path == RgbaConverter::Sse2Path)
+            return (flags & AV_CPU_FLAG_SSE2) != 0;
+        if(path == RgbaConverter::Avx2Path)
+            return (flags & AV_CPU_FLAG_AVX2) != 0;
+#endif
+        return path == RgbaConverter::SwscalePath;
+    }
+}
+
+bool RgbaConverter::isSupported(Path path, AVPixelFormat format)
+{
+    if(path == SwscalePath)
+        return true;
+
+    return isKernelFormat(format) && cpuHas(path);
+}
+
+RgbaConverter::RgbaConverter(int width, int height, AVPixelFormat format, Path path)
+: m_width(width)
+, m_height(height)
+, m_format(format)
+, m_requestedPath(path)
+, m_path(SwscalePath)
+, m_dstWidth(width)
+, m_dstHeight(height)
+, m_filter(BilinearFilter)
+, m_swsCtx(NULL)
+, m_fullRange(false)
+{
+    m_path = choosePath(path, format);
+
+    // Also kept for full range frames the kernels don't handle
+    m_swsCtx = sws_getContext(width, height, format, width, height, PIX_FMT_RGBA, SWS_BILINEAR, NULL, NULL, NULL);
+}
+
+RgbaConverter::Path RgbaConverter::choosePath(Path path, AVPixelFormat format)
+{
+    if(path == AutoPath)
+    {
+        if(isSupported(Avx2Path, format))
+            return Avx2Path;
+        if(isSupported(Sse2Path, format))
+            return Sse2Path;
+    }
+    else if(isSupported(path, format))
+    {
+        return path;
+    }
+
+    return SwscalePath;
+}
+
+void RgbaConverter::setSource(int width, int height, AVPixelFormat format)
+{
+    if(width == m_width && height == m_height && format == m_format)
+        return;
+
+    m_width = width;
+    m_height = height;
+    m_format = format;
+    m_path = choosePath(m_requestedPath, format);
+    m_swsCtx = sws_getCachedContext(m_swsCtx, width, height, format, m_dstWidth, m_dstHeight, PIX_FMT_RGBA, SwsFlags[m_filter], NULL, NULL, NULL);
+    applyRange();
+}
+
+void RgbaConverter::setOutput(int width, int height, Filter filter)
+{
+    if(width == m_dstWidth && height == m_dstHeight && filter == m_filter)
+        return;
+
+    m_dstWidth = width;
+    m_dstHeight = height;
+    m_filter = filter;
+    m_swsCtx = sws_getCachedContext(m_swsCtx, m_width, m_height, m_format, width, height, PIX_FMT_RGBA, SwsFlags[filter], NULL, NULL, NULL);
+
+    // A rebuilt context is back to limited range
+    applyRange();
+}
+
+void RgbaConverter::applyRange()
+{
+    if(!m_swsCtx)
+        return;
+
+    const int* coefficients = sws_getCoefficients(SWS_CS_DEFAULT);
+    sws_setColorspaceDetails(m_swsCtx, coefficients, m_fullRange ? 1 : 0, coefficients, 1, 0, 1 << 16, 1 << 16);
+}
+
+const char* RgbaConverter::filterName(Filter filter)
+{
+    switch (filter)
+    {
+        case FastBilinearFilter:
+            return "fast bilinear";
+        case PointFilter:
+            return "point";
+        default:
+            return "bilinear";
+    }
+}
+
+RgbaConverter::~RgbaConverter()
+{
+    sws_freeContext(m_swsCtx);
+}
+
+const char* RgbaConverter::pathName() const
+{
+    if(m_dstWidth != m_width || m_dstHeight != m_height)
+        return "swscale";
+
+    switch (m_path)
+    {
+        case Sse2Path:
+            return "sse2";
+        case Avx2Path:
+            return "avx2";
+        default:
+            return "swscale";
+    }
+}
+
+void RgbaConverter::convert(const AVFrame* frame, uint8_t* dst, int dstStride)
+{
+    const bool fullRange = av_frame_get_color_range(frame) == AVCOL_RANGE_JPEG;
+    if(fullRange != m_fullRange)
+    {
+        m_fullRange = fullRange;
+        applyRange();
+    }
+
+    if(m_path != SwscalePath && fullRange)
+    {
+        // The kernels only cover limited range
+        uint8_t* dstData[4] = { dst, NULL, NULL, NULL };
+        int dstLinesize[4] = { dstStride, 0, 0, 0 };
+        sws_scale(m_swsCtx, (uint8_t const * const *)frame->data, frame->linesize, 0, m_height, dstData, dstLinesize);
+        return;
+    }
+
+    convert((const uint8_t* const*)frame->data, frame->linesize, dst, dstStride);
+}
+
+void RgbaConverter::convert(const uint8_t* const data[4], const int linesize[4], uint8_t* dst, int dstStride)
+{
+#ifdef RGBA_KERNELS_X86
+    // The kernels don't scale
+    const bool kernel = m_path != SwscalePath && m_dstWidth == m_width && m_dstHeight == m_height;
+    const bool avx2 = m_path == Avx2Path;
+
+    if(kernel && m_format == PIX_FMT_YUV420P)
+    {
+        for (int j = 0; j < m_height; ++j)
+        {
+            const uint8_t* y = data[0] + j * linesize[0];
+            const uint8_t* u = data[1] + (j / 2) * linesize[1];
+            const uint8_t* v = data[2] + (j / 2) * linesize[2];
+            if(avx2)
+                yuv420pRowAvx2(y, u, v, dst + j * dstStride, m_width);
+            else
+                yuv420pRowSse2(y, u, v, dst + j * dstStride, m_width);
+        }
+        return;
+    }
+
+    if(kernel && m_format == PIX_FMT_NV12)
+    {
+        for (int j = 0; j < m_height; ++j)
+        {
+            const uint8_t* y = data[0] + j * linesize[0];
+            const uint8_t* uv = data[1] + (j / 2) * linesize[1];
+            if(avx2)
+                nv12RowAvx2(y, uv, dst + j * dstStride, m_width);
+            else
+                nv12RowSse2(y, uv, dst + j * dstStride, m_width);
+        }
+        return;
+    }
+
+    if(kernel && m_format == PIX_FMT_YUV420P10LE)
+    {
+        for (int j = 0; j < m_height; ++j)
+        {
+            const uint16_t* y = (const uint16_t*)(data[0] + j * linesize[0]);
+            const uint16_t* u = (const uint16_t*)(data[1] + (j / 2) * linesize[1]);
+            const uint16_t* v = (const uint16_t*)(data[2] + (j / 2) * linesize[2]);
+            if(avx2)
+                yuv420p10RowAvx2(y, u, v, dst + j * dstStride, m_width);
+            else
+                yuv420p10RowSse2(y, u, v, dst + j * dstStride, m_width);
+        }
+        return;
+    }
+#endif
+
+    uint8_t* dstData[4] = { dst, NULL, NULL, NULL };
+    int dstLinesize[4] = { dstStride, 0, 0, 0 };
+    sws_scale(m_swsCtx, (uint8_t const * const *)data, linesize, 0, m_height, dstData, dstLinesize);
+}
+
+bool parseConvertPath(const std::string& name, RgbaConverter::Path& path)
+{
+    if(name == "auto")
+        path = RgbaConverter::AutoPath;
+    else if(name == "swscale")
+        path = RgbaConverter::SwscalePath;
+    else if(name == "sse2")
+        path = RgbaConverter::Sse2Path;
+    else if(name == "avx2")
+        path = RgbaConverter::Avx2Path;
+    else
+        return false;
+
+    return true;
+}
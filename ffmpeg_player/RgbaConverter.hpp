@@ -0,0 +1,122 @@
+#ifndef RGBA_CONVERTER_HPP
+#define RGBA_CONVERTER_HPP
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include <string>
+
+//
+// Converts decoded frames to packed RGBA in a single pass.
+//
+// yuv420p, nv12 and yuv420p10 (limited range, BT.601 like swscale's
+// default) go through hand-written SSE2 or AVX2 kernels, picked at runtime
+// from the CPU features FFmpeg detects. Everything else, and any CPU
+// without SSE2, goes through swscale.
+//
+// The kernels trade chroma quality for speed: each pixel takes the chroma
+// of its 2x2 block as is, like swscale's SWS_POINT, where swscale's
+// bilinear path interpolates it. Sharp chroma edges come out blockier.
+//
+// The output can be smaller than the source; then swscale does the scaling
+// with the filter chosen by setOutput().
+//
+class RgbaConverter
+{
+public:
+    enum Path
+    {
+        AutoPath,
+        SwscalePath,
+        Sse2Path,
+        Avx2Path
+    };
+
+    // path forces a kernel, for benchmarking and the self-check. A kernel
+    // the CPU or the format doesn't support falls back to swscale.
+    RgbaConverter(int width, int height, AVPixelFormat format, Path path = AutoPath);
+    ~RgbaConverter();
+
+    enum Filter
+    {
+        BilinearFilter,
+        FastBilinearFilter,
+        PointFilter
+    };
+
+    // Changes the output size and scaling filter. Cheap when nothing changed.
+    void setOutput(int width, int height, Filter filter);
+
+    // For a stream whose frames change size or format midway. The output
+    // size stays; the path is chosen again for the new format.
+    void setSource(int width, int height, AVPixelFormat format);
+
+    int sourceWidth() const
+    {
+        return m_width;
+    }
+
+    int sourceHeight() const
+    {
+        return m_height;
+    }
+
+    AVPixelFormat sourceFormat() const
+    {
+        return m_format;
+    }
+
+    int outputWidth() const
+    {
+        return m_dstWidth;
+    }
+
+    int outputHeight() const
+    {
+        return m_dstHeight;
+    }
+
+    // Writes outputWidth() x outputHeight() pixels. Full range frames go
+    // through swscale, set up for their range.
+    void convert(const AVFrame* frame, uint8_t* dst, int dstStride);
+    void convert(const uint8_t* const data[4], const int linesize[4], uint8_t* dst, int dstStride);
+
+    Path path() const
+    {
+        return m_path;
+    }
+
+    const char* pathName() const;
+
+    static bool isSupported(Path path, AVPixelFormat format);
+
+    static const char* filterName(Filter filter);
+
+private:
+    RgbaConverter(const RgbaConverter&);
+    RgbaConverter& operator=(const RgbaConverter&);
+
+    // Tells swscale whether the source is full range
+    void applyRange();
+
+    static Path choosePath(Path path, AVPixelFormat format);
+
+    int m_width;
+    int m_height;
+    AVPixelFormat m_format;
+    Path m_requestedPath;
+    Path m_path;
+    int m_dstWidth;
+    int m_dstHeight;
+    Filter m_filter;
+    SwsContext* m_swsCtx;
+    // Of the last frame converted
+    bool m_fullRange;
+};
+
+// Parses "auto", "swscale", "sse2" or "avx2"
+bool parseConvertPath(const std::string& name, RgbaConverter::Path& path);
+
+#endif
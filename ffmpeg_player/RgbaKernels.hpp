@@ -0,0 +1,58 @@
+#ifndef RGBA_KERNELS_HPP
+#define RGBA_KERNELS_HPP
+
+#include <stdint.h>
+
+//
+// Row kernels behind RgbaConverter. Each converts one row of width pixels;
+// the chroma rows are already the ones for that luma row.
+//
+// All of them use the same BT.601 limited range fixed point math with 6
+// fractional bits, and the scalar versions are also used for the columns
+// left over at the end of a row, so every path gives identical pixels.
+//
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RGBA_KERNELS_X86 1
+#endif
+
+// Coefficients scaled by 64
+const int RgbaYScale = 74;      // 1.164
+const int RgbaRFromV = 102;     // 1.596
+const int RgbaGFromU = 25;      // 0.391
+const int RgbaGFromV = 52;      // 0.813
+const int RgbaBFromU = 129;     // 2.018
+
+inline uint8_t rgbaClamp(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
+
+inline void yuvToRgbaPixel(int y, int u, int v, uint8_t* dst)
+{
+    const int yy = (y - 16) * RgbaYScale + 32;
+    u -= 128;
+    v -= 128;
+    dst[0] = rgbaClamp((yy + RgbaRFromV * v) >> 6);
+    dst[1] = rgbaClamp((yy - RgbaGFromU * u - RgbaGFromV * v) >> 6);
+    dst[2] = rgbaClamp((yy + RgbaBFromU * u) >> 6);
+    dst[3] = 255;
+}
+
+// Scalar kernels starting at column x
+void yuv420pRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int x, int width);
+void nv12RowScalar(const uint8_t* y, const uint8_t* uv, uint8_t* dst, int x, int width);
+void yuv420p10RowScalar(const uint16_t* y, const uint16_t* u, const uint16_t* v, uint8_t* dst, int x, int width);
+
+#ifdef RGBA_KERNELS_X86
+void yuv420pRowSse2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int width);
+void nv12RowSse2(const uint8_t* y, const uint8_t* uv, uint8_t* dst, int width);
+void yuv420p10RowSse2(const uint16_t* y, const uint16_t* u, const uint16_t* v, uint8_t* dst, int width);
+
+// Built with -mavx2, only call when the CPU has it
+void yuv420pRowAvx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int width);
+void nv12RowAvx2(const uint8_t* y, const uint8_t* uv, uint8_t* dst, int width);
+void yuv420p10RowAvx2(const uint16_t* y, const uint16_t* u, const uint16_t* v, uint8_t* dst, int width);
+#endif
+
+#endif
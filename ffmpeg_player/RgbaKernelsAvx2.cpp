@@ -0,0 +1,110 @@
+#include "RgbaKernels.hpp"
+
+#ifdef RGBA_KERNELS_X86
+
+// This file is compiled with -mavx2 and only entered after RgbaConverter
+// has checked the CPU, so nothing in here may be called unconditionally.
+#include <immintrin.h>
+
+namespace
+{
+    // Sixteen pixels in order: y, u and v hold 16-bit samples, chroma
+    // already repeated per pixel pair and centred on zero.
+    inline void storeRgba16(__m256i y, __m256i u, __m256i v, uint8_t* dst)
+    {
+        const __m256i yy = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(16)), _mm256_set1_epi16(RgbaYScale)), _mm256_set1_epi16(32));
+
+        __m256i r = _mm256_adds_epi16(yy, _mm256_mullo_epi16(v, _mm256_set1_epi16(RgbaRFromV)));
+        __m256i g = _mm256_subs_epi16(_mm256_subs_epi16(yy, _mm256_mullo_epi16(u, _mm256_set1_epi16(RgbaGFromU))), _mm256_mullo_epi16(v, _mm256_set1_epi16(RgbaGFromV)));
+        __m256i b = _mm256_adds_epi16(yy, _mm256_mullo_epi16(u, _mm256_set1_epi16(RgbaBFromU)));
+
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i max = _mm256_set1_epi16(255);
+        r = _mm256_min_epi16(_mm256_max_epi16(_mm256_srai_epi16(r, 6), zero), max);
+        g = _mm256_min_epi16(_mm256_max_epi16(_mm256_srai_epi16(g, 6), zero), max);
+        b = _mm256_min_epi16(_mm256_max_epi16(_mm256_srai_epi16(b, 6), zero), max);
+
+        const __m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+        const __m256i ba = _mm256_or_si256(b, _mm256_set1_epi16((short)0xFF00));
+
+        // The unpacks work within each 128-bit lane: lo holds pixels 0-3
+        // and 8-11, hi pixels 4-7 and 12-15
+        const __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+        const __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    // Thirty-two pixels from two runs of sixteen luma samples and sixteen
+    // centred chroma samples in order
+    inline void storeRgba32(__m256i yLo, __m256i yHi, __m256i u, __m256i v, uint8_t* dst)
+    {
+        // Put chroma 0-3/8-11 in the low lane and 4-7/12-15 in the high one
+        // so the in-lane unpacks below come out in pixel order
+        u = _mm256_permute4x64_epi64(u, 0xD8);
+        v = _mm256_permute4x64_epi64(v, 0xD8);
+
+        storeRgba16(yLo, _mm256_unpacklo_epi16(u, u), _mm256_unpacklo_epi16(v, v), dst);
+        storeRgba16(yHi, _mm256_unpackhi_epi16(u, u), _mm256_unpackhi_epi16(v, v), dst + 64);
+    }
+}
+
+void yuv420pRowAvx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int width)
+{
+    const __m256i bias = _mm256_set1_epi16(128);
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        const __m256i yLo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x)));
+        const __m256i yHi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x + 16)));
+        const __m256i u16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(u + x / 2))), bias);
+        const __m256i v16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(v + x / 2))), bias);
+
+        storeRgba32(yLo, yHi, u16, v16, dst + x * 4);
+    }
+
+    // The SSE2 kernel takes the next sixteen, the scalar one the rest
+    yuv420pRowSse2(y + x, u + x / 2, v + x / 2, dst + x * 4, width - x);
+}
+
+void nv12RowAvx2(const uint8_t* y, const uint8_t* uv, uint8_t* dst, int width)
+{
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i lowBytes = _mm256_set1_epi16(0xFF);
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        const __m256i yLo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x)));
+        const __m256i yHi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x + 16)));
+        const __m256i uv8 = _mm256_loadu_si256((const __m256i*)(uv + x));
+        const __m256i u16 = _mm256_sub_epi16(_mm256_and_si256(uv8, lowBytes), bias);
+        const __m256i v16 = _mm256_sub_epi16(_mm256_srli_epi16(uv8, 8), bias);
+
+        storeRgba32(yLo, yHi, u16, v16, dst + x * 4);
+    }
+
+    nv12RowSse2(y + x, uv + x, dst + x * 4, width - x);
+}
+
+void yuv420p10RowAvx2(const uint16_t* y, const uint16_t* u, const uint16_t* v, uint8_t* dst, int width)
+{
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i half = _mm256_set1_epi16(2);
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        const __m256i yLo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(y + x)), half), 2);
+        const __m256i yHi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(y + x + 16)), half), 2);
+        const __m256i u16 = _mm256_sub_epi16(_mm256_srli_epi16(_mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(u + x / 2)), half), 2), bias);
+        const __m256i v16 = _mm256_sub_epi16(_mm256_srli_epi16(_mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(v + x / 2)), half), 2), bias);
+
+        storeRgba32(yLo, yHi, u16, v16, dst + x * 4);
+    }
+
+    yuv420p10RowSse2(y + x, u + x / 2, v + x / 2, dst + x * 4, width - x);
+}
+
+#endif
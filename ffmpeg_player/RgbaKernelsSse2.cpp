@@ -0,0 +1,100 @@
+#include "RgbaKernels.hpp"
+
+#ifdef RGBA_KERNELS_X86
+
+#include <emmintrin.h>
+
+namespace
+{
+    // y, u and v hold eight 16-bit samples, chroma already repeated for
+    // each pixel pair and centred on zero. Writes eight RGBA pixels.
+    inline void storeRgba8(__m128i y, __m128i u, __m128i v, uint8_t* dst)
+    {
+        const __m128i yy = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)), _mm_set1_epi16(RgbaYScale)), _mm_set1_epi16(32));
+
+        // Only blue can leave the 16-bit range, and only when the result
+        // clamps to 255 anyway, so saturating adds match the scalar code
+        __m128i r = _mm_adds_epi16(yy, _mm_mullo_epi16(v, _mm_set1_epi16(RgbaRFromV)));
+        __m128i g = _mm_subs_epi16(_mm_subs_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(RgbaGFromU))), _mm_mullo_epi16(v, _mm_set1_epi16(RgbaGFromV)));
+        __m128i b = _mm_adds_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(RgbaBFromU)));
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i max = _mm_set1_epi16(255);
+        r = _mm_min_epi16(_mm_max_epi16(_mm_srai_epi16(r, 6), zero), max);
+        g = _mm_min_epi16(_mm_max_epi16(_mm_srai_epi16(g, 6), zero), max);
+        b = _mm_min_epi16(_mm_max_epi16(_mm_srai_epi16(b, 6), zero), max);
+
+        // Bytes r g | b a in each 16-bit pair, then interleave the pairs
+        const __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        const __m128i ba = _mm_or_si128(b, _mm_set1_epi16((short)0xFF00));
+        _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+
+    // Converts sixteen pixels from 16-bit luma and eight centred chroma pairs
+    inline void storeRgba16(__m128i yLo, __m128i yHi, __m128i u, __m128i v, uint8_t* dst)
+    {
+        storeRgba8(yLo, _mm_unpacklo_epi16(u, u), _mm_unpacklo_epi16(v, v), dst);
+        storeRgba8(yHi, _mm_unpackhi_epi16(u, u), _mm_unpackhi_epi16(v, v), dst + 32);
+    }
+}
+
+void yuv420pRowSse2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        const __m128i y8 = _mm_loadu_si128((const __m128i*)(y + x));
+        const __m128i u16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(u + x / 2)), zero), bias);
+        const __m128i v16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(v + x / 2)), zero), bias);
+
+        storeRgba16(_mm_unpacklo_epi8(y8, zero), _mm_unpackhi_epi8(y8, zero), u16, v16, dst + x * 4);
+    }
+
+    yuv420pRowScalar(y, u, v, dst, x, width);
+}
+
+void nv12RowSse2(const uint8_t* y, const uint8_t* uv, uint8_t* dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i lowBytes = _mm_set1_epi16(0xFF);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        const __m128i y8 = _mm_loadu_si128((const __m128i*)(y + x));
+        const __m128i uv8 = _mm_loadu_si128((const __m128i*)(uv + x));
+        const __m128i u16 = _mm_sub_epi16(_mm_and_si128(uv8, lowBytes), bias);
+        const __m128i v16 = _mm_sub_epi16(_mm_srli_epi16(uv8, 8), bias);
+
+        storeRgba16(_mm_unpacklo_epi8(y8, zero), _mm_unpackhi_epi8(y8, zero), u16, v16, dst + x * 4);
+    }
+
+    nv12RowScalar(y, uv, dst, x, width);
+}
+
+void yuv420p10RowSse2(const uint16_t* y, const uint16_t* u, const uint16_t* v, uint8_t* dst, int width)
+{
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i half = _mm_set1_epi16(2);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        // Round off the two extra bits of precision on the way in
+        const __m128i yLo = _mm_srli_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*)(y + x)), half), 2);
+        const __m128i yHi = _mm_srli_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*)(y + x + 8)), half), 2);
+        const __m128i u16 = _mm_sub_epi16(_mm_srli_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*)(u + x / 2)), half), 2), bias);
+        const __m128i v16 = _mm_sub_epi16(_mm_srli_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*)(v + x / 2)), half), 2), bias);
+
+        storeRgba16(yLo, yHi, u16, v16, dst + x * 4);
+    }
+
+    yuv420p10RowScalar(y, u, v, dst, x, width);
+}
+
+#endif
@@ -0,0 +1,262 @@
+#include "StageBenchmark.hpp"
+
+#include "MediaFile.hpp"
+#include "PacketPool.hpp"
+#include "RgbaConverter.hpp"
+#include "AudioDecoder.hpp"
+#include "StageStats.hpp"
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#include <thread>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+
+// Whole-file stages run this many times, so one slow pass (a cold cache, a
+// frequency change) shows up in the percentiles rather than the totals
+const int BenchPasses = 3;
+// Seek targets spread over the file, visited out of order
+const int BenchSeeks = 20;
+const int BenchSeekStride = 7;
+
+namespace
+{
+    std::string jsonString(const std::string& s)
+    {
+        std::string json = "\"";
+        for (char c : s)
+        {
+            if(c == '"' || c == '\\')
+            {
+                json += '\\';
+                json += c;
+            }
+            else if((unsigned char)c < 0x20)
+            {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+                json += escaped;
+            }
+            else
+            {
+                json += c;
+            }
+        }
+        return json + "\"";
+    }
+
+    // mediaSec, when given, is the media time the stage got through
+    void printStage(std::ostream& out, const std::string& path, const StageStats& stats, double mediaSec)
+    {
+        const sf::Uint64 calls = stats.calls();
+        out << "{\"file\":" << jsonString(path)
+            << ",\"stage\":" << jsonString(stats.name())
+            << ",\"calls\":" << calls
+            << ",\"wall_us\":" << stats.wallUs()
+            << ",\"cpu_us\":" << stats.cpuUs()
+            << ",\"mean_us\":" << (calls ? stats.wallUs() / (double)calls : 0)
+            << ",\"p50_us\":" << stats.percentileUs(0.5)
+            << ",\"p95_us\":" << stats.percentileUs(0.95)
+            << ",\"p99_us\":" << stats.percentileUs(0.99)
+            << ",\"max_us\":" << stats.maxUs();
+        if(mediaSec > 0 && stats.wallUs() > 0)
+            out << ",\"realtime\":" << mediaSec * 1000000 / stats.wallUs();
+        out << "}" << std::endl;
+    }
+
+    int64_t ptsMsOf(const AVStream* stream, int64_t timestamp)
+    {
+        const int64_t startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+        return 1000 * (timestamp - startTime) * av_q2d(stream->time_base);
+    }
+
+    bool benchmarkFile(const std::string& path, const PlayerOptions& options, std::ostream& out)
+    {
+        MediaFile media;
+        if(!media.open(path, options))
+            return false;
+
+        AVFormatContext* formatCtx = media.formatContext();
+        AVStream* videoStream = media.videoStream();
+        AVStream* audioStream = media.audioStream();
+        AVCodecContext* codecCtx = videoStream->codec;
+        const int videoIndex = media.videoStreamIndex();
+        const int audioIndex = media.audioStreamIndex();
+        const double mediaSec = formatCtx->duration != AV_NOPTS_VALUE ? formatCtx->duration / (double)AV_TIME_BASE : 0;
+
+        RgbaConverter converter(codecCtx->width, codecCtx->height, codecCtx->pix_fmt, options.convertPath);
+        converter.setOutput(codecCtx->width, codecCtx->height, RgbaConverter::BilinearFilter);
+        uint8_t* rgba = (uint8_t*)av_malloc(codecCtx->width * codecCtx->height * 4);
+
+        out << "{\"file\":" << jsonString(path)
+            << ",\"width\":" << codecCtx->width
+            << ",\"height\":" << codecCtx->height
+            << ",\"video_codec\":" << jsonString(avcodec_get_name(codecCtx->codec_id))
+            << ",\"audio_codec\":" << jsonString(audioStream ? avcodec_get_name(audioStream->codec->codec_id) : "")
+            << ",\"conversion\":" << jsonString(converter.pathName())
+            << ",\"media_s\":" << mediaSec << "}" << std::endl;
+
+        // Demux: the first pass keeps the packets for the decode stages
+        PacketPool packetPool;
+        std::vector<PacketHandle> videoPackets;
+        std::vector<PacketHandle> audioPackets;
+        StageStats demuxStats("demux");
+        for (int pass = 0; pass < BenchPasses; ++pass)
+        {
+            if(pass > 0 && avformat_seek_file(formatCtx, videoIndex, INT64_MIN, 0, 0, AVSEEK_FLAG_BACKWARD) < 0)
+                break;
+
+            while (true)
+            {
+                PacketHandle packet = packetPool.acquire();
+                if(!packet)
+                    break;
+
+                int ret = 0;
+                {
+                    StageTimer timer(demuxStats);
+                    ret = av_read_frame(formatCtx, packet.get());
+                }
+                if(ret < 0)
+                    break;
+
+                if(pass > 0 || !packetPool.makeRefcounted(packet.get()))
+                    continue;
+
+                if(packet->stream_index == videoIndex)
+                    videoPackets.push_back(std::move(packet));
+                else if(packet->stream_index == audioIndex)
+                    audioPackets.push_back(std::move(packet));
+            }
+        }
+        printStage(out, path, demuxStats, mediaSec * BenchPasses);
+
+        // Video decode, and conversion of every frame at the source size.
+        // Decoders consume their input, so each gets a shallow copy.
+        AVFrame* frame = av_frame_alloc();
+        StageStats decodeStats("video decode");
+        StageStats convertStats("colour conversion");
+        auto decodeVideo = [&](AVPacket* packet)
+        {
+            int frameFinished = 0;
+            int ret = 0;
+            {
+                StageTimer timer(decodeStats);
+                ret = avcodec_decode_video2(codecCtx, frame, &frameFinished, packet);
+            }
+            if(ret < 0 || !frameFinished)
+                return false;
+
+            StageTimer timer(convertStats);
+            converter.convert(frame, rgba, converter.outputWidth() * 4);
+            return true;
+        };
+
+        for (int pass = 0; pass < BenchPasses; ++pass)
+        {
+            avcodec_flush_buffers(codecCtx);
+            for (const auto& handle : videoPackets)
+            {
+                AVPacket packet = *handle.get();
+                decodeVideo(&packet);
+            }
+
+            AVPacket flushPacket;
+            av_init_packet(&flushPacket);
+            flushPacket.data = NULL;
+            flushPacket.size = 0;
+            while (decodeVideo(&flushPacket)) {}
+        }
+        printStage(out, path, decodeStats, mediaSec * BenchPasses);
+        printStage(out, path, convertStats, mediaSec * BenchPasses);
+
+        if(audioStream)
+        {
+            AudioDecoder audioDecoder(audioStream);
+            for (int pass = 0; pass < BenchPasses; ++pass)
+            {
+                audioDecoder.flush();
+                for (const auto& handle : audioPackets)
+                {
+                    AVPacket packet = *handle.get();
+                    audioDecoder.decode(&packet, [](const sf::Int16*, size_t) { return true; });
+                }
+            }
+            printStage(out, path, audioDecoder.decodeStats(), mediaSec * BenchPasses);
+            printStage(out, path, audioDecoder.resampleStats(), mediaSec * BenchPasses);
+        }
+
+        // Seek: from the request to the exact target converted, through the
+        // container's index as the player does without a keyframe index
+        StageStats seekStats("seek");
+        const AVRational msTimeBase = {1, 1000};
+        const int64_t startTime = videoStream->start_time != AV_NOPTS_VALUE ? videoStream->start_time : 0;
+        for (int i = 0; mediaSec > 0 && i < BenchSeeks; ++i)
+        {
+            const int64_t targetMs = (int64_t)(mediaSec * 1000) * ((i * BenchSeekStride) % BenchSeeks) / BenchSeeks;
+            const int64_t target = startTime + av_rescale_q(targetMs, msTimeBase, videoStream->time_base);
+
+            StageTimer timer(seekStats);
+            if(avformat_seek_file(formatCtx, videoIndex, 0, target, target, AVSEEK_FLAG_BACKWARD) < 0)
+                continue;
+            avcodec_flush_buffers(codecCtx);
+
+            AVPacket packet;
+            av_init_packet(&packet);
+            bool reached = false;
+            while (!reached && av_read_frame(formatCtx, &packet) >= 0)
+            {
+                if(packet.stream_index == videoIndex)
+                {
+                    AVPacket input = packet;
+                    int frameFinished = 0;
+                    if(avcodec_decode_video2(codecCtx, frame, &frameFinished, &input) >= 0 && frameFinished
+                       && ptsMsOf(videoStream, av_frame_get_best_effort_timestamp(frame)) >= targetMs)
+                    {
+                        converter.convert(frame, rgba, converter.outputWidth() * 4);
+                        reached = true;
+                    }
+                }
+                av_free_packet(&packet);
+            }
+        }
+        printStage(out, path, seekStats, 0);
+
+        av_frame_free(&frame);
+        av_free(rgba);
+        return true;
+    }
+}
+
+int runStageBenchmarks(const PlayerOptions& options, std::ostream& out)
+{
+    if(options.inputs.empty())
+    {
+        std::cerr << "--bench-stages needs at least one input file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"bench\":\"stages\",\"passes\":" << BenchPasses
+        << ",\"seeks\":" << BenchSeeks
+        << ",\"cpus\":" << std::thread::hardware_concurrency()
+        << ",\"libavcodec\":" << jsonString(LIBAVCODEC_IDENT) << "}" << std::endl;
+
+    int failures = 0;
+    for (const auto& path : options.inputs)
+    {
+        if(!benchmarkFile(path, options, out))
+        {
+            std::cerr << path << ": can't open" << std::endl;
+            ++failures;
+        }
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
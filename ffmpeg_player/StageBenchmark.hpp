@@ -0,0 +1,18 @@
+#ifndef STAGE_BENCHMARK_HPP
+#define STAGE_BENCHMARK_HPP
+
+#include "Options.hpp"
+
+#include <ostream>
+
+// Times each pipeline stage of every input on its own, single-threaded and
+// without queues in between: demux, video decode, colour conversion, audio
+// decode and resampling, and seeking to an exact frame. Every stage but the
+// seek runs over the whole file several times.
+//
+// Prints one JSON object per line: a header, then for each input a line
+// describing it and one per stage with its call count, total CPU and wall
+// time and latency percentiles, for comparing runs between commits.
+int runStageBenchmarks(const PlayerOptions& options, std::ostream& out);
+
+#endif
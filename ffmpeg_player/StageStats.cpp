@@ -0,0 +1,119 @@
+#include "StageStats.hpp"
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <time.h>
+#endif
+
+#include <iomanip>
+#include <algorithm>
+
+sf::Uint64 threadCpuTimeUs()
+{
+#if defined(__APPLE__)
+    mach_port_t thread = mach_thread_self();
+    thread_basic_info_data_t info;
+    mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+    kern_return_t kr = thread_info(thread, THREAD_BASIC_INFO, (thread_info_t)&info, &count);
+    mach_port_deallocate(mach_task_self(), thread);
+
+    if(kr != KERN_SUCCESS)
+        return 0;
+
+    return (info.user_time.seconds + info.system_time.seconds) * 1000000ull
+        + info.user_time.microseconds + info.system_time.microseconds;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+#else
+    return 0;
+#endif
+}
+
+StageStats::StageStats(const char* name)
+: m_name(name)
+, m_calls(0)
+, m_cpuUs(0)
+, m_wallUs(0)
+, m_maxUs(0)
+{
+    for (auto& b : m_buckets)
+        b.store(0, std::memory_order_relaxed);
+}
+
+int StageStats::bucketFor(sf::Uint64 us)
+{
+    // 0-3 us get a bucket each, then four per octave: the top bit picks
+    // the octave and the two bits below it the quarter.
+    if(us < 4)
+        return (int)us;
+
+    int msb = 63;
+    while (!(us >> msb))
+        --msb;
+
+    int bucket = (msb - 1) * 4 + (int)((us >> (msb - 2)) & 3);
+    return bucket < BucketCount ? bucket : BucketCount - 1;
+}
+
+sf::Uint64 StageStats::bucketLimit(int bucket)
+{
+    // Smallest value of the next bucket
+    ++bucket;
+    if(bucket < 4)
+        return bucket;
+
+    int msb = bucket / 4 + 1;
+    return (sf::Uint64)(4 + bucket % 4) << (msb - 2);
+}
+
+void StageStats::record(sf::Uint64 cpuUs, sf::Uint64 wallUs)
+{
+    // Only the stage's own thread writes, so load/store is enough for max
+    m_calls.fetch_add(1, std::memory_order_relaxed);
+    m_cpuUs.fetch_add(cpuUs, std::memory_order_relaxed);
+    m_wallUs.fetch_add(wallUs, std::memory_order_relaxed);
+    if(wallUs > m_maxUs.load(std::memory_order_relaxed))
+        m_maxUs.store(wallUs, std::memory_order_relaxed);
+    m_buckets[bucketFor(wallUs)].fetch_add(1, std::memory_order_relaxed);
+}
+
+sf::Uint64 StageStats::percentileUs(double fraction) const
+{
+    sf::Uint64 total = 0;
+    for (auto& b : m_buckets)
+        total += b.load(std::memory_order_relaxed);
+
+    if(total == 0)
+        return 0;
+
+    const sf::Uint64 rank = (sf::Uint64)(fraction * (total - 1)) + 1;
+    sf::Uint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i)
+    {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if(seen >= rank)
+            return std::min(bucketLimit(i), maxUs());
+    }
+
+    return maxUs();
+}
+
+void StageStats::print(std::ostream& out) const
+{
+    const sf::Uint64 n = calls();
+    const double cpuMs = cpuUs() / 1000.0;
+    const double wallMs = wallUs() / 1000.0;
+
+    out << std::fixed << std::setprecision(2)
+        << "  " << std::left << std::setw(16) << m_name << std::right
+        << std::setw(10) << n << " calls"
+        << std::setw(12) << cpuMs << " ms cpu"
+        << std::setw(12) << wallMs << " ms wall"
+        << std::setw(10) << (n ? cpuUs() / (double)n : 0.0) << " us cpu/call"
+        << "  p50 " << percentileUs(0.5)
+        << " p99 " << percentileUs(0.99)
+        << " max " << maxUs() << " us" << std::endl;
+}
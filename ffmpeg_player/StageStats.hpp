@@ -0,0 +1,113 @@
+#ifndef STAGE_STATS_HPP
+#define STAGE_STATS_HPP
+
+#include <SFML/Config.hpp>
+
+#include "Trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+// CPU time consumed so far by the calling thread, in microseconds
+sf::Uint64 threadCpuTimeUs();
+
+//
+// Accumulated cost of one pipeline stage (demux, decode, scale, ...) and a
+// histogram of its wall-clock latency.
+//
+// Each stage is timed from a single thread, so updates are plain relaxed
+// atomic increments with no locking; any thread may read them.
+//
+// The histogram has four buckets per power of two, so percentiles are
+// accurate to within 25%, from 1 us up to about a minute.
+//
+class StageStats
+{
+public:
+    static const int BucketCount = 104;
+
+    explicit StageStats(const char* name);
+
+    // Called by StageTimer
+    void record(sf::Uint64 cpuUs, sf::Uint64 wallUs);
+
+    const char* name() const
+    {
+        return m_name;
+    }
+
+    sf::Uint64 calls() const
+    {
+        return m_calls.load(std::memory_order_relaxed);
+    }
+
+    sf::Uint64 cpuUs() const
+    {
+        return m_cpuUs.load(std::memory_order_relaxed);
+    }
+
+    sf::Uint64 wallUs() const
+    {
+        return m_wallUs.load(std::memory_order_relaxed);
+    }
+
+    sf::Uint64 maxUs() const
+    {
+        return m_maxUs.load(std::memory_order_relaxed);
+    }
+
+    // Upper bound of the bucket holding the given fraction (0-1) of calls
+    sf::Uint64 percentileUs(double fraction) const;
+
+    void print(std::ostream& out) const;
+
+private:
+    StageStats(const StageStats&);
+    StageStats& operator=(const StageStats&);
+
+    static int bucketFor(sf::Uint64 us);
+    static sf::Uint64 bucketLimit(int bucket);
+
+    const char* m_name;
+    std::atomic<sf::Uint64> m_calls;
+    std::atomic<sf::Uint64> m_cpuUs;
+    std::atomic<sf::Uint64> m_wallUs;
+    std::atomic<sf::Uint64> m_maxUs;
+    std::atomic<sf::Uint32> m_buckets[BucketCount];
+};
+
+//
+// Charges the CPU and wall time of its scope to a StageStats, and records it
+// as a trace event when tracing is on.
+//
+class StageTimer
+{
+public:
+    explicit StageTimer(StageStats& stats)
+    : m_stats(stats)
+    , m_cpuStart(threadCpuTimeUs())
+    , m_wallStart(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~StageTimer()
+    {
+        auto wallEnd = std::chrono::steady_clock::now();
+        auto wall = std::chrono::duration_cast<std::chrono::microseconds>(wallEnd - m_wallStart).count();
+        m_stats.record(threadCpuTimeUs() - m_cpuStart, wall);
+
+        if(traceEnabled())
+            traceComplete(m_stats.name(), m_wallStart, wallEnd);
+    }
+
+private:
+    StageTimer(const StageTimer&);
+    StageTimer& operator=(const StageTimer&);
+
+    StageStats& m_stats;
+    sf::Uint64 m_cpuStart;
+    std::chrono::steady_clock::time_point m_wallStart;
+};
+
+#endif
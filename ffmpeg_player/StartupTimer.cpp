@@ -0,0 +1,52 @@
+#include "StartupTimer.hpp"
+#include "Trace.hpp"
+
+StartupTimer::StartupTimer()
+: m_start(std::chrono::steady_clock::now())
+{
+    for (auto& ms : m_elapsedMs)
+        ms = -1;
+}
+
+void StartupTimer::mark(Milestone milestone)
+{
+    const sf::Int64 ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start).count();
+
+    sf::Int64 unset = -1;
+    if(m_elapsedMs[milestone].compare_exchange_strong(unset, ms) && traceEnabled())
+        traceInstant(milestoneName(milestone), "ms", ms);
+}
+
+void StartupTimer::print(std::ostream& out) const
+{
+    // Milestones that never happened, like audio in a silent file, are left
+    // out
+    out << "startup:";
+    const char* separator = " ";
+    for (int i = 0; i < MilestoneCount; ++i)
+    {
+        if(m_elapsedMs[i] < 0)
+            continue;
+
+        out << separator << milestoneName((Milestone)i) << " after " << m_elapsedMs[i] << " ms";
+        separator = ", ";
+    }
+    out << std::endl;
+}
+
+const char* StartupTimer::milestoneName(Milestone milestone)
+{
+    switch (milestone)
+    {
+        case MediaOpened:
+            return "media opened";
+        case WindowReady:
+            return "window ready";
+        case FirstVideoFrame:
+            return "first video frame";
+        case FirstAudio:
+            return "first audio";
+        default:
+            return "?";
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef STARTUP_TIMER_HPP
+#define STARTUP_TIMER_HPP
+
+#include <SFML/Config.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+//
+// Milestones of a start, in milliseconds from construction. Each can be
+// marked from any thread; only the first mark counts.
+//
+class StartupTimer
+{
+public:
+    enum Milestone
+    {
+        // Format probed and decoders opened
+        MediaOpened,
+        // Window, icon and font ready
+        WindowReady,
+        FirstVideoFrame,
+        FirstAudio,
+        MilestoneCount
+    };
+
+    StartupTimer();
+
+    void mark(Milestone milestone);
+
+    // -1 until marked
+    sf::Int64 elapsedMs(Milestone milestone) const
+    {
+        return m_elapsedMs[milestone];
+    }
+
+    void print(std::ostream& out) const;
+
+    static const char* milestoneName(Milestone milestone);
+
+private:
+    StartupTimer(const StartupTimer&);
+    StartupTimer& operator=(const StartupTimer&);
+
+    std::chrono::steady_clock::time_point m_start;
+    std::atomic<sf::Int64> m_elapsedMs[MilestoneCount];
+};
+
+#endif
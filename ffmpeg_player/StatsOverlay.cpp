@@ -0,0 +1,168 @@
+#include "StatsOverlay.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+// Often enough to follow a stutter as it happens, rarely enough that
+// laying out the text never shows in the frame time
+const sf::Time RefreshInterval = sf::milliseconds(250);
+const unsigned OverlayTextSize = 14;
+const float OverlayMargin = 8;
+
+namespace
+{
+    double perCall(sf::Uint64 us, sf::Uint64 calls)
+    {
+        return calls ? us / 1000.0 / calls : 0;
+    }
+
+    const char* masterName(SyncClock::Master master)
+    {
+        static const char* names[] = { "audio", "video", "external" };
+        return names[master];
+    }
+}
+
+StatsOverlay::StatsOverlay(const sf::Font& font)
+: m_text("", font, OverlayTextSize)
+, m_background()
+, m_visible(false)
+{
+    m_text.setColor(sf::Color::White);
+    m_text.setPosition(OverlayMargin * 2, OverlayMargin * 2);
+    m_background.setFillColor(sf::Color(0, 0, 0, 160));
+    m_background.setPosition(OverlayMargin, OverlayMargin);
+
+    Snapshot none = {};
+    m_last = none;
+}
+
+void StatsOverlay::toggle()
+{
+    m_visible = !m_visible;
+    m_last.item = NULL;
+}
+
+void StatsOverlay::update(const Sources& sources)
+{
+    if(!m_visible)
+        return;
+
+    // Just shown, or a new file whose decoder counts from zero: rates are
+    // measured from here
+    if(m_last.item != sources.item)
+    {
+        m_last = take(sources);
+        m_sinceRefresh.restart();
+        return;
+    }
+
+    if(m_sinceRefresh.getElapsedTime() < RefreshInterval)
+        return;
+
+    const double seconds = m_sinceRefresh.restart().asSeconds();
+    const Snapshot now = take(sources);
+    rebuild(sources, now, seconds);
+    m_last = now;
+}
+
+StatsOverlay::Snapshot StatsOverlay::take(const Sources& sources) const
+{
+    const VideoDecoder& decoder = sources.item->videoDecoder();
+    Snapshot s;
+    s.item = sources.item;
+    s.presented = sources.presented;
+    s.presentDrops = sources.presentDrops;
+    s.lateDrops = decoder.lateDrops();
+    s.decodeCalls = decoder.decodeStats().calls();
+    s.decodeUs = decoder.decodeStats().wallUs();
+    s.scaleCalls = decoder.scaleStats().calls();
+    s.scaleUs = decoder.scaleStats().wallUs();
+    s.underruns = sources.sound ? sources.sound->underruns() : 0;
+    return s;
+}
+
+void StatsOverlay::rebuild(const Sources& sources, const Snapshot& now, double seconds)
+{
+    PlaybackItem& item = *sources.item;
+    const VideoDecoder& decoder = item.videoDecoder();
+
+    const double presentedFps = (now.presented - m_last.presented) / seconds;
+    const double decoderDropFps = (now.lateDrops - m_last.lateDrops) / seconds;
+    const double presentDropFps = (now.presentDrops - m_last.presentDrops) / seconds;
+    const double decodeMs = perCall(now.decodeUs - m_last.decodeUs, now.decodeCalls - m_last.decodeCalls);
+    const double scaleMs = perCall(now.scaleUs - m_last.scaleUs, now.scaleCalls - m_last.scaleCalls);
+    const sf::Uint64 underruns = now.underruns - m_last.underruns;
+
+    const PacketQueueStats videoPkts = item.videoPackets().stats();
+    const PacketQueueStats audioPkts = item.audioPackets().stats();
+    const size_t frames = item.videoFrames().size();
+    const size_t frameDepth = item.videoFrames().depth();
+
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1);
+    text << "presented " << presentedFps << " fps, dropped " << decoderDropFps + presentDropFps
+         << " fps (" << decoderDropFps << " in decoder, " << presentDropFps << " at present)\n";
+    text << "decode " << decodeMs << " ms/frame, convert " << scaleMs << " ms/frame ("
+         << decoder.converter().pathName() << ", " << RgbaConverter::filterName(decoder.scaleFilter()) << ")\n";
+    text << "packets: video " << videoPkts.packets << " (" << videoPkts.bytes / 1024 << " KiB, "
+         << videoPkts.durationMs << " ms), audio " << audioPkts.packets << " (" << audioPkts.durationMs << " ms)\n";
+    text << "frames queued " << frames << "/" << frameDepth << "\n";
+
+    if(sources.sound)
+    {
+        const MovieSound& sound = *sources.sound;
+        const double samplesPerMs = sound.getSampleRate() * sound.getChannelCount() / 1000.0;
+        text << "PCM buffer " << sound.bufferedSamples() / samplesPerMs << "/"
+             << sound.bufferCapacity() / samplesPerMs << " ms, " << underruns << " underruns\n";
+    }
+    else
+    {
+        text << "no audio\n";
+    }
+
+    text << "A/V drift " << std::showpos << sources.clock->lastDriftMs() << std::noshowpos
+         << " ms (" << masterName(sources.clock->master()) << " master)\n";
+
+    if(sources.jitter)
+    {
+        const JitterBuffer& jitter = *sources.jitter;
+        text << "live: buffered " << jitter.levelMs() << "/" << jitter.targetMs() << " ms, rate "
+             << std::setprecision(2) << jitter.rate() << std::setprecision(1) << ", latency p50 "
+             << jitter.latencyStats().percentileUs(0.5) / 1000.0 << " ms, "
+             << jitter.underruns() << " underruns\n";
+    }
+
+    // The likeliest cause first: a starved pipeline makes the decoder look
+    // idle and the presentation late
+    const double frameMs = item.frameIntervalMs();
+    const char* cause = NULL;
+    if(frames == 0 && videoPkts.packets == 0 && !item.demuxer().isEof())
+        cause = "waiting for input: the packet queue is empty";
+    else if(decodeMs + scaleMs > frameMs)
+        cause = "decoding and converting take longer than a frame";
+    else if(decoderDropFps > 0)
+        cause = "decoder behind the clock, dropping late frames";
+    else if(underruns > 0)
+        cause = "audio output running dry";
+    else if(presentDropFps > 0)
+        cause = "render loop late presenting frames";
+
+    text << (cause ? cause : "keeping up");
+    m_text.setColor(cause ? sf::Color::Yellow : sf::Color::White);
+    m_text.setString(text.str());
+
+    const sf::FloatRect bounds = m_text.getLocalBounds();
+    m_background.setSize(sf::Vector2f(bounds.left + bounds.width + OverlayMargin * 2,
+                                      bounds.top + bounds.height + OverlayMargin * 2));
+}
+
+void StatsOverlay::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+    if(!m_visible)
+        return;
+
+    target.draw(m_background, states);
+    target.draw(m_text, states);
+}
@@ -0,0 +1,82 @@
+#ifndef STATS_OVERLAY_HPP
+#define STATS_OVERLAY_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "PlaybackItem.hpp"
+#include "MovieSound.hpp"
+#include "SyncClock.hpp"
+#include "JitterBuffer.hpp"
+
+//
+// Live playback statistics drawn over the video, shown and hidden with I.
+//
+// Everything it reads is a counter the pipeline keeps anyway, as relaxed
+// atomics (stage timings, drops, the PCM ring positions), or something the
+// render loop counts itself. It reads them when the text is rebuilt, a few
+// times a second, and shows rates over the time since. Drawing costs two
+// draw calls while shown and none while hidden.
+//
+// The last line names the likeliest reason the picture stutters, so it can
+// be told at a glance whether input, the decoder or audio is at fault.
+//
+class StatsOverlay : public sf::Drawable
+{
+public:
+    // What update() reads. sound may be NULL, and jitter is unless the
+    // input is live.
+    struct Sources
+    {
+        PlaybackItem* item;
+        const MovieSound* sound;
+        const SyncClock* clock;
+        const JitterBuffer* jitter;
+        // Counted by the render loop: frames shown, and passed over because
+        // a later one was already due
+        sf::Uint64 presented;
+        sf::Uint64 presentDrops;
+    };
+
+    explicit StatsOverlay(const sf::Font& font);
+
+    void toggle();
+
+    bool isVisible() const
+    {
+        return m_visible;
+    }
+
+    // Call every loop iteration; does nothing until the next refresh
+    void update(const Sources& sources);
+
+private:
+    StatsOverlay(const StatsOverlay&);
+    StatsOverlay& operator=(const StatsOverlay&);
+
+    virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+
+    // Counters at the last refresh
+    struct Snapshot
+    {
+        const PlaybackItem* item;
+        sf::Uint64 presented;
+        sf::Uint64 presentDrops;
+        sf::Uint64 lateDrops;
+        sf::Uint64 decodeCalls;
+        sf::Uint64 decodeUs;
+        sf::Uint64 scaleCalls;
+        sf::Uint64 scaleUs;
+        sf::Uint64 underruns;
+    };
+
+    Snapshot take(const Sources& sources) const;
+    void rebuild(const Sources& sources, const Snapshot& now, double seconds);
+
+    sf::Text m_text;
+    sf::RectangleShape m_background;
+    bool m_visible;
+    sf::Clock m_sinceRefresh;
+    Snapshot m_last;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "SyncClock.hpp"
+
+#include <cstdlib>
+#include <iomanip>
+#include <initializer_list>
+
+// Drift beyond this counts as visibly out of sync
+const sf::Int64 OutOfSyncMs = 80;
+
+SyncClock::SyncClock(Master master)
+: m_master(master)
+, m_rate(1)
+, m_serial(-1)
+, m_driftSamples(0)
+, m_driftAbsSumMs(0)
+, m_driftMaxMs(0)
+, m_outOfSync(0)
+, m_lastDriftMs(0)
+{
+    Source idle = { 0, std::chrono::steady_clock::now(), false };
+    m_audio = idle;
+    m_video = idle;
+    m_external = idle;
+}
+
+sf::Int64 SyncClock::read(const Source& source) const
+{
+    if(!source.running)
+        return source.ptsMs;
+
+    auto elapsed = std::chrono::steady_clock::now() - source.anchor;
+    return source.ptsMs + (sf::Int64)(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() * m_rate);
+}
+
+void SyncClock::set(Source& source, sf::Int64 ptsMs)
+{
+    source.ptsMs = ptsMs;
+    source.anchor = std::chrono::steady_clock::now();
+    source.running = true;
+}
+
+void SyncClock::reset(int serial, sf::Int64 ptsMs)
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    set(m_video, ptsMs);
+    set(m_external, ptsMs);
+    set(m_audio, ptsMs);
+    m_audio.running = false;
+    m_serial = serial;
+}
+
+void SyncClock::setRate(double rate)
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    for (Source* source : { &m_audio, &m_video, &m_external })
+    {
+        if(source->running)
+            set(*source, read(*source));
+    }
+    m_rate = rate;
+}
+
+void SyncClock::pause()
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    for (Source* source : { &m_audio, &m_video, &m_external })
+    {
+        source->ptsMs = read(*source);
+        source->running = false;
+    }
+}
+
+void SyncClock::updateAudio(sf::Int64 ms)
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    set(m_audio, ms);
+}
+
+void SyncClock::updateVideo(sf::Int64 ptsMs)
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    set(m_video, ptsMs);
+}
+
+sf::Int64 SyncClock::masterMs() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    switch (m_master)
+    {
+        case AudioMaster:
+            return read(m_audio);
+        case VideoMaster:
+            return read(m_video);
+        default:
+            return read(m_external);
+    }
+}
+
+sf::Int64 SyncClock::audioMs() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    return read(m_audio);
+}
+
+sf::Int64 SyncClock::videoMs() const
+{
+    std::lock_guard<std::mutex> lk(m_mut);
+    return read(m_video);
+}
+
+void SyncClock::recordDrift(sf::Int64 driftMs)
+{
+    const sf::Int64 absDrift = std::llabs(driftMs);
+    m_lastDriftMs = driftMs;
+    ++m_driftSamples;
+    m_driftAbsSumMs += absDrift;
+    if(absDrift > std::llabs(m_driftMaxMs))
+        m_driftMaxMs = driftMs;
+    if(absDrift > OutOfSyncMs)
+        ++m_outOfSync;
+}
+
+void SyncClock::printStats(std::ostream& out) const
+{
+    static const char* names[] = { "audio", "video", "external" };
+
+    out << std::fixed << std::setprecision(1)
+        << "sync (" << names[m_master] << " master): "
+        << m_driftSamples << " frames, mean |drift| "
+        << (m_driftSamples ? m_driftAbsSumMs / (double)m_driftSamples : 0.0) << " ms, worst "
+        << m_driftMaxMs << " ms, "
+        << m_outOfSync << " beyond " << OutOfSyncMs << " ms" << std::endl;
+}
+
+bool parseSyncMaster(const std::string& name, SyncClock::Master& master)
+{
+    if(name == "audio")
+        master = SyncClock::AudioMaster;
+    else if(name == "video")
+        master = SyncClock::VideoMaster;
+    else if(name == "external")
+        master = SyncClock::ExternalMaster;
+    else
+        return false;
+
+    return true;
+}
@@ -0,0 +1,123 @@
+#ifndef SYNC_CLOCK_HPP
+#define SYNC_CLOCK_HPP
+
+#include <SFML/Config.hpp>
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+//
+// The clock video frames are presented against.
+//
+// The master is the audio position reported by the sound card, the
+// timestamp of the last presented frame, or the system clock. Between
+// updates every source runs on the system clock. The render loop updates
+// it; the video decoder reads it to throw away frames that are already late
+// before converting them.
+//
+// In trick play the clock runs at a rate other than 1, negative when
+// rewinding.
+//
+// reset() is called with the first frame after a seek. Until then the clock
+// still describes the old position, which serial() lets readers detect.
+//
+class SyncClock
+{
+public:
+    enum Master
+    {
+        AudioMaster,
+        VideoMaster,
+        ExternalMaster
+    };
+
+    explicit SyncClock(Master master);
+
+    Master master() const
+    {
+        return m_master;
+    }
+
+    // A playlist changes the master between files with and without audio
+    void setMaster(Master master)
+    {
+        m_master = master;
+    }
+
+    // Restarts every source at ptsMs. The audio source holds there until the
+    // first updateAudio, since the sound card needs a moment to start.
+    void reset(int serial, sf::Int64 ptsMs);
+
+    // Media time per unit of real time. Every source carries on from where
+    // it is at the new rate.
+    void setRate(double rate);
+
+    double rate() const
+    {
+        return m_rate;
+    }
+
+    // Holds every source where it is until the next reset()
+    void pause();
+
+    void updateAudio(sf::Int64 ms);
+    void updateVideo(sf::Int64 ptsMs);
+
+    sf::Int64 masterMs() const;
+    sf::Int64 audioMs() const;
+    sf::Int64 videoMs() const;
+
+    // Serial of the last reset; -1 before the first one
+    int serial() const
+    {
+        return m_serial;
+    }
+
+    // Video ahead (positive) or behind (negative) the master at presentation
+    void recordDrift(sf::Int64 driftMs);
+
+    // The latest drift recorded
+    sf::Int64 lastDriftMs() const
+    {
+        return m_lastDriftMs;
+    }
+
+    void printStats(std::ostream& out) const;
+
+private:
+    SyncClock(const SyncClock&);
+    SyncClock& operator=(const SyncClock&);
+
+    struct Source
+    {
+        sf::Int64 ptsMs;
+        std::chrono::steady_clock::time_point anchor;
+        bool running;
+    };
+
+    sf::Int64 read(const Source& source) const;
+    void set(Source& source, sf::Int64 ptsMs);
+
+    std::atomic<Master> m_master;
+    std::atomic<double> m_rate;
+    mutable std::mutex m_mut;
+    Source m_audio;
+    Source m_video;
+    Source m_external;
+    std::atomic<int> m_serial;
+
+    // Drift is only recorded by the render thread
+    sf::Uint64 m_driftSamples;
+    sf::Uint64 m_driftAbsSumMs;
+    sf::Int64 m_driftMaxMs;
+    sf::Uint64 m_outOfSync;
+    sf::Int64 m_lastDriftMs;
+};
+
+// Parses "audio", "video" or "external"
+bool parseSyncMaster(const std::string& name, SyncClock::Master& master);
+
+#endif
@@ -0,0 +1,374 @@
+#include "TestMedia.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+}
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdio>
+
+const int TestAudioRate = 48000;
+const int TestAudioBitRate = 192000;
+// Tone sweeps between these over the clip, the right channel a fifth up
+const double SweepFromHz = 220;
+const double SweepToHz = 880;
+const double TwoPi = 6.283185307179586;
+
+// Ten seconds at 25 fps with a keyframe every two, so seeks have GOPs to
+// land in. 1080p comes in several codecs to compare decoders at one size.
+const TestClipSpec StandardClips[] =
+{
+    { "mpeg4_480p", AV_CODEC_ID_MPEG4, 854, 480, 25, 50, 10 },
+    { "mpeg4_720p", AV_CODEC_ID_MPEG4, 1280, 720, 25, 50, 10 },
+    { "mpeg4_1080p", AV_CODEC_ID_MPEG4, 1920, 1080, 25, 50, 10 },
+    { "mpeg2_1080p", AV_CODEC_ID_MPEG2VIDEO, 1920, 1080, 25, 50, 10 },
+    { "h264_1080p", AV_CODEC_ID_H264, 1920, 1080, 25, 50, 10 }
+};
+
+namespace
+{
+    inline unsigned hash(unsigned x, unsigned y)
+    {
+        unsigned h = x * 0x9E3779B1u ^ y * 0x85EBCA77u;
+        h ^= h >> 15;
+        h *= 0x2C1B3C6Du;
+        h ^= h >> 13;
+        return h;
+    }
+
+    // Goes 0..span and back as i counts up
+    inline int bounce(int i, int span)
+    {
+        if(span <= 0)
+            return 0;
+        const int t = i % (2 * span);
+        return t < span ? t : 2 * span - t;
+    }
+
+    // Integer arithmetic only, so the frames don't depend on the libm
+    void drawFrame(AVFrame* frame, int index)
+    {
+        const int w = frame->width;
+        const int h = frame->height;
+        const int block = h / 6;
+        const int blockX = bounce(index * 7, w - block);
+        const int blockY = bounce(index * 3, h - block);
+
+        for (int y = 0; y < h; ++y)
+        {
+            uint8_t* row = frame->data[0] + y * frame->linesize[0];
+            const bool blockRow = y >= blockY && y < blockY + block;
+            for (int x = 0; x < w; ++x)
+            {
+                if(blockRow && x >= blockX && x < blockX + block)
+                {
+                    row[x] = 235;
+                    continue;
+                }
+                // Gradient scrolling down, noise drifting right
+                const int noise = (int)(hash((x + 3 * index) >> 1, y >> 1) & 31) - 16;
+                row[x] = (uint8_t)(48 + ((x + y - 2 * index) & 0xFF) / 2 + noise);
+            }
+        }
+
+        for (int y = 0; y < h / 2; ++y)
+        {
+            uint8_t* u = frame->data[1] + y * frame->linesize[1];
+            uint8_t* v = frame->data[2] + y * frame->linesize[2];
+            for (int x = 0; x < w / 2; ++x)
+            {
+                u[x] = (uint8_t)(96 + ((2 * x + index) & 63));
+                v[x] = (uint8_t)(96 + ((2 * y + 3 * index) & 63));
+            }
+        }
+    }
+
+    void fillSamples(AVFrame* frame, int64_t firstSample, int64_t totalSamples)
+    {
+        const int channels = av_get_channel_layout_nb_channels(frame->channel_layout);
+        const AVSampleFormat format = (AVSampleFormat)frame->format;
+        const bool planar = av_sample_fmt_is_planar(format) != 0;
+
+        for (int i = 0; i < frame->nb_samples; ++i)
+        {
+            // Phase of a linear sweep, exact for any sample
+            const double t = (firstSample + i) / (double)TestAudioRate;
+            const double duration = totalSamples / (double)TestAudioRate;
+            const double phase = TwoPi * (SweepFromHz * t + (SweepToHz - SweepFromHz) * t * t / (2 * duration));
+
+            for (int c = 0; c < channels; ++c)
+            {
+                const double value = 0.25 * std::sin(phase * (c ? 1.5 : 1));
+                const int slot = planar ? i : i * channels + c;
+                uint8_t* data = frame->extended_data[planar ? c : 0];
+
+                if(format == AV_SAMPLE_FMT_FLT || format == AV_SAMPLE_FMT_FLTP)
+                    ((float*)data)[slot] = (float)value;
+                else
+                    ((int16_t*)data)[slot] = (int16_t)(value * 32767);
+            }
+        }
+    }
+
+    //
+    // Muxer and encoders for one clip
+    //
+    class ClipWriter
+    {
+    public:
+        ClipWriter()
+        : m_formatCtx(NULL)
+        , m_video(NULL)
+        , m_audio(NULL)
+        , m_picture(av_frame_alloc())
+        , m_samples(av_frame_alloc())
+        {
+        }
+
+        ~ClipWriter()
+        {
+            if(m_video)
+                avcodec_close(m_video->codec);
+            if(m_audio)
+                avcodec_close(m_audio->codec);
+            if(m_formatCtx)
+            {
+                if(m_formatCtx->pb)
+                    avio_close(m_formatCtx->pb);
+                avformat_free_context(m_formatCtx);
+            }
+            av_frame_free(&m_picture);
+            av_frame_free(&m_samples);
+        }
+
+        bool write(const std::string& path, const TestClipSpec& spec)
+        {
+            if(avformat_alloc_output_context2(&m_formatCtx, NULL, "matroska", path.c_str()) < 0)
+                return false;
+#ifdef AVFMT_FLAG_BITEXACT
+            // Older muxers stamp a date and random UIDs regardless; the
+            // streams are identical either way
+            m_formatCtx->flags |= AVFMT_FLAG_BITEXACT;
+#endif
+
+            if(!addVideo(spec))
+                return false;
+
+            // Not every build has an AC-3 encoder; MP2 is plain S16
+            AVCodec* audioEncoder = avcodec_find_encoder(AV_CODEC_ID_AC3);
+            if(!audioEncoder)
+                audioEncoder = avcodec_find_encoder(AV_CODEC_ID_MP2);
+            if(audioEncoder && !addAudio(audioEncoder))
+                return false;
+
+            if(avio_open(&m_formatCtx->pb, path.c_str(), AVIO_FLAG_WRITE) < 0)
+                return false;
+            if(avformat_write_header(m_formatCtx, NULL) < 0)
+                return false;
+
+            const int frames = spec.fps * spec.seconds;
+            const int64_t totalSamples = (int64_t)spec.seconds * TestAudioRate;
+            int64_t samplesWritten = 0;
+
+            for (int i = 0; i < frames; ++i)
+            {
+                if(av_frame_make_writable(m_picture) < 0)
+                    return false;
+                drawFrame(m_picture, i);
+                m_picture->pts = i;
+                if(encode(m_video, m_picture) < 0)
+                    return false;
+
+                // Audio up to the end of this frame, for the muxer to
+                // interleave
+                const int64_t until = (int64_t)(i + 1) * TestAudioRate / spec.fps;
+                while (m_audio && samplesWritten < until)
+                {
+                    if(av_frame_make_writable(m_samples) < 0)
+                        return false;
+                    fillSamples(m_samples, samplesWritten, totalSamples);
+                    m_samples->pts = samplesWritten;
+                    samplesWritten += m_samples->nb_samples;
+                    if(encode(m_audio, m_samples) < 0)
+                        return false;
+                }
+            }
+
+            // Delayed packets: B-frames, encoder lookahead
+            while (encode(m_video, NULL) > 0) {}
+            while (m_audio && encode(m_audio, NULL) > 0) {}
+
+            return av_write_trailer(m_formatCtx) >= 0;
+        }
+
+    private:
+        ClipWriter(const ClipWriter&);
+        ClipWriter& operator=(const ClipWriter&);
+
+        void setCommonFlags(AVCodecContext* codecCtx)
+        {
+            codecCtx->flags |= CODEC_FLAG_BITEXACT;
+            if(m_formatCtx->oformat->flags & AVFMT_GLOBALHEADER)
+                codecCtx->flags |= CODEC_FLAG_GLOBAL_HEADER;
+        }
+
+        bool addVideo(const TestClipSpec& spec)
+        {
+            AVCodec* encoder = avcodec_find_encoder(spec.videoCodec);
+            if(!encoder)
+                return false;
+
+            m_video = avformat_new_stream(m_formatCtx, encoder);
+            if(!m_video)
+                return false;
+
+            AVCodecContext* codecCtx = m_video->codec;
+            codecCtx->width = spec.width;
+            codecCtx->height = spec.height;
+            codecCtx->pix_fmt = PIX_FMT_YUV420P;
+            codecCtx->time_base.num = 1;
+            codecCtx->time_base.den = spec.fps;
+            codecCtx->gop_size = spec.gop;
+            codecCtx->max_b_frames = 2;
+            // About a tenth of a bit per pixel, a typical broadcast rate
+            codecCtx->bit_rate = (int64_t)spec.width * spec.height * spec.fps / 10;
+            // Threaded encoders may cut the picture differently from run to
+            // run
+            codecCtx->thread_count = 1;
+            setCommonFlags(codecCtx);
+            m_video->time_base = codecCtx->time_base;
+
+            if(avcodec_open2(codecCtx, encoder, NULL) < 0)
+            {
+                m_video = NULL;
+                return false;
+            }
+
+            m_picture->format = PIX_FMT_YUV420P;
+            m_picture->width = spec.width;
+            m_picture->height = spec.height;
+            return av_frame_get_buffer(m_picture, 32) >= 0;
+        }
+
+        bool addAudio(AVCodec* encoder)
+        {
+            m_audio = avformat_new_stream(m_formatCtx, encoder);
+            if(!m_audio)
+                return false;
+
+            AVCodecContext* codecCtx = m_audio->codec;
+            codecCtx->sample_fmt = encoder->sample_fmts ? encoder->sample_fmts[0] : AV_SAMPLE_FMT_S16;
+            codecCtx->sample_rate = TestAudioRate;
+            codecCtx->channel_layout = AV_CH_LAYOUT_STEREO;
+            codecCtx->channels = 2;
+            codecCtx->bit_rate = TestAudioBitRate;
+            codecCtx->time_base.num = 1;
+            codecCtx->time_base.den = TestAudioRate;
+            setCommonFlags(codecCtx);
+            m_audio->time_base = codecCtx->time_base;
+
+            if(avcodec_open2(codecCtx, encoder, NULL) < 0)
+            {
+                m_audio = NULL;
+                return false;
+            }
+
+            m_samples->format = codecCtx->sample_fmt;
+            m_samples->channel_layout = codecCtx->channel_layout;
+            m_samples->sample_rate = codecCtx->sample_rate;
+            m_samples->nb_samples = codecCtx->frame_size;
+            return av_frame_get_buffer(m_samples, 0) >= 0;
+        }
+
+        // NULL drains the encoder. Returns 1 if a packet came out, 0 if none
+        // and negative on error.
+        int encode(AVStream* stream, const AVFrame* frame)
+        {
+            AVCodecContext* codecCtx = stream->codec;
+
+            AVPacket packet;
+            av_init_packet(&packet);
+            packet.data = NULL;
+            packet.size = 0;
+
+            int gotPacket = 0;
+            const int ret = codecCtx->codec_type == AVMEDIA_TYPE_VIDEO
+                ? avcodec_encode_video2(codecCtx, &packet, frame, &gotPacket)
+                : avcodec_encode_audio2(codecCtx, &packet, frame, &gotPacket);
+            if(ret < 0)
+                return ret;
+            if(!gotPacket)
+                return 0;
+
+            // Encoders stamp packets in the codec time base
+            if(packet.pts != AV_NOPTS_VALUE)
+                packet.pts = av_rescale_q(packet.pts, codecCtx->time_base, stream->time_base);
+            if(packet.dts != AV_NOPTS_VALUE)
+                packet.dts = av_rescale_q(packet.dts, codecCtx->time_base, stream->time_base);
+            packet.duration = (int)av_rescale_q(packet.duration, codecCtx->time_base, stream->time_base);
+            packet.stream_index = stream->index;
+
+            return av_interleaved_write_frame(m_formatCtx, &packet) < 0 ? -1 : 1;
+        }
+
+        AVFormatContext* m_formatCtx;
+        AVStream* m_video;
+        AVStream* m_audio;
+        AVFrame* m_picture;
+        AVFrame* m_samples;
+    };
+}
+
+bool writeTestClip(const std::string& path, const TestClipSpec& spec)
+{
+    ClipWriter writer;
+    if(writer.write(path, spec))
+        return true;
+
+    std::remove(path.c_str());
+    return false;
+}
+
+int runMakeTestMedia(const std::string& dir, std::ostream& out)
+{
+    const std::string listPath = dir + "/clips.txt";
+    std::ofstream list(listPath.c_str());
+    if(!list)
+    {
+        out << "can't write " << listPath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int written = 0;
+    for (const auto& spec : StandardClips)
+    {
+        const std::string file = std::string(spec.name) + ".mkv";
+        if(!avcodec_find_encoder(spec.videoCodec))
+        {
+            out << file << ": skipped, no " << avcodec_get_name(spec.videoCodec) << " encoder" << std::endl;
+            continue;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        if(!writeTestClip(dir + "/" + file, spec))
+        {
+            out << file << ": encoding failed" << std::endl;
+            continue;
+        }
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        out << std::fixed << std::setprecision(2)
+            << file << ": " << spec.width << "x" << spec.height << " " << avcodec_get_name(spec.videoCodec)
+            << ", " << spec.seconds << " s, written in " << sec << " s" << std::endl;
+        list << file << "\n";
+        ++written;
+    }
+
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,41 @@
+#ifndef TEST_MEDIA_HPP
+#define TEST_MEDIA_HPP
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include <ostream>
+#include <string>
+
+//
+// Synthetic clips for benchmarking, encoded with libavcodec so every
+// machine can make the same ones without shipping media.
+//
+// The picture is a scrolling gradient under hashed noise with a moving
+// block, so motion search and residual coding have real work to do; the
+// audio a stereo tone sweep. Encoders run single-threaded in bit-exact
+// mode, so with the same FFmpeg build the files come out identical.
+//
+struct TestClipSpec
+{
+    const char* name;
+    AVCodecID videoCodec;
+    int width;
+    int height;
+    int fps;
+    // Keyframe interval, in frames
+    int gop;
+    int seconds;
+};
+
+// Writes one clip, with audio if an AC-3 or MP2 encoder is built in.
+// Returns false if the video encoder isn't.
+bool writeTestClip(const std::string& path, const TestClipSpec& spec);
+
+// Writes the standard set into dir, which must exist, skipping codecs this
+// FFmpeg can't encode, and lists the files written in dir/clips.txt for
+// --playlist
+int runMakeTestMedia(const std::string& dir, std::ostream& out);
+
+#endif
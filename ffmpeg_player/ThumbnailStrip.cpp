@@ -0,0 +1,552 @@
+#include "ThumbnailStrip.hpp"
+#include "KeyframeIndex.hpp"
+#include "Trace.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Each worker takes this many ranges on average, so one slow range (large
+// keyframes, a slow stretch of disk) doesn't hold up the others
+const unsigned RangesPerWorker = 4;
+// MJPEG qscale, 2 (best) to 31
+const int ThumbnailQScale = 5;
+// Workers only need the video stream's codec parameters, which are mostly
+// in the headers; don't let each of them probe 5 MB
+const unsigned WorkerProbeBytes = 256 << 10;
+
+namespace
+{
+    const char CacheMagic[4] = { 'T', 'H', 'M', '1' };
+
+    struct CacheHeader
+    {
+        char magic[4];
+        sf::Int32 maxWidth;
+        sf::Int32 maxHeight;
+        sf::Int32 width;
+        sf::Int32 height;
+        sf::Int64 sourceSize;
+        sf::Int64 sourceMtime;
+        sf::Int64 intervalMs;
+        sf::Uint64 markCount;
+        sf::Uint64 imageCount;
+    };
+
+    // What a worker found for one mark
+    struct Slot
+    {
+        sf::Int64 keyframeMs;
+        bool ok;
+        // Left empty, with ok set, when the previous mark's picture is reused
+        std::vector<sf::Uint8> jpeg;
+    };
+
+    //
+    // One worker's demuxer, decoder, scaler and JPEG encoder, opened once
+    // and used for every range it takes.
+    //
+    class ThumbnailWorker
+    {
+    public:
+        ThumbnailWorker(const std::string& path, int videoStream, int width, int height)
+        : m_path(path)
+        , m_videoStream(videoStream)
+        , m_width(width)
+        , m_height(height)
+        , m_formatCtx(NULL)
+        , m_codecCtx(NULL)
+        , m_encoderCtx(NULL)
+        , m_swsCtx(NULL)
+        , m_frame(av_frame_alloc())
+        , m_scaled(av_frame_alloc())
+        , m_startTime(0)
+        , m_lastMark(0)
+        , m_lastKeyframeMs(INT64_MIN)
+        {
+        }
+
+        ~ThumbnailWorker()
+        {
+            if(m_encoderCtx)
+            {
+                avcodec_close(m_encoderCtx);
+                av_free(m_encoderCtx);
+            }
+            if(m_codecCtx)
+                avcodec_close(m_codecCtx);
+            if(m_formatCtx)
+                avformat_close_input(&m_formatCtx);
+
+            sws_freeContext(m_swsCtx);
+            av_frame_free(&m_frame);
+            av_frame_free(&m_scaled);
+        }
+
+        bool open()
+        {
+            m_formatCtx = avformat_alloc_context();
+            m_formatCtx->probesize = WorkerProbeBytes;
+            if(avformat_open_input(&m_formatCtx, m_path.c_str(), NULL, NULL) != 0)
+                return false;
+
+            if(avformat_find_stream_info(m_formatCtx, NULL) < 0 || m_videoStream >= (int)m_formatCtx->nb_streams)
+                return false;
+
+            // Non-key packets are dropped by demuxers that can, and by the
+            // decoder otherwise
+            for (unsigned i = 0; i < m_formatCtx->nb_streams; ++i)
+                m_formatCtx->streams[i]->discard = (int)i == m_videoStream ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+
+            AVStream* stream = m_formatCtx->streams[m_videoStream];
+            m_startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+
+            AVCodec* decoder = avcodec_find_decoder(stream->codec->codec_id);
+            if(!decoder)
+                return false;
+
+            // The workers are the parallelism
+            m_codecCtx = stream->codec;
+            m_codecCtx->thread_count = 1;
+            m_codecCtx->skip_frame = AVDISCARD_NONKEY;
+            if(avcodec_open2(m_codecCtx, decoder, NULL) < 0)
+            {
+                m_codecCtx = NULL;
+                return false;
+            }
+
+            AVCodec* encoder = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+            if(!encoder)
+                return false;
+
+            m_encoderCtx = avcodec_alloc_context3(encoder);
+            m_encoderCtx->width = m_width;
+            m_encoderCtx->height = m_height;
+            m_encoderCtx->pix_fmt = PIX_FMT_YUVJ420P;
+            m_encoderCtx->time_base.num = 1;
+            m_encoderCtx->time_base.den = 25;
+            m_encoderCtx->flags |= CODEC_FLAG_QSCALE;
+            m_encoderCtx->global_quality = FF_QP2LAMBDA * ThumbnailQScale;
+            if(avcodec_open2(m_encoderCtx, encoder, NULL) < 0)
+                return false;
+
+            m_scaled->format = PIX_FMT_YUVJ420P;
+            m_scaled->width = m_width;
+            m_scaled->height = m_height;
+            return av_frame_get_buffer(m_scaled, 32) >= 0;
+        }
+
+        // Thumbnail of the keyframe at or before targetMs
+        void grab(size_t mark, sf::Int64 targetMs, Slot& slot)
+        {
+            slot.ok = false;
+
+            const AVStream* stream = m_formatCtx->streams[m_videoStream];
+            const AVRational msTimeBase = {1, 1000};
+            const int64_t ts = m_startTime + av_rescale_q(targetMs, msTimeBase, stream->time_base);
+            if(avformat_seek_file(m_formatCtx, m_videoStream, INT64_MIN, ts, ts, 0) < 0)
+                return;
+            avcodec_flush_buffers(m_codecCtx);
+
+            AVPacket packet;
+            av_init_packet(&packet);
+            while (av_read_frame(m_formatCtx, &packet) >= 0)
+            {
+                if(packet.stream_index != m_videoStream || !(packet.flags & AV_PKT_FLAG_KEY))
+                {
+                    av_free_packet(&packet);
+                    continue;
+                }
+
+                const int64_t pts = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+                slot.keyframeMs = pts != AV_NOPTS_VALUE ? (sf::Int64)(1000 * (pts - m_startTime) * av_q2d(stream->time_base)) : targetMs;
+
+                // Marks closer than the keyframe interval land on the same
+                // keyframe as the one before
+                if(mark == m_lastMark + 1 && slot.keyframeMs == m_lastKeyframeMs)
+                {
+                    av_free_packet(&packet);
+                    slot.ok = true;
+                    m_lastMark = mark;
+                    return;
+                }
+
+                const bool decoded = decodeKeyframe(&packet);
+                av_free_packet(&packet);
+
+                if(decoded && encode(slot.jpeg))
+                {
+                    slot.ok = true;
+                    m_lastMark = mark;
+                    m_lastKeyframeMs = slot.keyframeMs;
+                }
+                return;
+            }
+        }
+
+    private:
+        ThumbnailWorker(const ThumbnailWorker&);
+        ThumbnailWorker& operator=(const ThumbnailWorker&);
+
+        bool decodeKeyframe(AVPacket* packet)
+        {
+            int gotFrame = 0;
+            if(avcodec_decode_video2(m_codecCtx, m_frame, &gotFrame, packet) < 0)
+                return false;
+
+            if(!gotFrame)
+            {
+                // Decoders that reorder hold the picture back until more
+                // come in; drain it out instead
+                AVPacket flushPacket;
+                av_init_packet(&flushPacket);
+                flushPacket.data = NULL;
+                flushPacket.size = 0;
+                if(avcodec_decode_video2(m_codecCtx, m_frame, &gotFrame, &flushPacket) < 0)
+                    return false;
+            }
+
+            return gotFrame != 0;
+        }
+
+        bool encode(std::vector<sf::Uint8>& jpeg)
+        {
+            // Area averaging, the scale factors here are large
+            m_swsCtx = sws_getCachedContext(m_swsCtx, m_frame->width, m_frame->height, (AVPixelFormat)m_frame->format,
+                                            m_width, m_height, PIX_FMT_YUVJ420P, SWS_AREA, NULL, NULL, NULL);
+            if(!m_swsCtx)
+                return false;
+
+            sws_scale(m_swsCtx, m_frame->data, m_frame->linesize, 0, m_frame->height, m_scaled->data, m_scaled->linesize);
+            m_scaled->quality = m_encoderCtx->global_quality;
+
+            AVPacket packet;
+            av_init_packet(&packet);
+            packet.data = NULL;
+            packet.size = 0;
+
+            int gotPacket = 0;
+            if(avcodec_encode_video2(m_encoderCtx, &packet, m_scaled, &gotPacket) < 0 || !gotPacket)
+                return false;
+
+            jpeg.assign(packet.data, packet.data + packet.size);
+            av_free_packet(&packet);
+            return true;
+        }
+
+        std::string m_path;
+        int m_videoStream;
+        int m_width;
+        int m_height;
+
+        AVFormatContext* m_formatCtx;
+        AVCodecContext* m_codecCtx;
+        AVCodecContext* m_encoderCtx;
+        SwsContext* m_swsCtx;
+        AVFrame* m_frame;
+        AVFrame* m_scaled;
+        int64_t m_startTime;
+
+        size_t m_lastMark;
+        sf::Int64 m_lastKeyframeMs;
+    };
+}
+
+ThumbnailStrip::ThumbnailStrip(const std::string& path, sf::Int64 intervalMs, int maxWidth, int maxHeight)
+: m_path(path)
+, m_cachePath(path + ".thumbs")
+, m_intervalMs(std::max<sf::Int64>(1, intervalMs))
+, m_maxWidth(std::max(2, maxWidth))
+, m_maxHeight(std::max(2, maxHeight))
+, m_width(0)
+, m_height(0)
+, m_fromCache(false)
+{
+}
+
+bool ThumbnailStrip::generate(unsigned workers)
+{
+    m_marks.clear();
+    m_images.clear();
+
+    m_fromCache = loadCache();
+    if(m_fromCache)
+        return true;
+
+    int videoStream = -1;
+    sf::Int64 durationMs = 0;
+    if(!probe(videoStream, durationMs))
+        return false;
+
+    const size_t markCount = (size_t)((durationMs - 1) / m_intervalMs) + 1;
+    if(workers == 0)
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    workers = (unsigned)std::min<size_t>(workers, markCount);
+    const size_t rangeCount = std::min<size_t>(markCount, workers * RangesPerWorker);
+
+    // Ranges are contiguous runs of marks, taken in order by whichever
+    // worker is free. A worker that fails to open leaves its share to
+    // the others.
+    std::vector<Slot> slots(markCount);
+    std::atomic<size_t> nextRange(0);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < workers; ++i)
+    {
+        threads.push_back(std::thread([&]
+        {
+            traceThreadName("thumbnailer");
+
+            ThumbnailWorker worker(m_path, videoStream, m_width, m_height);
+            if(!worker.open())
+                return;
+
+            for (size_t range = nextRange++; range < rangeCount; range = nextRange++)
+            {
+                const size_t first = range * markCount / rangeCount;
+                const size_t last = (range + 1) * markCount / rangeCount;
+                for (size_t mark = first; mark < last; ++mark)
+                    worker.grab(mark, mark * m_intervalMs, slots[mark]);
+            }
+        }));
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    m_marks.resize(markCount);
+    for (size_t i = 0; i < markCount; ++i)
+    {
+        Mark& mark = m_marks[i];
+        mark.ptsMs = i * m_intervalMs;
+        mark.keyframeMs = slots[i].keyframeMs;
+
+        if(!slots[i].ok)
+        {
+            mark.image = -1;
+        }
+        else if(slots[i].jpeg.empty())
+        {
+            // Reused only from the mark right before, by the same worker
+            mark.image = i > 0 ? m_marks[i - 1].image : -1;
+        }
+        else
+        {
+            mark.image = (sf::Int32)m_images.size();
+            m_images.push_back(std::move(slots[i].jpeg));
+        }
+    }
+
+    if(m_images.empty())
+    {
+        m_marks.clear();
+        return false;
+    }
+
+    saveCache();
+    return true;
+}
+
+bool ThumbnailStrip::probe(int& videoStream, sf::Int64& durationMs)
+{
+    AVFormatContext* ctx = NULL;
+    if(avformat_open_input(&ctx, m_path.c_str(), NULL, NULL) != 0)
+        return false;
+
+    bool ok = avformat_find_stream_info(ctx, NULL) >= 0;
+    if(ok)
+    {
+        videoStream = av_find_best_stream(ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        ok = videoStream >= 0 && ctx->duration != AV_NOPTS_VALUE && ctx->duration > 0;
+    }
+
+    if(ok)
+    {
+        const AVCodecContext* codecCtx = ctx->streams[videoStream]->codec;
+        const double scale = std::min(m_maxWidth / (double)codecCtx->width, m_maxHeight / (double)codecCtx->height);
+
+        // Even sizes, as 4:2:0 needs
+        m_width = std::max(2, (int)(codecCtx->width * scale) & ~1);
+        m_height = std::max(2, (int)(codecCtx->height * scale) & ~1);
+        durationMs = ctx->duration / (AV_TIME_BASE / 1000);
+    }
+
+    avformat_close_input(&ctx);
+    return ok;
+}
+
+size_t ThumbnailStrip::indexAt(sf::Int64 ms) const
+{
+    if(m_marks.empty() || ms <= 0)
+        return 0;
+
+    return std::min<size_t>(ms / m_intervalMs, m_marks.size() - 1);
+}
+
+bool ThumbnailStrip::loadImage(size_t index, sf::Image& image) const
+{
+    if(index >= m_marks.size() || m_marks[index].image < 0)
+        return false;
+
+    const std::vector<sf::Uint8>& jpeg = m_images[m_marks[index].image];
+    return image.loadFromMemory(jpeg.data(), jpeg.size());
+}
+
+size_t ThumbnailStrip::imageBytes() const
+{
+    size_t bytes = 0;
+    for (const auto& jpeg : m_images)
+        bytes += jpeg.size();
+    return bytes;
+}
+
+bool ThumbnailStrip::loadCache()
+{
+    CacheHeader header;
+    std::ifstream in(m_cachePath.c_str(), std::ios::binary);
+    if(!in.read((char*)&header, sizeof(header)))
+        return false;
+
+    sf::Int64 size = 0;
+    sf::Int64 mtime = 0;
+    if(std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0
+       || header.maxWidth != m_maxWidth
+       || header.maxHeight != m_maxHeight
+       || header.intervalMs != m_intervalMs
+       || !fileIdentity(m_path, size, mtime)
+       || header.sourceSize != size
+       || header.sourceMtime != mtime)
+    {
+        return false;
+    }
+
+    // Every count is checked against what is left of the file before
+    // anything is sized from it, so a damaged cache is just a miss
+    const std::streamoff dataStart = in.tellg();
+    in.seekg(0, std::ios::end);
+    std::streamoff remaining = in.tellg() - dataStart;
+    in.seekg(dataStart);
+    if(!in || remaining < 0 || header.markCount > (sf::Uint64)remaining / sizeof(Mark))
+        return false;
+
+    std::vector<Mark> marks(header.markCount);
+    if(!in.read((char*)marks.data(), header.markCount * sizeof(Mark)))
+        return false;
+    remaining -= header.markCount * sizeof(Mark);
+
+    // Each image takes at least its length
+    if(header.imageCount > (sf::Uint64)remaining / sizeof(sf::Uint32))
+        return false;
+
+    std::vector<std::vector<sf::Uint8> > images(header.imageCount);
+    for (auto& jpeg : images)
+    {
+        sf::Uint32 bytes = 0;
+        if(!in.read((char*)&bytes, sizeof(bytes)))
+            return false;
+        remaining -= sizeof(bytes);
+        if(bytes > remaining)
+            return false;
+        remaining -= bytes;
+
+        jpeg.resize(bytes);
+        if(!in.read((char*)jpeg.data(), bytes))
+            return false;
+    }
+
+    for (const Mark& mark : marks)
+    {
+        if(mark.image >= (sf::Int32)images.size())
+            return false;
+    }
+
+    m_width = header.width;
+    m_height = header.height;
+    m_marks.swap(marks);
+    m_images.swap(images);
+    return true;
+}
+
+void ThumbnailStrip::saveCache() const
+{
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.maxWidth = m_maxWidth;
+    header.maxHeight = m_maxHeight;
+    header.width = m_width;
+    header.height = m_height;
+    header.intervalMs = m_intervalMs;
+    header.markCount = m_marks.size();
+    header.imageCount = m_images.size();
+    if(!fileIdentity(m_path, header.sourceSize, header.sourceMtime))
+        return;
+
+    // Same as the keyframe index: whole or not at all, and failing (say on
+    // read-only media) only costs a rebuild next time
+    const std::string tmpPath = m_cachePath + ".tmp";
+    {
+        std::ofstream out(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)m_marks.data(), m_marks.size() * sizeof(Mark));
+        for (const auto& jpeg : m_images)
+        {
+            const sf::Uint32 bytes = (sf::Uint32)jpeg.size();
+            out.write((const char*)&bytes, sizeof(bytes));
+            out.write((const char*)jpeg.data(), bytes);
+        }
+
+        if(!out)
+        {
+            out.close();
+            std::remove(tmpPath.c_str());
+            return;
+        }
+    }
+    std::rename(tmpPath.c_str(), m_cachePath.c_str());
+}
+
+int runThumbnails(const PlayerOptions& options, std::ostream& out)
+{
+    if(options.inputs.empty())
+    {
+        out << "--thumbnails needs at least one input file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int failures = 0;
+    for (const auto& path : options.inputs)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        ThumbnailStrip strip(path, options.thumbnailIntervalMs, options.thumbnailWidth, options.thumbnailHeight);
+        if(!strip.generate(options.thumbnailWorkers))
+        {
+            out << path << ": no thumbnails" << std::endl;
+            ++failures;
+            continue;
+        }
+
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double mediaSec = strip.size() * options.thumbnailIntervalMs / 1000.0;
+
+        out << std::fixed << std::setprecision(2)
+            << path << ": " << strip.size() << " thumbnails of " << strip.width() << "x" << strip.height()
+            << " from " << strip.imageCount() << " keyframes, " << strip.imageBytes() / 1024 << " KiB, "
+            << (strip.fromCache() ? "loaded" : "built") << " in " << sec * 1000 << " ms ("
+            << mediaSec / sec << "x realtime)" << std::endl;
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+#ifndef THUMBNAIL_STRIP_HPP
+#define THUMBNAIL_STRIP_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "Options.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+//
+// Small pictures of a video at a fixed interval, for scrubbing previews.
+//
+// Only keyframes are decoded. The marks are split into time ranges handed
+// to a pool of workers, each with its own format and codec context; for
+// every mark a worker seeks to the keyframe at or before it, decodes just
+// that picture (the codec discards everything that isn't a keyframe),
+// scales it and compresses it to JPEG. Marks sharing a keyframe share the
+// picture.
+//
+// The strip is cached in a sidecar next to the input, keyed on the file's
+// size and modification time and on the interval and thumbnail size.
+//
+class ThumbnailStrip
+{
+public:
+    struct Mark
+    {
+        // Where the mark is, and the keyframe shown for it
+        sf::Int64 ptsMs;
+        sf::Int64 keyframeMs;
+        // Into the images; -1 if no keyframe could be decoded there
+        sf::Int32 image;
+    };
+
+    // Thumbnails fit in maxWidth x maxHeight with the source's aspect ratio
+    ThumbnailStrip(const std::string& path, sf::Int64 intervalMs, int maxWidth, int maxHeight);
+
+    // Loads the cache or builds the strip with that many workers, 0 for
+    // one per core. Blocks until done.
+    bool generate(unsigned workers);
+
+    size_t size() const
+    {
+        return m_marks.size();
+    }
+
+    const Mark& mark(size_t index) const
+    {
+        return m_marks[index];
+    }
+
+    // Mark at or before ms
+    size_t indexAt(sf::Int64 ms) const;
+
+    // Decodes the thumbnail of a mark
+    bool loadImage(size_t index, sf::Image& image) const;
+
+    int width() const
+    {
+        return m_width;
+    }
+
+    int height() const
+    {
+        return m_height;
+    }
+
+    // Distinct pictures and their total compressed size
+    size_t imageCount() const
+    {
+        return m_images.size();
+    }
+
+    size_t imageBytes() const;
+
+    // Whether the last generate() was served by the sidecar
+    bool fromCache() const
+    {
+        return m_fromCache;
+    }
+
+private:
+    bool probe(int& videoStream, sf::Int64& durationMs);
+    bool loadCache();
+    void saveCache() const;
+
+    std::string m_path;
+    std::string m_cachePath;
+    sf::Int64 m_intervalMs;
+    int m_maxWidth;
+    int m_maxHeight;
+    int m_width;
+    int m_height;
+    bool m_fromCache;
+
+    std::vector<Mark> m_marks;
+    std::vector<std::vector<sf::Uint8> > m_images;
+};
+
+// Builds (or loads) the strip of every input and prints how long it took
+int runThumbnails(const PlayerOptions& options, std::ostream& out);
+
+#endif
@@ -0,0 +1,162 @@
+#include "Trace.hpp"
+
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+
+std::atomic<bool> g_traceEnabled(false);
+
+namespace
+{
+    // Keeps a forgotten trace from eating all memory: about 40 MB per thread
+    const size_t MaxEventsPerThread = 1 << 20;
+
+    struct TraceEvent
+    {
+        const char* name;
+        const char* argName;
+        sf::Int64 ts;
+        sf::Int64 value;
+        char phase;
+    };
+
+    struct ThreadBuffer
+    {
+        int tid;
+        const char* name;
+        std::vector<TraceEvent> events;
+        size_t dropped;
+    };
+
+    std::mutex g_registryMut;
+    std::vector<std::unique_ptr<ThreadBuffer> > g_buffers;
+    std::ofstream g_traceFile;
+    std::chrono::steady_clock::time_point g_traceOrigin;
+
+    // Owned by g_buffers so events survive the thread that recorded them.
+    // __thread rather than thread_local, which older Apple toolchains lack.
+    // Only threads that record while a trace is on get one, and it starts
+    // empty: untraced runs start and end threads freely, the wall and its
+    // benchmark hundreds of them.
+    __thread ThreadBuffer* t_buffer = NULL;
+
+    ThreadBuffer* threadBuffer()
+    {
+        if(!t_buffer)
+        {
+            std::lock_guard<std::mutex> lk(g_registryMut);
+            std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+            buffer->tid = (int)g_buffers.size() + 1;
+            buffer->name = NULL;
+            buffer->dropped = 0;
+            t_buffer = buffer.get();
+            g_buffers.push_back(std::move(buffer));
+        }
+        return t_buffer;
+    }
+
+    sf::Int64 sinceOrigin(std::chrono::steady_clock::time_point t)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t - g_traceOrigin).count();
+    }
+
+    void append(const TraceEvent& e)
+    {
+        if(!traceEnabled())
+            return;
+
+        ThreadBuffer* buffer = threadBuffer();
+        if(buffer->events.size() < MaxEventsPerThread)
+            buffer->events.push_back(e);
+        else
+            ++buffer->dropped;
+    }
+
+}
+
+bool startTrace(const std::string& path)
+{
+    g_traceFile.open(path.c_str());
+    if(!g_traceFile)
+    {
+        std::cerr << "couldn't create trace file " << path << std::endl;
+        return false;
+    }
+
+    g_traceOrigin = std::chrono::steady_clock::now();
+    g_traceEnabled = true;
+    return true;
+}
+
+void finishTrace()
+{
+    if(!g_traceEnabled.exchange(false))
+        return;
+
+    std::lock_guard<std::mutex> lk(g_registryMut);
+    std::ostream& out = g_traceFile;
+
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    size_t dropped = 0;
+    for (const auto& buffer : g_buffers)
+    {
+        if(buffer->name)
+        {
+            out << (first ? "" : ",\n")
+                << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"name\":\"thread_name\",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+            first = false;
+        }
+
+        for (const auto& e : buffer->events)
+        {
+            out << (first ? "" : ",\n")
+                << "{\"ph\":\"" << e.phase << "\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"name\":\"" << e.name << "\",\"ts\":" << e.ts;
+            if(e.phase == 'X')
+                out << ",\"dur\":" << e.value;
+            else
+                out << ",\"s\":\"t\",\"args\":{\"" << e.argName << "\":" << e.value << "}";
+            out << "}";
+            first = false;
+        }
+
+        dropped += buffer->dropped;
+        std::vector<TraceEvent>().swap(buffer->events);
+        buffer->dropped = 0;
+    }
+    out << "\n]}\n";
+    g_traceFile.close();
+
+    if(dropped)
+        std::cerr << "trace: " << dropped << " events dropped, buffers full" << std::endl;
+}
+
+void traceThreadName(const char* name)
+{
+    // Cheap enough to call from callbacks that don't own their thread
+    if(!traceEnabled())
+        return;
+
+    ThreadBuffer* buffer = threadBuffer();
+    if(buffer->name == name)
+        return;
+
+    std::lock_guard<std::mutex> lk(g_registryMut);
+    buffer->name = name;
+}
+
+void traceComplete(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    TraceEvent e = { name, NULL, sinceOrigin(start), sinceOrigin(end) - sinceOrigin(start), 'X' };
+    append(e);
+}
+
+void traceInstant(const char* name, const char* argName, sf::Int64 value)
+{
+    TraceEvent e = { name, argName, sinceOrigin(std::chrono::steady_clock::now()), value, 'i' };
+    append(e);
+}
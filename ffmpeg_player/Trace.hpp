@@ -0,0 +1,42 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <SFML/Config.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+//
+// Optional session trace in Chrome trace-event JSON, for chrome://tracing or
+// Perfetto.
+//
+// Every thread appends to its own buffer without locking; the file is only
+// written by finishTrace(), once the pipeline threads have been stopped.
+//
+
+// Starts recording. The file is created right away so a bad path fails early.
+bool startTrace(const std::string& path);
+
+// Writes everything recorded so far and stops recording.
+void finishTrace();
+
+extern std::atomic<bool> g_traceEnabled;
+
+inline bool traceEnabled()
+{
+    return g_traceEnabled.load(std::memory_order_relaxed);
+}
+
+// Labels the calling thread's row in the viewer. name must be a string
+// literal.
+void traceThreadName(const char* name);
+
+// A span on the calling thread. name must be a string literal or otherwise
+// outlive the trace.
+void traceComplete(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+// A point event with one integer argument, e.g. a seek and its target
+void traceInstant(const char* name, const char* argName, sf::Int64 value);
+
+#endif
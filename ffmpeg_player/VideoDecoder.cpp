@@ -0,0 +1,362 @@
+#include "VideoDecoder.hpp"
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+// A frame this far behind the clock is dropped before conversion
+const int64_t LateDropMs = 40;
+// ... but never this many in a row, so the picture keeps moving
+const int MaxConsecutiveDrops = 8;
+// Lag sustained over this many frames makes the codec skip non-reference
+// frames, until the lag falls back under CaughtUpMs
+const int64_t SkipNonRefLagMs = 150;
+const int SkipNonRefAfterFrames = 12;
+const int64_t CaughtUpMs = 20;
+// Scaling gets one step cheaper after this many late frames in a row, and
+// one step better after this many on time
+const int CheaperFilterAfterFrames = 6;
+const int BetterFilterAfterFrames = 250;
+
+VideoDecoder::VideoDecoder(AVStream* stream, PacketQueue& packets, FrameQueue& frames, bool convert, const SyncClock* clock, RgbaConverter::Path convertPath)
+: m_stream(stream)
+, m_codecCtx(stream->codec)
+, m_packets(packets)
+, m_frames(frames)
+, m_converter(m_codecCtx->width, m_codecCtx->height, m_codecCtx->pix_fmt, convertPath)
+, m_maxWidth(m_codecCtx->width)
+, m_maxHeight(m_codecCtx->height)
+, m_outputSize(m_codecCtx->width << 16 | m_codecCtx->height)
+, m_filter(RgbaConverter::BilinearFilter)
+, m_behindStreak(0)
+, m_onTimeStreak(0)
+, m_startTime(stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0)
+, m_serial(packets.serial())
+, m_convert(convert)
+, m_seekTargetMs(-1)
+, m_seekDiscards(0)
+, m_clock(clock)
+, m_lagStreak(0)
+, m_lagging(false)
+, m_consecutiveDrops(0)
+, m_lateDrops(0)
+, m_nonRefSkips(0)
+, m_decodeStats("video decode")
+, m_scaleStats("video scale")
+, m_quit(false)
+, m_finished(false)
+{
+    m_frame = av_frame_alloc();
+}
+
+VideoDecoder::~VideoDecoder()
+{
+    stop();
+
+    av_frame_free(&m_frame);
+}
+
+void VideoDecoder::start()
+{
+    m_quit = false;
+    m_thread = std::thread(&VideoDecoder::run, this);
+}
+
+void VideoDecoder::stop()
+{
+    m_quit = true;
+
+    // Unblock the thread wherever it waits
+    m_packets.abort();
+    m_frames.abort();
+
+    if(m_thread.joinable())
+        m_thread.join();
+}
+
+void VideoDecoder::setOutputSize(int width, int height)
+{
+    width = std::max(1, std::min(width, m_maxWidth));
+    height = std::max(1, std::min(height, m_maxHeight));
+    m_outputSize = width << 16 | height;
+}
+
+void VideoDecoder::run()
+{
+    traceThreadName("video decoder");
+
+    while (!m_quit)
+    {
+        PacketHandle packet;
+        int serial = 0;
+
+        if(!m_packets.pop(packet, serial))
+        {
+            if(!m_finished && !m_quit)
+            {
+                // Get the frames still buffered in the codec out
+                AVPacket flushPacket;
+                av_init_packet(&flushPacket);
+                flushPacket.data = NULL;
+                flushPacket.size = 0;
+                while (decodePacket(&flushPacket)) {}
+
+                m_finished = true;
+            }
+
+            // Wait for a seek to bring more packets in
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        m_finished = false;
+        decodeNext(packet.get(), serial);
+    }
+}
+
+bool VideoDecoder::hasWork() const
+{
+    // The frame a packet decodes to must not wait for a slot
+    if(m_frames.size() >= m_frames.depth())
+        return false;
+
+    return !m_packets.isEmpty() || (!m_finished && m_packets.isFinished());
+}
+
+bool VideoDecoder::decodeStep()
+{
+    if(m_frames.size() >= m_frames.depth())
+        return false;
+
+    PacketHandle packet;
+    int serial = 0;
+    if(!m_packets.tryPop(packet, serial))
+    {
+        if(m_finished || !m_packets.isFinished())
+            return false;
+
+        // One buffered frame per step, until the codec is empty
+        AVPacket flushPacket;
+        av_init_packet(&flushPacket);
+        flushPacket.data = NULL;
+        flushPacket.size = 0;
+        if(!decodePacket(&flushPacket))
+            m_finished = true;
+        return true;
+    }
+
+    m_finished = false;
+    decodeNext(packet.get(), serial);
+    return true;
+}
+
+void VideoDecoder::decodeNext(AVPacket* packet, int serial)
+{
+    if(serial != m_serial)
+    {
+        // First packet after a seek
+        avcodec_flush_buffers(m_codecCtx);
+        m_serial = serial;
+        m_seekTargetMs = m_packets.seekTargetMs(serial);
+        setLagging(false);
+    }
+
+    updateSkipFrame(packet);
+    decodePacket(packet);
+}
+
+bool VideoDecoder::decodePacket(AVPacket* packet)
+{
+    int frameFinished = 0;
+
+    do {
+        int decodedLength = 0;
+        {
+            StageTimer timer(m_decodeStats);
+            decodedLength = avcodec_decode_video2(m_codecCtx, m_frame, &frameFinished, packet);
+        }
+        if(decodedLength < 0)
+            return false;
+
+        if(frameFinished && !queueFrame())
+            return false;
+
+        packet->data += decodedLength;
+        packet->size -= decodedLength;
+    }while (packet->size > 0);
+
+    return frameFinished != 0;
+}
+
+bool VideoDecoder::queueFrame()
+{
+    int64_t timestamp = av_frame_get_best_effort_timestamp(m_frame);
+    const int64_t ptsMs = 1000 * (timestamp - m_startTime) * av_q2d(m_stream->time_base);
+
+    if(m_seekTargetMs >= 0)
+    {
+        if(ptsMs < m_seekTargetMs)
+        {
+            ++m_seekDiscards;
+            return true;
+        }
+        m_seekTargetMs = -1;
+    }
+
+    if(dropLateFrame(ptsMs))
+        return true;
+
+    VideoFrame* frame = m_frames.peekWritable();
+    if(!frame)
+        return false;
+
+    if(m_convert)
+    {
+        StageTimer timer(m_scaleStats);
+
+        if(m_frame->width != m_converter.sourceWidth() || m_frame->height != m_converter.sourceHeight()
+           || m_frame->format != m_converter.sourceFormat())
+        {
+            sourceChanged();
+        }
+
+        const sf::Uint32 size = m_outputSize;
+        int width = size >> 16;
+        int height = size & 0xFFFF;
+        if((size_t)width * height > m_frames.pixelCapacity())
+        {
+            // Never past the queue's buffers, whatever the window asked for
+            // after the stream changed shape
+            const double scale = std::sqrt((double)m_frames.pixelCapacity() / ((double)width * height));
+            width = std::max(1, (int)(width * scale));
+            height = std::max(1, (int)(height * scale));
+        }
+        m_converter.setOutput(width, height, (RgbaConverter::Filter)m_filter.load());
+
+        // Writes RGBA with opaque alpha straight into the frame queue buffer
+        m_converter.convert(m_frame, frame->pixels, m_converter.outputWidth() * 4);
+    }
+
+    frame->width = m_converter.outputWidth();
+    frame->height = m_converter.outputHeight();
+    frame->ptsMs = ptsMs;
+    frame->serial = m_serial;
+
+    m_frames.push();
+    return true;
+}
+
+void VideoDecoder::sourceChanged()
+{
+    av_log(NULL, AV_LOG_INFO, "video changed midstream to %dx%d %s\n", m_frame->width, m_frame->height,
+           av_get_pix_fmt_name((AVPixelFormat)m_frame->format));
+
+    // The frame queue's buffers stay as they are, so the new picture is
+    // fitted inside the current output size rather than converted at its own
+    const sf::Uint32 size = m_outputSize;
+    int width = size >> 16;
+    int height = size & 0xFFFF;
+    if((int64_t)width * m_frame->height > (int64_t)height * m_frame->width)
+        width = (int)((int64_t)height * m_frame->width / m_frame->height);
+    else
+        height = (int)((int64_t)width * m_frame->height / m_frame->width);
+    m_outputSize = std::max(1, width) << 16 | std::max(1, height);
+
+    m_converter.setSource(m_frame->width, m_frame->height, (AVPixelFormat)m_frame->format);
+}
+
+bool VideoDecoder::dropLateFrame(int64_t ptsMs)
+{
+    // Before the first frame after a seek is presented the clock still
+    // belongs to the old position
+    if(!m_clock || m_clock->serial() != m_serial)
+        return false;
+
+    // Rewinding, frames fall behind as the clock drops below them
+    const int64_t lag = m_clock->rate() < 0 ? ptsMs - m_clock->masterMs() : m_clock->masterMs() - ptsMs;
+    adaptScaleFilter(lag);
+
+    if(lag > SkipNonRefLagMs)
+    {
+        if(++m_lagStreak >= SkipNonRefAfterFrames)
+            setLagging(true);
+    }
+    else
+    {
+        m_lagStreak = 0;
+        if(lag < CaughtUpMs)
+            setLagging(false);
+    }
+
+    if(lag <= LateDropMs || m_consecutiveDrops >= MaxConsecutiveDrops)
+    {
+        m_consecutiveDrops = 0;
+        return false;
+    }
+
+    ++m_consecutiveDrops;
+    ++m_lateDrops;
+    return true;
+}
+
+void VideoDecoder::setLagging(bool lagging)
+{
+    if(lagging == m_lagging)
+        return;
+
+    m_lagging = lagging;
+    if(lagging)
+    {
+        ++m_nonRefSkips;
+        av_log(NULL, AV_LOG_VERBOSE, "video decoder lagging, skipping non-reference frames\n");
+    }
+}
+
+void VideoDecoder::updateSkipFrame(const AVPacket* packet)
+{
+    // Nothing refers to a non-reference picture, so one that shows before
+    // the seek target need not be decoded at all. Packets without a pts
+    // might be the target and are decoded.
+    bool beforeTarget = false;
+    if(m_seekTargetMs >= 0 && packet->pts != AV_NOPTS_VALUE)
+    {
+        const int64_t ptsMs = 1000 * (packet->pts - m_startTime) * av_q2d(m_stream->time_base);
+        beforeTarget = ptsMs < m_seekTargetMs;
+    }
+
+    m_codecCtx->skip_frame = (m_lagging || beforeTarget) ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+
+void VideoDecoder::adaptScaleFilter(int64_t lag)
+{
+    int filter = m_filter;
+
+    if(lag > LateDropMs)
+    {
+        m_onTimeStreak = 0;
+        if(++m_behindStreak >= CheaperFilterAfterFrames && filter < RgbaConverter::PointFilter)
+        {
+            ++filter;
+            m_behindStreak = 0;
+        }
+    }
+    else if(lag <= 0)
+    {
+        m_behindStreak = 0;
+        if(++m_onTimeStreak >= BetterFilterAfterFrames && filter > RgbaConverter::BilinearFilter)
+        {
+            --filter;
+            m_onTimeStreak = 0;
+        }
+    }
+
+    if(filter != m_filter)
+    {
+        av_log(NULL, AV_LOG_VERBOSE, "video scaling filter now %s\n", RgbaConverter::filterName((RgbaConverter::Filter)filter));
+        m_filter = filter;
+    }
+}
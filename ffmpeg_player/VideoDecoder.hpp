@@ -0,0 +1,160 @@
+#ifndef VIDEO_DECODER_HPP
+#define VIDEO_DECODER_HPP
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "PacketQueue.hpp"
+#include "FrameQueue.hpp"
+#include "StageStats.hpp"
+#include "SyncClock.hpp"
+#include "RgbaConverter.hpp"
+
+#include <thread>
+#include <atomic>
+
+//
+// Decoder thread for the video stream. Pops packets from the video
+// PacketQueue, decodes and converts them to RGBA and fills the FrameQueue
+// ahead of presentation. Blocks when the FrameQueue is full.
+//
+// With convert off the RGBA conversion is skipped and frames carry only
+// their timestamp, which is what the headless benchmark uses to measure raw
+// codec throughput.
+//
+// Given a clock, frames that are already late against it are dropped before
+// conversion, and while the lag persists the codec skips non-reference
+// frames altogether.
+//
+// The output size follows setOutputSize() and the scaling filter gets
+// cheaper while the decoder lags behind the clock, and better again once it
+// has kept up for a while.
+//
+// Instead of running its own thread the decoder can be driven by a
+// WorkPool, one decodeStep() at a time.
+//
+// Frames that change size or pixel format midway, as live streams may,
+// are converted to fit the output size the stream started with.
+//
+// After a seek with an exact target the decoder runs forward from the
+// keyframe, skipping non-reference pictures before the target and dropping
+// the rest unconverted, so the first frame queued is the one asked for.
+//
+class VideoDecoder
+{
+public:
+    VideoDecoder(AVStream* stream, PacketQueue& packets, FrameQueue& frames, bool convert = true, const SyncClock* clock = NULL, RgbaConverter::Path convertPath = RgbaConverter::AutoPath);
+    ~VideoDecoder();
+
+    void start();
+    void stop();
+
+    // Pooled decoding, instead of start(): decodes one packet, or drains
+    // one frame at EOF, without blocking. Returns false if there was
+    // nothing to do. Calls must not overlap.
+    bool decodeStep();
+
+    // A decodeStep() would do something
+    bool hasWork() const;
+
+    // Size frames are converted to from the next frame on, clamped to the
+    // source size. Callable from any thread.
+    void setOutputSize(int width, int height);
+
+    // True once every packet up to EOF has been decoded and queued
+    bool isFinished() const
+    {
+        return m_finished;
+    }
+
+    const StageStats& decodeStats() const
+    {
+        return m_decodeStats;
+    }
+
+    const RgbaConverter& converter() const
+    {
+        return m_converter;
+    }
+
+    const StageStats& scaleStats() const
+    {
+        return m_scaleStats;
+    }
+
+    // Frames decoded but dropped unconverted because they were late
+    sf::Uint64 lateDrops() const
+    {
+        return m_lateDrops;
+    }
+
+    // Frames decoded on the way from a keyframe to an exact seek target
+    sf::Uint64 seekDiscards() const
+    {
+        return m_seekDiscards;
+    }
+
+    RgbaConverter::Filter scaleFilter() const
+    {
+        return (RgbaConverter::Filter)m_filter.load();
+    }
+
+    // Number of times the codec was switched to skipping non-reference frames
+    sf::Uint64 nonRefSkips() const
+    {
+        return m_nonRefSkips;
+    }
+
+private:
+    void run();
+    void decodeNext(AVPacket* packet, int serial);
+    bool decodePacket(AVPacket* packet);
+    bool queueFrame();
+    void sourceChanged();
+    bool dropLateFrame(int64_t ptsMs);
+    void adaptScaleFilter(int64_t lag);
+    void setLagging(bool lagging);
+    void updateSkipFrame(const AVPacket* packet);
+
+    AVStream* m_stream;
+    AVCodecContext* m_codecCtx;
+    PacketQueue& m_packets;
+    FrameQueue& m_frames;
+
+    AVFrame* m_frame;
+    RgbaConverter m_converter;
+    // The frame queue's buffers are sized for the stream as opened; the
+    // output never grows past that, whatever the stream changes to
+    const int m_maxWidth;
+    const int m_maxHeight;
+    // Packed as width << 16 | height so both change together
+    std::atomic<sf::Uint32> m_outputSize;
+    std::atomic<int> m_filter;
+    int m_behindStreak;
+    int m_onTimeStreak;
+    int64_t m_startTime;
+    int m_serial;
+    bool m_convert;
+
+    // Exact seek target of the current serial, -1 once it has been reached
+    int64_t m_seekTargetMs;
+    std::atomic<sf::Uint64> m_seekDiscards;
+
+    const SyncClock* m_clock;
+    int m_lagStreak;
+    bool m_lagging;
+    int m_consecutiveDrops;
+    std::atomic<sf::Uint64> m_lateDrops;
+    std::atomic<sf::Uint64> m_nonRefSkips;
+
+    StageStats m_decodeStats;
+    StageStats m_scaleStats;
+
+    std::thread m_thread;
+    std::atomic<bool> m_quit;
+    std::atomic<bool> m_finished;
+};
+
+#endif
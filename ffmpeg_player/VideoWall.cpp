@@ -0,0 +1,492 @@
+#include "VideoWall.hpp"
+#include "Trace.hpp"
+
+#include <SFML/Graphics.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <cstdlib>
+#include <thread>
+
+// Decode steps a tile task runs before it goes back in the queue, so one
+// tile can't hold a worker while others of higher priority wait
+const int StepsPerTask = 4;
+// A visible tile whose clock is this far past its last presented frame
+// drops most of what it decodes anyway; it gets no more than the rest
+const sf::Int64 FarBehindMs = 500;
+// Each tile queues far less than a single file played full screen
+const size_t TileMemoryBudget = 8 << 20;
+const size_t TileReadAheadBytes = 2 << 20;
+
+// Wall benchmark: tiles are converted at this size, the size of a cell of
+// a 4x4 wall on a 1080p screen
+const unsigned BenchTileWidth = 480;
+const unsigned BenchTileHeight = 270;
+// Measured for this long after a warmup, which covers opening the files
+// and the first decode bursts filling the queues
+const int BenchWarmupMs = 2000;
+const int BenchTrialMs = 8000;
+// A trial passes when every stream presents this share of its frames
+const double BenchOnTimeRatio = 0.95;
+const size_t BenchMaxStreams = 256;
+const int BenchPresentIntervalMs = 4;
+
+VideoWall::VideoWall(const PlayerOptions& options, WorkPool& pool)
+: m_options(options)
+, m_pool(pool)
+, m_stopping(false)
+{
+    // Tiles are decoded one step at a time on the pool, without audio or
+    // seeking other than looping back to the start
+    m_options.audio = false;
+    m_options.seekIndex = false;
+    m_options.videoThreading.threads = 1;
+    if(m_options.memoryBudget == 0 || m_options.memoryBudget > TileMemoryBudget)
+        m_options.memoryBudget = TileMemoryBudget;
+    m_options.readAheadBytes = std::min(m_options.readAheadBytes, TileReadAheadBytes);
+}
+
+VideoWall::~VideoWall()
+{
+    stop();
+}
+
+bool VideoWall::open(const std::vector<std::string>& paths, size_t count, const sf::Vector2u& maxTileSize)
+{
+    for (size_t i = 0; i < count && !paths.empty(); ++i)
+    {
+        std::unique_ptr<Tile> tile(new Tile);
+        tile->clock.reset(new SyncClock(SyncClock::ExternalMaster));
+        tile->item.reset(new PlaybackItem(m_options));
+        tile->item->setMaxOutputSize(maxTileSize);
+        tile->item->setPooledDecoding(true);
+        tile->queued = false;
+        tile->visible = false;
+        tile->presentedPtsMs = 0;
+        tile->presentedSerial = -1;
+        tile->looping = false;
+        tile->presented = 0;
+        tile->skipped = 0;
+
+        const std::string& path = paths[i % paths.size()];
+        if(!tile->item->open(path, tile->clock.get()))
+        {
+            std::cerr << path << ": can't open, left off the wall" << std::endl;
+            continue;
+        }
+        m_tiles.push_back(std::move(tile));
+    }
+
+    return !m_tiles.empty();
+}
+
+void VideoWall::start()
+{
+    m_stopping = false;
+    for (auto& tile : m_tiles)
+        tile->item->start();
+}
+
+void VideoWall::stop()
+{
+    // Running tasks finish their steps without queueing more
+    m_stopping = true;
+    m_pool.waitIdle();
+
+    for (auto& tile : m_tiles)
+        tile->item->stop();
+}
+
+void VideoWall::setTileSize(const sf::Vector2u& size)
+{
+    for (auto& tile : m_tiles)
+        tile->item->setWindowSize(size);
+}
+
+void VideoWall::schedule(size_t firstVisible, size_t visibleCount)
+{
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        Tile& tile = *m_tiles[i];
+        tile.visible = i >= firstVisible && i < firstVisible + visibleCount;
+
+        if(tile.queued || !tile.item->videoDecoder().hasWork())
+            continue;
+
+        tile.queued = true;
+        m_pool.submit([this, i]{ runTile(i); }, priorityOf(tile), (unsigned)i);
+    }
+}
+
+void VideoWall::runTile(size_t index)
+{
+    Tile& tile = *m_tiles[index];
+    VideoDecoder& decoder = tile.item->videoDecoder();
+
+    for (int step = 0; step < StepsPerTask && !m_stopping; ++step)
+    {
+        if(!decoder.decodeStep())
+            break;
+    }
+
+    // Requeued with the priority it has now rather than kept on the
+    // worker, so a tile that caught up makes way for the others
+    if(!m_stopping && decoder.hasWork())
+        m_pool.submit([this, index]{ runTile(index); }, priorityOf(tile), (unsigned)index);
+    else
+        tile.queued = false;
+}
+
+WorkPool::Priority VideoWall::priorityOf(const Tile& tile) const
+{
+    if(!tile.visible)
+        return WorkPool::Low;
+
+    // Before its first frame the clock means nothing
+    if(tile.clock->serial() < 0)
+        return WorkPool::High;
+
+    if(tile.item->videoFrames().size() > 0)
+        return WorkPool::Normal;
+
+    // About to run dry, unless it is too far behind to catch up soon
+    if(tile.clock->masterMs() - tile.presentedPtsMs > FarBehindMs)
+        return WorkPool::Low;
+    return WorkPool::High;
+}
+
+bool VideoWall::present(size_t index, const FrameSink& sink)
+{
+    Tile& tile = *m_tiles[index];
+    PlaybackItem& item = *tile.item;
+    FrameQueue& frames = item.videoFrames();
+
+    // Frames from before the latest loop are of no use
+    const int serial = item.videoPackets().serial();
+    VideoFrame* frame = frames.peek();
+    while (frame && frame->serial != serial)
+    {
+        frames.next();
+        frame = frames.peek();
+    }
+
+    if(!frame)
+    {
+        if(!tile.looping && item.isFinished())
+        {
+            tile.looping = true;
+            item.demuxer().seek(0);
+        }
+        return false;
+    }
+
+    if(frame->serial != tile.presentedSerial)
+    {
+        // First frame of the file or of a loop
+        tile.clock->reset(frame->serial, frame->ptsMs);
+        tile.presentedSerial = frame->serial;
+        tile.looping = false;
+    }
+    else
+    {
+        const sf::Int64 nowMs = tile.clock->masterMs();
+        if(frame->ptsMs > nowMs)
+            return false;
+
+        // Only the latest frame due is shown
+        VideoFrame* later = frames.peekNext();
+        while (later && later->serial == serial && later->ptsMs <= nowMs)
+        {
+            frames.next();
+            ++tile.skipped;
+            frame = later;
+            later = frames.peekNext();
+        }
+    }
+
+    if(sink)
+        sink(*frame);
+
+    tile.presentedPtsMs = frame->ptsMs;
+    ++tile.presented;
+    frames.next();
+    return true;
+}
+
+VideoWall::TileStats VideoWall::stats(size_t index) const
+{
+    const Tile& tile = *m_tiles[index];
+    TileStats s = { tile.presented, tile.skipped, tile.item->videoDecoder().lateDrops() };
+    return s;
+}
+
+void VideoWall::printStats(std::ostream& out) const
+{
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        const TileStats s = stats(i);
+        out << "tile " << i << " (" << m_tiles[i]->item->media().path() << "): "
+            << s.presented << " presented, " << s.skipped << " skipped, "
+            << s.lateDrops << " dropped late" << std::endl;
+    }
+}
+
+int runVideoWall(const PlayerOptions& options)
+{
+    if(options.inputs.empty())
+    {
+        std::cerr << "--wall needs at least one input file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const size_t count = options.wallStreams > 0 ? options.wallStreams : options.inputs.size();
+    const size_t pageSize = std::max<size_t>(1, std::min<size_t>(options.wallPageSize, count));
+    const unsigned columns = (unsigned)std::ceil(std::sqrt((double)pageSize));
+    const unsigned rows = (unsigned)((pageSize + columns - 1) / columns);
+
+    // Tile buffers hold a cell of a full screen window
+    const sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
+    const sf::Vector2u maxTileSize(std::max(1u, desktop.width / columns), std::max(1u, desktop.height / rows));
+
+    WorkPool pool(options.poolThreads);
+    VideoWall wall(options, pool);
+    if(!wall.open(options.inputs, count, maxTileSize))
+        return EXIT_FAILURE;
+
+    const unsigned width = options.windowWidth > 0 ? options.windowWidth : 1280;
+    const unsigned height = options.windowHeight > 0 ? options.windowHeight : 720;
+    sf::RenderWindow window(sf::VideoMode(width, height), "Video wall");
+    window.setFramerateLimit(60);
+    traceThreadName("render");
+
+    sf::Vector2u cell(width / columns, height / rows);
+    wall.setTileSize(cell);
+    wall.start();
+
+    std::vector<std::unique_ptr<sf::Texture> > textures;
+    std::vector<sf::Sprite> sprites(wall.size());
+    for (size_t i = 0; i < wall.size(); ++i)
+    {
+        textures.push_back(std::unique_ptr<sf::Texture>(new sf::Texture));
+        textures.back()->setSmooth(true);
+    }
+
+    std::cout << wall.size() << " streams, " << pageSize << " per page, "
+              << pool.threadCount() << " pool threads" << std::endl;
+
+    size_t page = 0;
+    while (window.isOpen())
+    {
+        sf::Event event;
+        while (window.pollEvent(event))
+        {
+            if(event.type == sf::Event::Closed
+               || (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape))
+            {
+                window.close();
+            }
+            else if(event.type == sf::Event::Resized)
+            {
+                window.setView(sf::View(sf::FloatRect(0, 0, event.size.width, event.size.height)));
+                cell = sf::Vector2u(event.size.width / columns, event.size.height / rows);
+                wall.setTileSize(cell);
+            }
+            else if(event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::PageDown)
+            {
+                if((page + 1) * pageSize < wall.size())
+                    ++page;
+            }
+            else if(event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::PageUp)
+            {
+                if(page > 0)
+                    --page;
+            }
+        }
+
+        const size_t first = page * pageSize;
+        wall.schedule(first, pageSize);
+
+        // Tiles off the page keep playing, their frames thrown away
+        for (size_t i = 0; i < wall.size(); ++i)
+        {
+            const bool visible = i >= first && i < first + pageSize;
+            if(!visible)
+            {
+                wall.present(i, VideoWall::FrameSink());
+                continue;
+            }
+
+            const size_t slot = i - first;
+            wall.present(i, [&](const VideoFrame& frame)
+            {
+                sf::Texture& texture = *textures[i];
+                if(texture.getSize() != sf::Vector2u(frame.width, frame.height))
+                {
+                    texture.create(frame.width, frame.height);
+                    sprites[i].setTexture(texture, true);
+                }
+                texture.update(frame.pixels);
+
+                // Letterbox the picture in its cell
+                const float scale = std::min(cell.x / (float)frame.width, cell.y / (float)frame.height);
+                sprites[i].setScale(scale, scale);
+                sprites[i].setPosition((slot % columns) * cell.x + (cell.x - frame.width * scale) / 2,
+                                       (slot / columns) * cell.y + (cell.y - frame.height * scale) / 2);
+            });
+        }
+
+        window.clear();
+        for (size_t i = first; i < std::min(first + pageSize, wall.size()); ++i)
+        {
+            if(textures[i]->getSize().x > 0)
+                window.draw(sprites[i]);
+        }
+        window.display();
+    }
+
+    wall.stop();
+    wall.printStats(std::cout);
+    pool.printStats(std::cout);
+    return EXIT_SUCCESS;
+}
+
+namespace
+{
+    struct TrialResult
+    {
+        bool passed;
+        // Share of its frames the worst stream presented
+        double worstOnTime;
+        // CPU time used per second of the trial
+        double coresBusy;
+    };
+
+    TrialResult runTrial(const PlayerOptions& options, WorkPool& pool, size_t streams)
+    {
+        TrialResult result = { false, 0, 0 };
+
+        VideoWall wall(options, pool);
+        const sf::Vector2u tileSize(BenchTileWidth, BenchTileHeight);
+        if(!wall.open(options.inputs, streams, tileSize) || wall.size() < streams)
+            return result;
+
+        wall.setTileSize(tileSize);
+        wall.start();
+
+        // Presents every stream, unseen, until the deadline
+        auto runUntil = [&](std::chrono::steady_clock::time_point deadline)
+        {
+            while (std::chrono::steady_clock::now() < deadline)
+            {
+                wall.schedule(0, streams);
+                for (size_t i = 0; i < streams; ++i)
+                    wall.present(i, VideoWall::FrameSink());
+                std::this_thread::sleep_for(std::chrono::milliseconds(BenchPresentIntervalMs));
+            }
+        };
+
+        const auto start = std::chrono::steady_clock::now();
+        runUntil(start + std::chrono::milliseconds(BenchWarmupMs));
+
+        std::vector<VideoWall::TileStats> before;
+        for (size_t i = 0; i < streams; ++i)
+            before.push_back(wall.stats(i));
+        const std::clock_t cpuStart = std::clock();
+        const auto measureStart = std::chrono::steady_clock::now();
+
+        runUntil(measureStart + std::chrono::milliseconds(BenchTrialMs));
+
+        const double cpuSec = (std::clock() - cpuStart) / (double)CLOCKS_PER_SEC;
+        const double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - measureStart).count();
+        wall.stop();
+
+        result.worstOnTime = 1;
+        for (size_t i = 0; i < streams; ++i)
+        {
+            const VideoWall::TileStats after = wall.stats(i);
+            const double presented = after.presented - before[i].presented;
+            const double missed = (after.skipped - before[i].skipped) + (after.lateDrops - before[i].lateDrops);
+            const double onTime = presented + missed > 0 ? presented / (presented + missed) : 0;
+            result.worstOnTime = std::min(result.worstOnTime, onTime);
+        }
+        result.coresBusy = cpuSec / wallSec;
+        result.passed = result.worstOnTime >= BenchOnTimeRatio;
+        return result;
+    }
+}
+
+int runWallBenchmark(const PlayerOptions& options, std::ostream& out)
+{
+    if(options.inputs.empty())
+    {
+        out << "--wall-bench needs at least one input file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    WorkPool pool(options.poolThreads);
+
+    std::string source = options.inputs[0];
+    {
+        MediaFile media;
+        if(media.open(options.inputs[0], options) && media.videoStream())
+        {
+            const AVCodecContext* codecCtx = media.videoStream()->codec;
+            source += " (" + std::to_string(codecCtx->width) + "x" + std::to_string(codecCtx->height) + ")";
+        }
+    }
+    out << "wall benchmark: " << source << ", " << BenchTileWidth << "x" << BenchTileHeight
+        << " tiles, " << pool.threadCount() << " pool threads" << std::endl;
+    out << std::fixed << std::setprecision(2);
+
+    size_t best = 0;
+    double bestCores = 0;
+    auto trial = [&](size_t streams)
+    {
+        const TrialResult r = runTrial(options, pool, streams);
+        out << "  " << streams << " streams: worst " << r.worstOnTime * 100 << "% on time, "
+            << r.coresBusy << " cores busy" << (r.passed ? "" : " (fail)") << std::endl;
+        if(r.passed && streams > best)
+        {
+            best = streams;
+            bestCores = r.coresBusy;
+        }
+        return r.passed;
+    };
+
+    // Double until a trial fails, then bisect between the last pass and it
+    size_t failed = 0;
+    for (size_t streams = 1; streams <= BenchMaxStreams; streams *= 2)
+    {
+        if(!trial(streams))
+        {
+            failed = streams;
+            break;
+        }
+    }
+
+    size_t low = best;
+    size_t high = failed;
+    while (failed && high - low > 1)
+    {
+        const size_t mid = (low + high) / 2;
+        if(trial(mid))
+            low = mid;
+        else
+            high = mid;
+    }
+
+    if(!best)
+    {
+        out << "not even one stream plays on time" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    out << best << " streams on time" << (failed ? "" : " (limit not reached)") << ", "
+        << best / (double)pool.threadCount() << " per core, " << bestCores << " cores busy" << std::endl;
+    pool.printStats(out);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+#ifndef VIDEO_WALL_HPP
+#define VIDEO_WALL_HPP
+
+#include <SFML/System.hpp>
+
+#include "PlaybackItem.hpp"
+#include "SyncClock.hpp"
+#include "WorkPool.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//
+// Many files playing at once, for monitoring. Each tile is a PlaybackItem
+// with its own demuxer thread and clock but no decoder thread: decoding and
+// conversion for every tile run as tasks on one shared WorkPool.
+//
+// Tiles not on screen, and tiles so far behind that their frames would be
+// dropped anyway, are decoded at low priority; a visible tile about to run
+// out of frames at high priority. Files loop, and there is no audio.
+//
+class VideoWall
+{
+public:
+    typedef std::function<void(const VideoFrame&)> FrameSink;
+
+    struct TileStats
+    {
+        sf::Uint64 presented;
+        // Due at once with a later frame and passed over
+        sf::Uint64 skipped;
+        // Dropped by the decoder before conversion
+        sf::Uint64 lateDrops;
+    };
+
+    VideoWall(const PlayerOptions& options, WorkPool& pool);
+    ~VideoWall();
+
+    // Opens count tiles, going round paths. Tiles are converted to at most
+    // maxTileSize. Returns false if none could be opened.
+    bool open(const std::vector<std::string>& paths, size_t count, const sf::Vector2u& maxTileSize);
+
+    void start();
+
+    // Waits for the tile tasks to finish and stops every tile
+    void stop();
+
+    void setTileSize(const sf::Vector2u& size);
+
+    // Queues a decode task for every tile that has work and none queued.
+    // Tiles outside [firstVisible, firstVisible + visibleCount) are off
+    // screen. Call from the render loop.
+    void schedule(size_t firstVisible, size_t visibleCount);
+
+    // Hands the tile's frame due now to sink, which may be empty for a tile
+    // off screen, and takes it off the queue. Returns whether there was one.
+    bool present(size_t tile, const FrameSink& sink);
+
+    size_t size() const
+    {
+        return m_tiles.size();
+    }
+
+    const PlaybackItem& item(size_t tile) const
+    {
+        return *m_tiles[tile]->item;
+    }
+
+    TileStats stats(size_t tile) const;
+
+    void printStats(std::ostream& out) const;
+
+private:
+    VideoWall(const VideoWall&);
+    VideoWall& operator=(const VideoWall&);
+
+    struct Tile
+    {
+        std::unique_ptr<SyncClock> clock;
+        std::unique_ptr<PlaybackItem> item;
+        std::atomic<bool> queued;
+        std::atomic<bool> visible;
+        std::atomic<sf::Int64> presentedPtsMs;
+        int presentedSerial;
+        bool looping;
+        sf::Uint64 presented;
+        sf::Uint64 skipped;
+    };
+
+    void runTile(size_t index);
+    WorkPool::Priority priorityOf(const Tile& tile) const;
+
+    // Tile items keep a reference to these
+    PlayerOptions m_options;
+    WorkPool& m_pool;
+    std::atomic<bool> m_stopping;
+    std::vector<std::unique_ptr<Tile> > m_tiles;
+};
+
+// Plays the inputs tiled in one window; --wall-streams repeats them
+int runVideoWall(const PlayerOptions& options);
+
+// Finds how many copies of the inputs play on time together on the pool
+// and prints the streams per core
+int runWallBenchmark(const PlayerOptions& options, std::ostream& out);
+
+#endif
@@ -0,0 +1,132 @@
+#include "WorkPool.hpp"
+
+#include "Trace.hpp"
+
+#include <algorithm>
+
+WorkPool::WorkPool(unsigned threads)
+: m_queued(0)
+, m_pending(0)
+, m_quit(false)
+, m_tasksRun(0)
+, m_steals(0)
+{
+    if(threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int p = 0; p < PriorityCount; ++p)
+        m_byPriority[p] = 0;
+
+    for (unsigned i = 0; i < threads; ++i)
+        m_workers.push_back(std::unique_ptr<Worker>(new Worker));
+
+    for (unsigned i = 0; i < threads; ++i)
+        m_threads.push_back(std::thread(&WorkPool::run, this, i));
+}
+
+WorkPool::~WorkPool()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_quit = true;
+    }
+    m_wakeCond.notify_all();
+
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void WorkPool::submit(Task task, Priority priority, unsigned affinity)
+{
+    Worker& worker = *m_workers[affinity % m_workers.size()];
+    {
+        std::lock_guard<std::mutex> lk(worker.mut);
+        worker.tasks[priority].push_back(std::move(task));
+
+        // Counted once the task is there, so a worker woken for it finds
+        // it; while the queue is still locked, so nobody can take it
+        // before it is counted; and under m_mut, so a worker about to
+        // sleep can't miss it
+        std::lock_guard<std::mutex> wakeLk(m_mut);
+        ++m_pending;
+        ++m_queued;
+    }
+    ++m_byPriority[priority];
+    m_wakeCond.notify_one();
+}
+
+void WorkPool::waitIdle()
+{
+    std::unique_lock<std::mutex> lk(m_mut);
+    m_idleCond.wait(lk, [this]{ return m_pending == 0; });
+}
+
+bool WorkPool::take(unsigned index, Task& task)
+{
+    const size_t count = m_workers.size();
+
+    for (int p = 0; p < PriorityCount; ++p)
+    {
+        {
+            Worker& own = *m_workers[index];
+            std::lock_guard<std::mutex> lk(own.mut);
+            if(!own.tasks[p].empty())
+            {
+                task = std::move(own.tasks[p].front());
+                own.tasks[p].pop_front();
+                --m_queued;
+                return true;
+            }
+        }
+
+        // From the other end than the owner takes, the task the owner
+        // would have got to last
+        for (size_t i = 1; i < count; ++i)
+        {
+            Worker& victim = *m_workers[(index + i) % count];
+            std::lock_guard<std::mutex> lk(victim.mut);
+            if(!victim.tasks[p].empty())
+            {
+                task = std::move(victim.tasks[p].back());
+                victim.tasks[p].pop_back();
+                --m_queued;
+                ++m_steals;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void WorkPool::run(unsigned index)
+{
+    traceThreadName("work pool");
+
+    while (true)
+    {
+        Task task;
+        if(take(index, task))
+        {
+            task();
+            ++m_tasksRun;
+
+            std::lock_guard<std::mutex> lk(m_mut);
+            if(--m_pending == 0)
+                m_idleCond.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lk(m_mut);
+        m_wakeCond.wait(lk, [this]{ return m_queued > 0 || m_quit; });
+        if(m_quit && m_queued == 0)
+            break;
+    }
+}
+
+void WorkPool::printStats(std::ostream& out) const
+{
+    out << "work pool: " << m_threads.size() << " threads, " << m_tasksRun << " tasks ("
+        << m_byPriority[High] << " high, " << m_byPriority[Normal] << " normal, "
+        << m_byPriority[Low] << " low priority), " << m_steals << " stolen" << std::endl;
+}
@@ -0,0 +1,97 @@
+#ifndef WORK_POOL_HPP
+#define WORK_POOL_HPP
+
+#include <SFML/Config.hpp>
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+//
+// Fixed set of worker threads running short tasks, with work stealing.
+//
+// Every worker has its own queues, one per priority. A task goes to the
+// worker picked by its affinity, so work for the same stream tends to stay
+// on one core with its decoder state warm. A worker takes its oldest task;
+// once it has nothing of a priority it steals the newest one from another
+// worker before falling to a lower priority. So the next free worker always
+// takes a higher priority task before any lower one, but running tasks are
+// not preempted: with every worker busy, a high priority task waits for the
+// first of them to finish, whatever its priority.
+//
+class WorkPool
+{
+public:
+    enum Priority
+    {
+        High,
+        Normal,
+        Low,
+        PriorityCount
+    };
+
+    typedef std::function<void()> Task;
+
+    // 0 threads for one per core
+    explicit WorkPool(unsigned threads);
+    ~WorkPool();
+
+    void submit(Task task, Priority priority, unsigned affinity);
+
+    // Blocks until every task submitted so far has run
+    void waitIdle();
+
+    unsigned threadCount() const
+    {
+        return (unsigned)m_threads.size();
+    }
+
+    sf::Uint64 tasksRun() const
+    {
+        return m_tasksRun;
+    }
+
+    sf::Uint64 steals() const
+    {
+        return m_steals;
+    }
+
+    void printStats(std::ostream& out) const;
+
+private:
+    WorkPool(const WorkPool&);
+    WorkPool& operator=(const WorkPool&);
+
+    struct Worker
+    {
+        std::mutex mut;
+        std::deque<Task> tasks[PriorityCount];
+    };
+
+    void run(unsigned index);
+    bool take(unsigned index, Task& task);
+
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::vector<std::thread> m_threads;
+
+    // Workers sleep on m_wakeCond while nothing is queued; waitIdle() on
+    // m_idleCond until nothing is queued or running
+    std::mutex m_mut;
+    std::condition_variable m_wakeCond;
+    std::condition_variable m_idleCond;
+    std::atomic<size_t> m_queued;
+    std::atomic<size_t> m_pending;
+    std::atomic<bool> m_quit;
+
+    std::atomic<sf::Uint64> m_tasksRun;
+    std::atomic<sf::Uint64> m_steals;
+    std::atomic<sf::Uint64> m_byPriority[PriorityCount];
+};
+
+#endif
@@ -19,346 +19,417 @@
 
 // Here is a small helper for you ! Have a look.
 #include "ResourcePath.hpp"
+#include "Options.hpp"
+#include "MovieSound.hpp"
+#include "ConvertBenchmark.hpp"
+#include "HeadlessBenchmark.hpp"
+#include "StageBenchmark.hpp"
+#include "TestMedia.hpp"
+#include "ThumbnailStrip.hpp"
+#include "VideoWall.hpp"
+#include "FrameExtractor.hpp"
+#include "Playlist.hpp"
+#include "StartupTimer.hpp"
+#include "FrameCache.hpp"
+#include "StatsOverlay.hpp"
+#include "JitterBuffer.hpp"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
-#include <libswscale/swscale.h>
-#include <libswresample/swresample.h>
-#include <libavutil/opt.h>
-#include <libavutil/samplefmt.h>
-#include <libavutil/channel_layout.h>
 }
 
-#include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <deque>
-#include <chrono>
 #include <algorithm>
 #include <assert.h>
 
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include <vector>
+#include <utility>
 
-std::mutex  g_mut;
-std::condition_variable g_newPktCondition;
-std::deque<AVPacket*> g_audioPkts;
-std::deque<AVPacket*> g_videoPkts;
+// Files without audio fall back from the audio to the external clock
+static SyncClock::Master masterFor(const PlaybackItem& item, SyncClock::Master wanted)
+{
+    return !item.hasAudio() && wanted == SyncClock::AudioMaster ? SyncClock::ExternalMaster : wanted;
+}
+
+// Window size while the file is still being probed
+const unsigned ProvisionalWindowWidth = 1280;
+const unsigned ProvisionalWindowHeight = 720;
+
+// Arrow keys seek this far
+const sf::Int64 SeekStepMs = 10 * 1000;
 
-class MovieSound : public sf::SoundStream
+// Trick play speeds double from 2 up to this, forwards (F) or backwards (R)
+const int MaxTrickSpeed = 16;
+// Up to this speed forwards every frame is decoded and the audio is sped
+// up. Faster, and rewinding, only keyframes are shown, at most one per
+// TrickFrameIntervalMs, and the audio is muted. That keeps the decoding
+// cost close to normal playback's whatever the speed.
+const int MaxAudibleSpeed = 2;
+const sf::Int64 TrickFrameIntervalMs = 100;
+
+static bool isKeyframeOnly(int speed)
 {
-public:
-    MovieSound(AVFormatContext* ctx, int index);
-    virtual ~MovieSound();
-    
-    
-    bool isAudioReady() const
-    {
-        return sf::SoundStream::getPlayingOffset() != initialTime;
-    }
-    
-    sf::Int32 timeElapsed() const
-    {
-        return sf::SoundStream::getPlayingOffset().asMilliseconds();
-    }
-    
-private:
-    
-    virtual bool onGetData(Chunk& data);
-    virtual void onSeek(sf::Time timeOffset);
-    
-    bool decodePacket(AVPacket* packet, AVFrame* outputFrame, bool& gotFrame);
-    void initResampler();
-    void resampleFrame(AVFrame* frame, uint8_t*& outSamples, int& outNbSamples, int& outSamplesLength);
-    
-    AVFormatContext* m_formatCtx;
-    AVCodecContext* m_codecCtx;
-    int m_audioStreamIndex;
-    
-    unsigned m_sampleRate;
-    sf::Int16* m_samplesBuffer;
-    AVFrame* m_audioFrame;
-    
-    SwrContext* m_swrCtx;
-    int m_dstNbSamples;
-    int m_maxDstNbSamples;
-    int m_dstNbChannels;
-    int m_dstLinesize;
-    uint8_t** m_dstData;
-    
-    
-    sf::Time initialTime;
-};
+    return speed < 0 || speed > MaxAudibleSpeed;
+}
+
+// The next file of a playlist is opened once the current one is read to
+// the end or has this much left to play
+const sf::Int64 PreloadAheadMs = 15000;
 
-MovieSound::MovieSound(AVFormatContext* ctx, int index)
-: m_formatCtx(ctx)
-, m_audioStreamIndex(index)
-, m_codecCtx(ctx->streams[index]->codec)
+int main(int argc, char const** argv)
 {
-    m_audioFrame = av_frame_alloc();
+    StartupTimer startup;
     
-    m_sampleRate = m_codecCtx->sample_rate;
-    m_samplesBuffer = (sf::Int16*)av_malloc(sizeof(sf::Int16) * av_get_channel_layout_nb_channels(AV_CH_LAYOUT_STEREO) * m_sampleRate * 2);
+    PlayerOptions options;
+    if(!parseOptions(argc, argv, options))
+        return EXIT_FAILURE;
     
-    initialize(av_get_channel_layout_nb_channels(AV_CH_LAYOUT_STEREO), m_sampleRate);
+    if(options.benchConvert)
+        return runConvertBenchmark(std::cout);
     
-    initResampler();
+    if(options.checkConvert)
+        return runConvertCheck(std::cout);
     
-    initialTime = sf::SoundStream::getPlayingOffset();
+    // Register all formats and codecs
+    av_register_all();
     
-}
-
-MovieSound::~MovieSound()
-{
-}
-
-void MovieSound::initResampler()
-{
-    int err = 0;
-    m_swrCtx = swr_alloc();
+    if(!options.tracePath.empty() && !startTrace(options.tracePath))
+        return EXIT_FAILURE;
     
-    if(m_codecCtx->channel_layout == 0)
+    if(!options.testMediaDir.empty())
     {
-        m_codecCtx->channel_layout = av_get_default_channel_layout(m_codecCtx->channels);
+        int ret = runMakeTestMedia(options.testMediaDir, std::cout);
+        finishTrace();
+        return ret;
     }
     
-    /* set options */
-    av_opt_set_int(m_swrCtx, "in_channel_layout",    m_codecCtx->channel_layout, 0);
-    av_opt_set_int(m_swrCtx, "in_sample_rate",       m_codecCtx->sample_rate, 0);
-    av_opt_set_sample_fmt(m_swrCtx, "in_sample_fmt", m_codecCtx->sample_fmt, 0);
-    av_opt_set_int(m_swrCtx, "out_channel_layout",    AV_CH_LAYOUT_STEREO, 0);
-    av_opt_set_int(m_swrCtx, "out_sample_rate",       m_codecCtx->sample_rate, 0);
-    av_opt_set_sample_fmt(m_swrCtx, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-    
-    err = swr_init(m_swrCtx);
-    
-    m_maxDstNbSamples = m_dstNbSamples = 1024;
+    if(options.benchStages)
+    {
+        std::ofstream file;
+        if(!options.benchOutPath.empty())
+        {
+            file.open(options.benchOutPath.c_str());
+            if(!file)
+            {
+                std::cerr << "can't write " << options.benchOutPath << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        int ret = runStageBenchmarks(options, options.benchOutPath.empty() ? std::cout : file);
+        finishTrace();
+        return ret;
+    }
     
-    m_dstNbChannels = av_get_channel_layout_nb_channels(AV_CH_LAYOUT_STEREO);
-    err = av_samples_alloc_array_and_samples(&m_dstData, &m_dstLinesize, m_dstNbChannels, m_dstNbSamples, AV_SAMPLE_FMT_S16, 0);
-}
-
-bool MovieSound::decodePacket(AVPacket* packet, AVFrame* outputFrame, bool& gotFrame)
-{
-    bool needsMoreDecoding = false;
-    int igotFrame = 0;
+    if(options.headless)
+    {
+        int ret = runHeadlessBenchmark(options, std::cout);
+        finishTrace();
+        return ret;
+    }
     
-    int decodedLength = avcodec_decode_audio4(m_codecCtx, outputFrame, &igotFrame, packet);
-    gotFrame = (igotFrame != 0);
+    if(options.thumbnailIntervalMs > 0)
+    {
+        int ret = runThumbnails(options, std::cout);
+        finishTrace();
+        return ret;
+    }
     
-    if(decodedLength < packet->size)
+    if(!options.extractDir.empty())
     {
-        needsMoreDecoding = true;
-        packet->data += decodedLength;
-        packet->size -= decodedLength;
+        int ret = runFrameExtraction(options, std::cout);
+        finishTrace();
+        return ret;
     }
     
-    return needsMoreDecoding;
-}
-
-void MovieSound::resampleFrame(AVFrame *frame, uint8_t *&outSamples, int &outNbSamples, int &outSamplesLength)
-{
-    int err = 0;
-    int src_rate = frame->sample_rate;
-    int dst_rate = frame->sample_rate;
+    if(options.wallBench)
+    {
+        int ret = runWallBenchmark(options, std::cout);
+        finishTrace();
+        return ret;
+    }
     
-    m_dstNbSamples = av_rescale_rnd(swr_get_delay(m_swrCtx, src_rate) + frame->nb_samples, dst_rate, src_rate, AV_ROUND_UP);
+    if(options.wall)
+    {
+        int ret = runVideoWall(options);
+        finishTrace();
+        return ret;
+    }
     
-    if(m_dstNbSamples > m_maxDstNbSamples)
+    const std::vector<std::string>& paths = options.inputs;
+    if(paths.empty())
     {
-        av_free(m_dstData[0]);
-        err = av_samples_alloc(m_dstData, &m_dstLinesize, m_dstNbChannels, m_dstNbSamples, AV_SAMPLE_FMT_S16, 1);
-        m_maxDstNbSamples = m_dstNbSamples;
+        std::cerr << "no input files; give some on the command line or with --playlist" << std::endl;
+        return EXIT_FAILURE;
     }
     
-    err = swr_convert(m_swrCtx, m_dstData, m_dstNbSamples, (const uint8_t**)frame->extended_data, frame->nb_samples);
+    // beginItem() picks the master for each file once it is open
+    SyncClock clock(options.syncMaster);
     
-    int dst_bufsize = av_samples_get_buffer_size(&m_dstLinesize, m_dstNbChannels, err, AV_SAMPLE_FMT_S16, 1);
+    // Until the video size is known the window gets the asked size or a
+    // provisional one, never larger than the desktop
+    const sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
+    const unsigned maxWidth = desktop.width * 9 / 10;
+    const unsigned maxHeight = desktop.height * 9 / 10;
+    const sf::Vector2u provisionalSize(std::min<unsigned>(options.windowWidth > 0 ? options.windowWidth : ProvisionalWindowWidth, maxWidth),
+                                       std::min<unsigned>(options.windowHeight > 0 ? options.windowHeight : ProvisionalWindowHeight, maxHeight));
     
-    outNbSamples = dst_bufsize / av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
-    outSamplesLength = dst_bufsize;
-    outSamples = m_dstData[0];
-}
-
-bool MovieSound::onGetData(sf::SoundStream::Chunk &data)
-{
-    data.samples = m_samplesBuffer;
+    // Probing and opening the decoders can take seconds on large or remote
+    // files. The window, icon and font are set up meanwhile.
+    Playlist playlist(paths, options, &clock);
+    playlist.setStartupTimer(&startup);
+    playlist.preload(provisionalSize);
     
-    while (data.sampleCount < av_get_channel_layout_nb_channels(AV_CH_LAYOUT_STEREO) * m_sampleRate)
-    {
-        bool needsMoreDecoding = false;
-        bool gotFrame = false;
-        
-        std::unique_lock<std::mutex> lk(g_mut);
-        g_newPktCondition.wait(lk, []{ return !g_audioPkts.empty();});
-        
-        AVPacket* packet = g_audioPkts.front();
-        g_audioPkts.pop_front();
-        //lk.unlock();
-        
-        do {
-            needsMoreDecoding = decodePacket(packet, m_audioFrame, gotFrame);
-            
-            if (gotFrame)
-            {
-                uint8_t* samples = NULL;
-                int nbSamples = 0;
-                int samplesLength = 0;
-                
-                resampleFrame(m_audioFrame, samples, nbSamples, samplesLength);
-                
-                std::memcpy((void*)(data.samples + data.sampleCount), samples, samplesLength);
-                data.sampleCount += nbSamples;
-            }
-            
-        }while (needsMoreDecoding);
-        
-        lk.unlock();
-        
-        av_free_packet(packet);
-        av_free(packet);
-    }
+    sf::RenderWindow window(sf::VideoMode(provisionalSize.x, provisionalSize.y), "SFML window");
     
-    return true;
-}
+    // Set the Icon
+    sf::Image icon;
+    bool resourcesLoaded = icon.loadFromFile(resourcePath() + "icon.png");
+    if(resourcesLoaded)
+        window.setIcon(icon.getSize().x, icon.getSize().y, icon.getPixelsPtr());
 
-void MovieSound::onSeek(sf::Time timeOffset)
-{
-    std::lock_guard<std::mutex> lk(g_mut);
-    for (auto p : g_audioPkts)
+    // Font for the stats overlay
+    sf::Font font;
+    resourcesLoaded = resourcesLoaded && font.loadFromFile(resourcePath() + "sansation.ttf");
+    StatsOverlay overlay(font);
+    startup.mark(StartupTimer::WindowReady);
+    
+    std::unique_ptr<PlaybackItem> current = playlist.takeNext(provisionalSize);
+    if(!current)
+        return -1;
+    if(!resourcesLoaded)
+        return EXIT_FAILURE;
+    
+    const AVCodecContext* pCodecCtx = current->media().videoStream()->codec;
+ 
+    // Now fit the window to the first file, or to the asked size. Later
+    // files are letterboxed into it.
+    unsigned boxWidth = options.windowWidth > 0 ? options.windowWidth : pCodecCtx->width;
+    unsigned boxHeight = options.windowHeight > 0 ? options.windowHeight : pCodecCtx->height;
+    const sf::Vector2u windowSize = fitInside(pCodecCtx->width, pCodecCtx->height,
+                                              std::min(boxWidth, maxWidth),
+                                              std::min(boxHeight, maxHeight));
+    if(window.getSize() != windowSize)
     {
-        av_free_packet(p);
-        av_free(p);
+        window.setSize(windowSize);
+        window.setView(sf::View(sf::FloatRect(0, 0, windowSize.x, windowSize.y)));
     }
-    g_audioPkts.clear();
-    avcodec_flush_buffers(m_codecCtx);
-    //g_newPktCondition.notify_one();
-}
+    current->setWindowSize(windowSize);
 
+    // Recreated whenever the frame size changes
+    sf::Texture im_video;
+    im_video.create(windowSize.x, windowSize.y);
+    // Smoothing only matters when the window is larger than the source
+    im_video.setSmooth(true);
 
-int main(int, char const**)
-{
-    AVFormatContext *pFormatCtx = NULL;
-    AVCodecContext  *pCodecCtx = NULL;
-    AVCodecContext  *paCodecCtx = NULL;
-    AVCodec         *pCodec = NULL;
-    AVCodec         *paCodec = NULL;
-    AVFrame         *pFrame = NULL;
-    AVFrame         *pFrameRGB = NULL;
-    int             frameFinished;
-    int             numBytes;
-    uint8_t         *buffer = NULL;
-    int64_t         m_lastDecodedTimeStamp = 0;
-    
-    AVDictionary    *optionsDict = NULL;
-    AVDictionary    *optionsDictA = NULL;
-    SwsContext      *sws_ctx = NULL;
-    
-    std::ofstream of("outputframe.txt");
-    bool syncAV = false;
-    int64_t blockPts = 0;
-    std::vector<AVPacket*> audioSyncBuffer;
-    
-    //const char* filename = "/Users/JHQ/Desktop/Silicon_Valley.mkv";
-    const char* filename = "/Users/JHQ/Downloads/Soshite.Chichi.ni.Naru.2013.BluRay.iPad.720p.AAC.x264-YYeTs.mp4";
-    //const char* filename = "/Users/JHQ/Downloads/t_callofdutyaw_reveal_1280x720_3500_h32.mp4";
-    //const char* filename = "/Volumes/JuHeQi/iTunes/iTunes Media/Movies/Newsroom/新闻编辑室.The.Newsroom.S01E01.Chi_Eng.HR-HDTV.AC3.1024X576.x264-YYeTs人人影视.mkv";
-    // Register all formats and codecs
-    av_register_all();
+    sf::Sprite sprite(im_video);
     
-    // Open video file
-    if(avformat_open_input(&pFormatCtx, filename, NULL, NULL)!=0)
-        return -1; // Couldn't open file
+    std::cout << "colour conversion: " << current->videoDecoder().converter().pathName() << std::endl;
     
-    // Retrieve stream information
-    if(avformat_find_stream_info(pFormatCtx, NULL)<0)
-        return -1; // Couldn't find stream information
+    // One output for the whole playlist. Each file's audio is a MovieSound
+    // source; these are the numbers of the current and the next file's, -1
+    // while they have none.
+    std::unique_ptr<MovieSound> sound;
+    int currentAudioSource = -1;
+    int nextAudioSource = -1;
     
-    // Dump information about file onto standard error
-    av_dump_format(pFormatCtx, 0, filename, 0);
+    // Finished files whose audio the sound may still be playing out, with
+    // their source numbers
+    std::vector<std::pair<int, std::unique_ptr<PlaybackItem> > > retired;
+    std::unique_ptr<PlaybackItem> next;
     
-    int videoStream = -1;
-    int audioStream = -1;
-    for(int i = 0; i < pFormatCtx->nb_streams; ++i)
+    // Points the clock and the sound at the current file. Its audio is
+    // already queued when the previous file's was playing.
+    auto beginItem = [&]
     {
-        if(pFormatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO)
+        clock.setMaster(masterFor(*current, options.syncMaster));
+        if(!current->hasAudio())
+            return;
+        
+        AVStream* stream = current->media().audioStream();
+        if(!sound)
         {
-            videoStream = i;
+            sound.reset(new MovieSound(stream, current->audioPackets(), options.live));
+            sound->setStartupTimer(&startup);
+            currentAudioSource = 0;
         }
-        else if(pFormatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_AUDIO)
+        else if(currentAudioSource < 0)
         {
-            audioStream = i;
+            currentAudioSource = sound->queueNext(stream, current->audioPackets());
         }
-    }
-    
-    if(videoStream < 0)
-        return -1;
-    
-    if(videoStream >= 0)
+        
+        // The output stops when it runs out of audio; started again it
+        // plays the source being decoded from its beginning
+        if(sound->getStatus() != sf::SoundStream::Playing)
+            sound->play();
+    };
+    beginItem();
+    
+    // Serial of the last frame presented. A frame with a newer serial is the
+    // first one of a file or after a seek; the clock restarts from it, and
+    // after a seek the audio too.
+    int presentedSerial = -1;
+    bool itemStart = true;
+    
+    // The last frame presented, to hold it for its duration at the end of a
+    // file and to measure the gap to the next file's first frame
+    std::chrono::steady_clock::time_point lastPresentTime;
+    sf::Int64 lastPresentedPtsMs = 0;
+    sf::Int64 previousIntervalMs = 0;
+    StageStats gapStats("item gap");
+    
+    // When audio isn't the master it is moved back to the master clock once
+    // it drifts this far, but not more than once per AudioResyncInterval
+    const sf::Int64 AudioResyncMs = 200;
+    const sf::Time AudioResyncInterval = sf::seconds(1);
+    sf::Clock sinceAudioResync;
+    sf::Uint64 audioResyncs = 0;
+    sf::Uint64 presentDrops = 0;
+    sf::Uint64 presentedFrames = 0;
+    
+    // From the key press to the first frame at the new position
+    StageStats indexedSeekStats("seek (index)");
+    StageStats containerSeekStats("seek (container)");
+    StageStats cacheSeekStats("seek (cache)");
+    
+    // Live, playback is held a target latency behind the input
+    std::unique_ptr<JitterBuffer> jitter;
+    if(options.live)
+        jitter.reset(new JitterBuffer(options.liveLatencyMs));
+    sf::Uint64 lastAudioUnderruns = 0;
+    
+    // Presented frames are kept for stepping and short backward seeks
+    FrameCache frameCache(options.frameCacheBytes, options.frameCacheHalfSize ? FrameCache::HalfSize : FrameCache::FullSize);
+    
+    // Paused, the loop only presents what a step or a seek asks for.
+    // shownPtsMs is the frame on screen. Once anything else is shown than
+    // where playback paused, resuming seeks there, which brings the audio
+    // along.
+    bool paused = false;
+    bool stepForward = false;
+    bool resyncOnResume = false;
+    sf::Int64 shownPtsMs = 0;
+    
+    // Frames of this serial are held back: a seek was shown from the cache
+    // and they would replace it until the demuxer catches up
+    int previewSerial = -1;
+    
+    StageStats textureStats("texture update");
+    StageStats displayStats("display");
+    traceThreadName("render");
+    
+    auto uploadFrame = [&](const VideoFrame& frame)
     {
-        pCodecCtx = pFormatCtx->streams[videoStream]->codec;
-        pCodec = avcodec_find_decoder(pCodecCtx->codec_id);
+        {
+            StageTimer timer(textureStats);
+            
+            // Frames queued before a resize, and half-size cached ones,
+            // differ from the texture's size
+            if(im_video.getSize() != sf::Vector2u(frame.width, frame.height))
+            {
+                im_video.create(frame.width, frame.height);
+                sprite.setTexture(im_video, true);
+            }
+            im_video.update(frame.pixels);
+        }
         
-        if(avcodec_open2(pCodecCtx, pCodec, &optionsDict)<0)
-            return -1;
-    }
-    if(audioStream >= 0)
+        // Letterbox the picture in the window
+        const sf::Vector2u win = window.getSize();
+        const float scale = std::min(win.x / (float)frame.width, win.y / (float)frame.height);
+        sprite.setScale(scale, scale);
+        sprite.setPosition((win.x - frame.width * scale) / 2, (win.y - frame.height * scale) / 2);
+        shownPtsMs = frame.ptsMs;
+    };
+    
+    auto displayFrame = [&]
     {
-        paCodecCtx = pFormatCtx->streams[audioStream]->codec;
-        paCodec = avcodec_find_decoder(paCodecCtx->codec_id);
+        // Clear screen
+        window.clear();
         
-        if(avcodec_open2(paCodecCtx, paCodec, &optionsDictA))
-            return -1;
-    }
- 
-    const int FrameSize = pCodecCtx->width * pCodecCtx->height * 3;
+        window.draw(sprite);
+        window.draw(overlay);
+        
+        {
+            StageTimer timer(displayStats);
+            window.display();
+        }
+    };
     
-    pFrame = av_frame_alloc();
-    pFrameRGB = av_frame_alloc();
-    if (pFrameRGB == nullptr)
+    auto showCached = [&](const VideoFrame& frame)
     {
-        return -1;
-    }
-    
-    numBytes = avpicture_get_size(PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height);
-    buffer = (uint8_t*)av_malloc(numBytes * sizeof(uint8_t));
-    
-    sws_ctx = sws_getContext(pCodecCtx->width, pCodecCtx->height, pCodecCtx->pix_fmt, pCodecCtx->width, pCodecCtx->height, PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
-    
-    avpicture_fill((AVPicture*)pFrameRGB, buffer, PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height);
+        uploadFrame(frame);
+        displayFrame();
+    };
     
+    // Once the sound has moved on to the next file's audio the current one
+    // can't be seeked any more. Nor can a live stream, at all.
+    auto canSeek = [&]
+    {
+        return !options.live && !(sound && currentAudioSource >= 0 && sound->decodingSource() != currentAudioSource);
+    };
     
-    sf::Uint8* Data = new sf::Uint8[pCodecCtx->width * pCodecCtx->height * 4];
+    // Playback speed, negative when rewinding
+    int speed = 1;
     
-    // Create the main window
-    sf::RenderWindow window(sf::VideoMode(pCodecCtx->width, pCodecCtx->height), "SFML window");
-
-    sf::Texture im_video;
-    im_video.create(pCodecCtx->width, pCodecCtx->height);
-    im_video.setSmooth(false);
-    
-    // Set the Icon
-    sf::Image icon;
-    if (!icon.loadFromFile(resourcePath() + "icon.png")) {
-        return EXIT_FAILURE;
-    }
-    window.setIcon(icon.getSize().x, icon.getSize().y, icon.getPixelsPtr());
-
-    sf::Sprite sprite(im_video);
-
-    // Create a graphical text to display
-    sf::Font font;
-    if (!font.loadFromFile(resourcePath() + "sansation.ttf")) {
-        return EXIT_FAILURE;
-    }
-    sf::Text text("Hello SFML", font, 50);
-    text.setColor(sf::Color::Black);
+    // Restarts at the frame on screen in the new mode, which brings the
+    // audio along at the new speed
+    auto setSpeed = [&](int newSpeed)
+    {
+        if(newSpeed == speed || !canSeek())
+            return;
+        
+        speed = newSpeed;
+        const bool keyframeOnly = isKeyframeOnly(speed);
+        clock.setRate(speed);
+        clock.setMaster(keyframeOnly ? SyncClock::ExternalMaster : masterFor(*current, options.syncMaster));
+        if(sound)
+            sound->setSpeed(keyframeOnly ? 1 : speed);
+        
+        if(keyframeOnly)
+            current->demuxer().setTrickPlay(speed > 0 ? 1 : -1, std::abs(speed) * TrickFrameIntervalMs, shownPtsMs);
+        else
+            current->demuxer().setTrickPlay(0, 0, shownPtsMs);
+        
+        if(traceEnabled())
+            traceInstant("speed", "speed", speed);
+    };
     
-    MovieSound sound(pFormatCtx, audioStream);
-    //MovieSound* psound = new MovieSound(pFormatCtx, audioStream);
-    //MovieSound& soun
-    sound.play();
+    auto pause = [&]
+    {
+        // Pausing ends trick play
+        const bool wasTrick = speed != 1;
+        setSpeed(1);
+        
+        paused = true;
+        stepForward = false;
+        resyncOnResume = wasTrick;
+        clock.pause();
+        if(sound && sound->getStatus() == sf::SoundStream::Playing)
+            sound->pause();
+    };
+    
+    auto resume = [&]
+    {
+        paused = false;
+        stepForward = false;
+        if(resyncOnResume)
+        {
+            current->demuxer().seek(shownPtsMs);
+            return;
+        }
+        
+        clock.reset(presentedSerial, shownPtsMs);
+        if(sound && sound->getStatus() == sf::SoundStream::Paused)
+            sound->play();
+        
+        // What arrived meanwhile is dropped once measured again
+        if(jitter)
+            jitter->restart();
+    };
     
     // Start the game loop
     while (window.isOpen())
@@ -378,201 +449,416 @@ int main(int, char const**)
             {
                 window.close();
             }
-            else if(event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Right)
+            else if(event.type == sf::Event::Resized)
+            {
+                // Keep one view unit per pixel and convert at the new size
+                window.setView(sf::View(sf::FloatRect(0, 0, event.size.width, event.size.height)));
+                
+                current->setWindowSize(sf::Vector2u(event.size.width, event.size.height));
+                if(next)
+                    next->setWindowSize(sf::Vector2u(event.size.width, event.size.height));
+            }
+            else if(event.type == sf::Event::KeyPressed && (event.key.code == sf::Keyboard::Right || event.key.code == sf::Keyboard::Left))
             {
-                for(auto p : g_videoPkts)
+                if(!canSeek())
+                    continue;
+                
+                const sf::Int64 from = paused ? shownPtsMs : clock.masterMs();
+                const sf::Int64 target = event.key.code == sf::Keyboard::Right ? from + SeekStepMs : std::max<sf::Int64>(0, from - SeekStepMs);
+                
+                // A target still in the cache is shown at once. Paused,
+                // that is all; playing, the demuxer still seeks, for the
+                // audio and for what follows.
+                const auto pressed = std::chrono::steady_clock::now();
+                const VideoFrame* cached = frameCache.find(target);
+                if(cached)
                 {
-                    av_free_packet(p);
-                    av_free(p);
+                    showCached(*cached);
+                    const auto now = std::chrono::steady_clock::now();
+                    cacheSeekStats.record(0, std::chrono::duration_cast<std::chrono::microseconds>(now - pressed).count());
+                    if(traceEnabled())
+                        traceComplete(cacheSeekStats.name(), pressed, now);
                 }
-                g_videoPkts.clear();
                 
-                auto now = sound.timeElapsed();
-                auto next = ( now / 1000.0f + 10 ) * AV_TIME_BASE;
-                int64_t seekTarget = next;
+                if(paused)
+                {
+                    resyncOnResume = true;
+                    if(cached)
+                        continue;
+                }
+                else if(cached)
+                {
+                    previewSerial = current->videoPackets().serial();
+                }
                 
-                seekTarget = av_rescale_q(seekTarget, AV_TIME_BASE_Q, pFormatCtx->streams[videoStream]->time_base);
+                current->demuxer().seek(target);
+            }
+            else if(event.type == sf::Event::KeyPressed && (event.key.code == sf::Keyboard::F || event.key.code == sf::Keyboard::R)
+                    && presentedSerial >= 0 && !itemStart && canSeek())
+            {
+                // Each press doubles the speed, past the fastest back to 1x
+                int newSpeed = 1;
+                if(event.key.code == sf::Keyboard::F)
+                    newSpeed = speed < 2 ? 2 : (speed < MaxTrickSpeed ? speed * 2 : 1);
+                else
+                    newSpeed = speed > -2 ? -2 : (speed > -MaxTrickSpeed ? speed * 2 : 1);
                 
-                auto ret = avformat_seek_file(pFormatCtx, videoStream, 0, seekTarget, seekTarget, AVSEEK_FLAG_BACKWARD);
-                assert(ret >= 0);
-                avcodec_flush_buffers(pCodecCtx);
-
-                syncAV = true;
+                // Paused the speed is 1x; trick play starts from the frame
+                // on screen either way
+                paused = false;
+                resyncOnResume = false;
+                setSpeed(newSpeed);
+            }
+            else if(event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Space && presentedSerial >= 0 && !itemStart)
+            {
+                if(paused)
+                    resume();
+                else
+                    pause();
+            }
+            else if(event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::I)
+            {
+                overlay.toggle();
                 
-                of << "seek target : " << next << std::endl;
+                // Playing, the next frame shows it
+                if(paused)
+                    displayFrame();
             }
-            else if(event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Left)
+            else if(event.type == sf::Event::KeyPressed && (event.key.code == sf::Keyboard::Comma || event.key.code == sf::Keyboard::Period)
+                    && presentedSerial >= 0 && !itemStart && canSeek())
             {
-                for(auto p : g_videoPkts)
+                // Stepping pauses. Back, past the oldest cached frame, seeks
+                // for the frame before; forward, past the newest, takes the
+                // next one off the frame queue.
+                if(!paused)
+                    pause();
+                resyncOnResume = true;
+                
+                if(event.key.code == sf::Keyboard::Comma)
+                {
+                    if(const VideoFrame* cached = frameCache.previous(shownPtsMs))
+                        showCached(*cached);
+                    else if(shownPtsMs > 0)
+                        current->demuxer().seek(std::max<sf::Int64>(0, shownPtsMs - current->frameIntervalMs()));
+                }
+                else
                 {
-                    av_free_packet(p);
-                    av_free(p);
+                    if(const VideoFrame* cached = frameCache.next(shownPtsMs))
+                        showCached(*cached);
+                    else
+                        stepForward = true;
                 }
-                g_videoPkts.clear();
+            }
+        }
+        
+        // Let go of files the sound has played out
+        for (size_t i = 0; i < retired.size(); )
+        {
+            if(retired[i].first < sound->decodingSource())
+                retired.erase(retired.begin() + i);
+            else
+                ++i;
+        }
+        
+        // An item that ends without a frame to show moves on all the same
+        if(!next && (!itemStart || current->isFinished()) && playlist.hasNext() && !playlist.isPreloading())
+        {
+            const sf::Int64 durationMs = current->durationMs();
+            if(current->demuxer().isEof() || (durationMs > 0 && durationMs - clock.masterMs() < PreloadAheadMs))
+                playlist.preload(window.getSize());
+        }
+        
+        if(!next && playlist.isReady())
+        {
+            next = playlist.takeNext(window.getSize());
+            
+            // Queued right behind the current file's audio, the output
+            // doesn't stop between the two
+            if(next && next->hasAudio() && currentAudioSource >= 0 && sound->getStatus() == sf::SoundStream::Playing)
+                nextAudioSource = sound->queueNext(next->media().audioStream(), next->audioPackets());
+        }
+        
+        if(current->isFinished())
+        {
+            if(!next && !playlist.hasNext() && !playlist.isPreloading())
+                break;
+            
+            // Hold the last frame for its duration before the next file,
+            // if this one showed any
+            if(next && !paused && (itemStart || clock.masterMs() >= lastPresentedPtsMs + current->frameIntervalMs()))
+            {
+                previousIntervalMs = current->frameIntervalMs();
+                current->stop();
+                if(currentAudioSource >= 0)
+                    retired.push_back(std::make_pair(currentAudioSource, std::move(current)));
                 
-                auto now = sound.timeElapsed();
-                auto prev = std::max(0, now - 10 * 1000);
-                int64_t seekTarget = (prev / 1000) * AV_TIME_BASE;
-                seekTarget = av_rescale_q(seekTarget, AV_TIME_BASE_Q, pFormatCtx->streams[videoStream]->time_base);
+                current = std::move(next);
+                currentAudioSource = nextAudioSource;
+                nextAudioSource = -1;
                 
-                auto ret = avformat_seek_file(pFormatCtx, videoStream, 0, seekTarget, seekTarget, AVSEEK_FLAG_BACKWARD);
-                assert(ret >= 0);
-                avcodec_flush_buffers(pCodecCtx);
+                // Keyframe-only trick play ends with the file; sped up
+                // audio carries on into the next one
+                if(isKeyframeOnly(speed))
+                {
+                    speed = 1;
+                    clock.setRate(1);
+                }
+                beginItem();
                 
-                syncAV = true;
-                of << "seek target : " << prev << std::endl;
+                presentedSerial = -1;
+                itemStart = true;
+                continue;
             }
         }
         
-        AVPacket* packet_ptr = 0;
+        StatsOverlay::Sources overlaySources = { current.get(), currentAudioSource >= 0 ? sound.get() : NULL, &clock, jitter.get(), presentedFrames, presentDrops };
+        overlay.update(overlaySources);
+        
+        PacketQueue& videoPkts = current->videoPackets();
+        FrameQueue& videoFrames = current->videoFrames();
+        
+        // Throw away frames decoded before the last seek
+        const int serial = videoPkts.serial();
+        VideoFrame* frame = videoFrames.peek();
+        while (frame && frame->serial != serial)
+        {
+            videoFrames.next();
+            frame = videoFrames.peek();
+        }
+        if(serial == previewSerial)
+            frame = NULL;
+        
+        // Rewound to the start, play on from there
+        if(speed < 0 && current->demuxer().isRewound() && !frame && videoPkts.isEmpty())
+            setSpeed(1);
         
-        if(g_videoPkts.size() < 150)
+        // Once the audio has stopped (it may end before the video) the clock
+        // carries on by itself
+        const bool audioPlaying = currentAudioSource >= 0 && sound->playingSource() == currentAudioSource
+            && sound->isAudioReady() && sound->getStatus() == sf::SoundStream::Playing;
+        if(audioPlaying && clock.serial() == presentedSerial)
         {
-            packet_ptr = (AVPacket*)av_malloc(sizeof(AVPacket));
-            av_init_packet(packet_ptr);
+            clock.updateAudio(sound->timeElapsed());
+        }
+        
+        // Live, what has arrived and isn't presented yet is the latency.
+        // The jitter buffer keeps it on target by playing a little faster
+        // or slower, or by dropping what is too much. Underruns before
+        // playback starts don't count.
+        const sf::Int64 newestMs = current->demuxer().newestVideoMs();
+        const sf::Uint64 audioUnderruns = sound ? sound->underruns() : 0;
+        if(jitter && !paused && !itemStart && clock.serial() == presentedSerial && newestMs != INT64_MIN)
+        {
+            const bool videoStarved = !frame && videoPkts.isEmpty()
+                && clock.masterMs() > lastPresentedPtsMs + 2 * current->frameIntervalMs();
+            const bool underrun = videoStarved || audioUnderruns != lastAudioUnderruns;
             
-            if(av_read_frame(pFormatCtx, packet_ptr) < 0)
+            sf::Int64 dropMs = 0;
+            const double rate = jitter->update(newestMs - clock.masterMs(), underrun, dropMs);
+            if(dropMs > 0)
+            {
+                // Late frames are then dropped by the decoder and here
+                if(currentAudioSource >= 0)
+                    sound->skipBuffered(dropMs);
+                if(clock.master() != SyncClock::AudioMaster || !audioPlaying)
+                    clock.reset(presentedSerial, clock.masterMs() + dropMs);
+                if(traceEnabled())
+                    traceInstant("live drop", "ms", dropMs);
+            }
+            if(rate != clock.rate())
             {
-                if(g_videoPkts.empty() || g_audioPkts.empty())
+                clock.setRate(rate);
+                if(currentAudioSource >= 0)
+                    sound->changeSpeed(rate);
+            }
+        }
+        lastAudioUnderruns = audioUnderruns;
+        
+        bool present = false;
+        if(frame && frame->serial != presentedSerial)
+        {
+            // A file's audio starts by itself, after a seek it is moved
+            if(!itemStart)
+            {
+                Demuxer& demuxer = current->demuxer();
+                auto requested = demuxer.lastSeekRequestTime();
+                if(requested != std::chrono::steady_clock::time_point())
                 {
-                    for(auto p : g_videoPkts)
-                    {
-                        av_free_packet(p);
-                        av_free(p);
-                    }
-                    
-                    for(auto p : g_audioPkts)
-                    {
-                        av_free_packet(p);
-                        av_free(p);
-                    }
-                    
-                    break;
+                    auto now = std::chrono::steady_clock::now();
+                    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - requested).count();
+                    StageStats& seekStats = demuxer.lastSeekUsedIndex() ? indexedSeekStats : containerSeekStats;
+                    seekStats.record(0, latency);
+                    if(traceEnabled())
+                        traceComplete(seekStats.name(), requested, now);
                 }
-                else
+                
+                if(currentAudioSource >= 0 && !paused && isKeyframeOnly(speed))
                 {
-                    av_free_packet(packet_ptr);
-                    av_free(packet_ptr);
-                    
-                    packet_ptr = 0;
+                    sound->stop();
                 }
-            }
-            
-            if(packet_ptr)
-            {
-                AVPacket& packet = *packet_ptr;
-                if(packet.stream_index == videoStream)
+                else if(currentAudioSource >= 0 && !paused)
                 {
-                    //of << "new video pkt\n";
-                    g_videoPkts.push_back(packet_ptr);
+                    sound->setPlayingOffset(sf::milliseconds(frame->ptsMs));
+                    if(sound->getStatus() != sf::SoundStream::Playing)
+                        sound->play();
                 }
-                else if(packet.stream_index == audioStream)
+            }
+            clock.reset(frame->serial, frame->ptsMs);
+            if(paused)
+                clock.pause();
+            sinceAudioResync.restart();
+            presentedSerial = frame->serial;
+            previewSerial = -1;
+            present = true;
+        }
+        else if(frame && paused)
+        {
+            present = stepForward;
+            stepForward = false;
+        }
+        else if(frame)
+        {
+            // Rewinding, frames are due as the clock drops to them
+            const sf::Int64 now = clock.masterMs();
+            auto isDue = [&](const VideoFrame* f){ return speed < 0 ? f->ptsMs >= now : f->ptsMs <= now; };
+            if(isDue(frame))
+            {
+                // Skip to the most recent frame the clock has reached
+                VideoFrame* next = videoFrames.peekNext();
+                while (next && next->serial == serial && isDue(next))
                 {
-                    if(packet_ptr->pts >= blockPts && !syncAV)
-                    {
-                        std::lock_guard<std::mutex> lk(g_mut);
-                        for(auto p : audioSyncBuffer)
-                        {
-                            if(p->pts >= blockPts)
-                            {
-                                g_audioPkts.push_back(p);
-                            }
-                            else
-                            {
-                                av_free_packet(p);
-                                av_free(p);
-                            }
-                        }
-                        g_audioPkts.push_back(packet_ptr);
-                        g_newPktCondition.notify_one();
-                        
-                        audioSyncBuffer.clear();
-                    }
-                    
-                    if(syncAV)
-                    {
-                        audioSyncBuffer.push_back(packet_ptr);
-                    }
-                    
-                    //of << "new audio pkt\n";
+                    videoFrames.next();
+                    ++presentDrops;
+                    frame = next;
+                    next = videoFrames.peekNext();
                 }
+                if(speed == 1)
+                    clock.recordDrift(frame->ptsMs - now);
+                present = true;
             }
         }
         
-        const auto pStream = pFormatCtx->streams[videoStream];
-        
-        //of << "sound : " << sound.timeElapsed() << std::endl;
-        if(sound.timeElapsed() > m_lastDecodedTimeStamp && sound.isAudioReady() && !g_videoPkts.empty())
+        if(present)
         {
-            packet_ptr = g_videoPkts.front();
-            g_videoPkts.pop_front();
+            if(!paused)
+                clock.updateVideo(frame->ptsMs);
             
-            auto decodedLength = avcodec_decode_video2(pCodecCtx, pFrame, &frameFinished, packet_ptr);
+            uploadFrame(*frame);
+            if(!isKeyframeOnly(speed))
+                frameCache.add(*frame);
+            videoFrames.next();
+            displayFrame();
+            ++presentedFrames;
             
-            if(frameFinished)
+            const auto now = std::chrono::steady_clock::now();
+            std::chrono::steady_clock::time_point arrived;
+            if(jitter && current->demuxer().arrivalTime(shownPtsMs, arrived))
+                jitter->recordLatency(std::chrono::duration_cast<std::chrono::microseconds>(now - arrived).count());
+            
+            if(itemStart)
             {
-                sws_scale(sws_ctx, (uint8_t const * const *)pFrame->data, pFrame->linesize, 0, pCodecCtx->height, pFrameRGB->data, pFrameRGB->linesize);
-                
-                for (int i = 0, j = 0; i < FrameSize; i += 3, j += 4)
-                {
-                    Data[j + 0] = pFrameRGB->data[0][i + 0];
-                    Data[j + 1] = pFrameRGB->data[0][i + 1];
-                    Data[j + 2] = pFrameRGB->data[0][i + 2];
-                    Data[j + 3] = 255;
-                }
-                
-                im_video.update(Data);
-                
-                // Clear screen
-                window.clear();
-                
-                window.draw(sprite);
-                window.draw(text);
+                itemStart = false;
+                startup.mark(StartupTimer::FirstVideoFrame);
+                if(options.seekIndex && options.fastStart)
+                    current->keyframes().start();
                 
-                window.display();
-                
-                int64_t timestamp = av_frame_get_best_effort_timestamp(pFrame);
-                int64_t startTime = pStream->start_time != AV_NOPTS_VALUE ? pStream->start_time : 0;
-                int64_t ms = 1000 * (timestamp - startTime) * av_q2d(pStream->time_base);
-                m_lastDecodedTimeStamp = ms;
-                
-                if(syncAV)
+                if(playlist.position() > 1)
                 {
-                    blockPts = ms;
-                    sound.setPlayingOffset(sf::milliseconds(blockPts));
-                    
-                    syncAV = false;
+                    // Beyond the time the previous file's last frame was due
+                    const sf::Int64 shownUs = std::chrono::duration_cast<std::chrono::microseconds>(now - lastPresentTime).count();
+                    const sf::Int64 gapUs = std::max<sf::Int64>(0, shownUs - previousIntervalMs * 1000);
+                    gapStats.record(0, gapUs);
+                    std::cout << "item " << playlist.position() << "/" << playlist.size() << ": "
+                              << current->media().path() << ", gap " << gapUs / 1000.0 << " ms" << std::endl;
                 }
-                
-            }
-            
-            if(decodedLength < packet_ptr->size)
-            {
-                packet_ptr->data += decodedLength;
-                packet_ptr->size -= decodedLength;
-                
-                g_videoPkts.push_front(packet_ptr);
             }
-            else
+            lastPresentTime = now;
+            lastPresentedPtsMs = frame->ptsMs;
+        }
+        else
+        {
+            // Nothing due yet, don't spin on the event queue
+            sf::sleep(sf::milliseconds(1));
+        }
+        
+        if(audioPlaying && clock.master() != SyncClock::AudioMaster && sinceAudioResync.getElapsedTime() > AudioResyncInterval
+           && sound->decodingSource() == currentAudioSource)
+        {
+            const sf::Int64 masterNow = clock.masterMs();
+            if(std::llabs(sound->timeElapsed() - masterNow) > AudioResyncMs)
             {
-                av_free_packet(packet_ptr);
-                av_free(packet_ptr);
+                sound->setPlayingOffset(sf::milliseconds(masterNow));
+                ++audioResyncs;
             }
+            sinceAudioResync.restart();
         }
-        
     }
     
-    of.close();
-    
-    sws_freeContext(sws_ctx);
-    av_free(buffer);
-    av_free(pFrameRGB);
-    av_free(pFrame);
-    avcodec_close(pCodecCtx);
-    avcodec_close(paCodecCtx);
-    avformat_close_input(&pFormatCtx);
+    // The sound reads the audio queues of the current and retired files,
+    // stop it before them
+    if(sound)
+        sound->shutdown();
+    playlist.stop();
+    next.reset();
+    current->stop();
+    retired.clear();
+    
+    finishTrace();
+    
+    // Stats below are the last file's, apart from the playlist's own
+    Demuxer& demuxer = current->demuxer();
+    VideoDecoder& videoDecoder = current->videoDecoder();
+    
+    startup.print(std::cout);
+    std::cout << "stage latency:\n";
+    demuxer.readStats().print(std::cout);
+    videoDecoder.decodeStats().print(std::cout);
+    videoDecoder.scaleStats().print(std::cout);
+    if(sound)
+    {
+        sound->decoder().decodeStats().print(std::cout);
+        sound->decoder().resampleStats().print(std::cout);
+        sound->getDataStats().print(std::cout);
+    }
+    textureStats.print(std::cout);
+    displayStats.print(std::cout);
+    indexedSeekStats.print(std::cout);
+    containerSeekStats.print(std::cout);
+    cacheSeekStats.print(std::cout);
+    if(playlist.size() > 1)
+    {
+        playlist.openStats().print(std::cout);
+        gapStats.print(std::cout);
+    }
     
-    delete [] Data;
+    clock.printStats(std::cout);
+    std::cout << "  scaling filter at exit: " << RgbaConverter::filterName(videoDecoder.scaleFilter()) << "\n";
+    std::cout << "  late frames dropped: " << videoDecoder.lateDrops() << " in the decoder, "
+              << presentDrops << " at presentation; non-reference skipping engaged "
+              << videoDecoder.nonRefSkips() << " times\n"
+              << "  frames decoded to reach exact seek targets: " << videoDecoder.seekDiscards()
+              << ", keyframes indexed: " << current->keyframes().size() << "\n"
+              << "  keyframes hopped to in trick play: " << demuxer.trickHops() << "\n";
+    if(sound)
+    {
+        std::cout << "  audio underruns: " << sound->underruns()
+                  << ", resyncs to the master clock: " << audioResyncs << std::endl;
+    }
+    if(jitter)
+        jitter->printStats(std::cout);
+    
+    printQueueStats(std::cout, "video", current->videoPackets().stats());
+    printQueueStats(std::cout, "audio", current->audioPackets().stats());
+    std::cout << "packet budget: peak " << current->packetBudget().peak() / 1024 << " KiB of "
+              << current->packetBudget().limit() / 1024 << " KiB; reading paused "
+              << demuxer.queueWaits() << " times for full queues, "
+              << demuxer.budgetWaits() << " for the budget\n";
+    
+    current->packetPool().printStats(std::cout);
+    frameCache.printStats(std::cout);
+    const InputSource* input = current->media().inputSource();
+    if(input)
+        input->stats().print(std::cout, input->name());
 
     return EXIT_SUCCESS;
 }